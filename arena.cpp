@@ -0,0 +1,111 @@
+/* klondike/arena.cpp
+ * by python-b5
+ *
+ * A bump allocator for short-lived scratch memory that is freed in the
+ * reverse order it was allocated.
+ *
+ * Allocating just moves an offset forward through the current block, and
+ * freeing moves it back, so neither ever touches the heap once the arena has
+ * enough blocks. Each thread uses its own arena, so there is nothing to
+ * contend over either.
+ */
+
+
+// project includes
+#include "arena.hpp"
+
+// standard libraries
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+
+/* Arena implementation:
+ * A stack-ordered scratch allocator.
+ */
+
+Arena::Arena(size_t block_size_):
+    block_size(block_size_),
+    block(0),
+    offset(0),
+    used(0),
+    peak(0)
+{}
+
+/* Allocates a number of bytes with a given alignment (which must be a power
+ * of two no larger than a std::max_align_t's).
+ * Returns the memory, which stays valid until released.
+ */
+void *Arena::allocate(size_t size, size_t alignment) {
+    for (;;) {
+        if (block < blocks.size()) {
+            // (blocks come from the heap, so they start suitably aligned)
+            size_t start = (offset + alignment - 1) & ~(alignment - 1);
+
+            if (start + size <= blocks[block].size()) {
+                used += start + size - offset;
+                peak = std::max(peak, used);
+                offset = start + size;
+
+                return blocks[block].data() + start;
+            }
+
+            // move on to the next block, counting the rest of this one as
+            // used so releasing gives it back
+            used += blocks[block].size() - offset;
+            ++block;
+            offset = 0;
+
+            continue;
+        }
+
+        blocks.emplace_back(std::max(block_size, size));
+    }
+}
+
+/* Returns a point to release the arena back to later. */
+Arena::Mark Arena::mark() const {
+    Mark result;
+
+    result.block = block;
+    result.offset = offset;
+    result.used = used;
+
+    return result;
+}
+
+/* Frees everything allocated since a mark was taken. */
+void Arena::release(const Mark &mark_) {
+    block = mark_.block;
+    offset = mark_.offset;
+    used = mark_.used;
+}
+
+/* Frees everything allocated, keeping the blocks for reuse. */
+void Arena::reset() {
+    block = 0;
+    offset = 0;
+    used = 0;
+}
+
+/* Returns the number of bytes currently allocated. */
+size_t Arena::get_used() const {
+    return used;
+}
+
+/* Returns the most bytes that have ever been allocated at once. */
+size_t Arena::get_peak() const {
+    return peak;
+}
+
+/* Returns the number of bytes the arena holds onto. */
+size_t Arena::get_capacity() const {
+    size_t capacity = 0;
+
+    for (const std::vector<uint8_t> &block_ : blocks) {
+        capacity += block_.size();
+    }
+
+    return capacity;
+}
@@ -0,0 +1,70 @@
+/* klondike/arena.hpp
+ * by python-b5
+ *
+ * A bump allocator for short-lived scratch memory that is freed in the
+ * reverse order it was allocated.
+ */
+
+
+// standard libraries
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef ARENA
+    #define ARENA
+
+    class Arena {
+        // blocks are kept until the arena is destroyed, so once it has grown
+        // to fit the most it ever holds at once, it never allocates again
+        std::vector<std::vector<uint8_t>> blocks;
+        size_t block_size;
+
+        size_t block;
+        size_t offset;
+
+        size_t used;
+        size_t peak;
+
+        public:
+            /* A point to release an arena back to: everything allocated
+             * after it was taken is freed together.
+             */
+            struct Mark {
+                size_t block;
+                size_t offset;
+                size_t used;
+            };
+
+            static const size_t DEFAULT_BLOCK_SIZE = 1 << 16;
+
+            explicit Arena(size_t block_size = DEFAULT_BLOCK_SIZE);
+
+            // blocks are owned by the arena
+            Arena(const Arena &) = delete;
+            Arena &operator=(const Arena &) = delete;
+
+            void *allocate(size_t size, size_t alignment);
+
+            template <typename T>
+            T *allocate(size_t count);
+
+            Mark mark() const;
+            void release(const Mark &mark);
+            void reset();
+
+            size_t get_used() const;
+            size_t get_peak() const;
+            size_t get_capacity() const;
+    };
+
+
+    /* Allocates space for a number of objects of a trivial type (which are
+     * left uninitialized).
+     */
+    template <typename T>
+    T *Arena::allocate(size_t count) {
+        return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+#endif
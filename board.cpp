@@ -0,0 +1,442 @@
+/* klondike/board.cpp
+ * by python-b5
+ *
+ * Draws a position on the screen: the stock, the taken cards, the
+ * foundations and the tableau.
+ *
+ * Drawing only depends on the position and the overlay passed in, so the
+ * same code serves the game, and tools that render positions without a
+ * window.
+ */
+
+
+// project includes
+#include "board.hpp"
+#include "wrapper.hpp"
+#include "engine.hpp"
+
+// standard libraries
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+// C standard libraries
+#include <cmath>
+
+
+// using declarations
+using namespace board;
+
+
+// card sprites
+wrapper::Sprite board::cards[52];
+wrapper::Sprite board::cards_back;
+wrapper::Sprite board::cards_base;
+
+wrapper::Atlas board::atlas;
+
+Layout board::layout;
+
+// (boards drawn into batches are laid out at their own size, then scaled by
+// the batch's target instead)
+const Layout UNSCALED;
+
+
+/* helper functions */
+
+/* Draws one of the card images (a card, BACK_IMAGE or BASE_IMAGE) at a
+ * position on the board, optionally highlighted.
+ */
+static void draw_image(
+    int image, int x, int y, bool highlighted, const Target &target
+) {
+    if (target.batch != NULL) {
+        target.batch->draw(
+            image, target.x + x * target.scale, target.y + y * target.scale,
+            target.scale,
+            highlighted ? HINT_TINT : wrapper::Color(255, 255, 255)
+        );
+
+        return;
+    }
+
+    wrapper::Sprite &sprite = image == BACK_IMAGE ? cards_back
+                              : image == BASE_IMAGE ? cards_base
+                              : cards[image];
+
+    if (highlighted) {
+        sprite.draw(x, y, HINT_TINT);
+    } else {
+        sprite.draw(x, y);
+    }
+}
+
+
+/* Layout implementation:
+ * Where the piles go on the screen.
+ */
+
+Layout::Layout(): Layout(WIDTH, HEIGHT) {}
+
+Layout::Layout(int screen_width, int screen_height) {
+    // (a window shrunk to nothing still gets a usable layout)
+    scale = std::max(
+        0.05f, std::min(
+            static_cast<float>(screen_width) / WIDTH,
+            static_cast<float>(screen_height) / HEIGHT
+        )
+    );
+
+    auto scaled = [&](int length) -> int {
+        return static_cast<int>(std::lround(length * scale));
+    };
+
+    x = std::max(0, (screen_width - scaled(WIDTH)) / 2);
+    y = 0;
+
+    card_width = scaled(CARD_WIDTH);
+    card_height = scaled(CARD_HEIGHT);
+
+    stock_spacing = scaled(2);
+    waste_spacing_x = scaled(15);
+    waste_spacing_y = scaled(2);
+    face_down_spacing = scaled(3);
+    face_up_spacing = scaled(15);
+
+    stock_x = x + scaled(15);
+    stock_y = y + scaled(15);
+    waste_x = x + scaled(101);
+    waste_y = y + scaled(15);
+
+    for (int i = 0; i < 4; ++i) {
+        foundation_x[i] = x + scaled(273 + 86 * i);
+    }
+
+    foundation_y = y + scaled(15);
+
+    for (int i = 0; i < 7; ++i) {
+        stack_x[i] = x + scaled(15 + 86 * i);
+    }
+
+    stack_y = y + scaled(126);
+
+    status = wrapper::BBox(
+        x + scaled(237), y + scaled(100),
+        x + scaled(247) - 1, y + scaled(110) - 1
+    );
+}
+
+/* Returns the bounding box of a card drawn at a given position. */
+wrapper::BBox Layout::card_bbox(int card_x, int card_y) const {
+    return wrapper::BBox(
+        card_x, card_y, card_x + card_width - 1, card_y + card_height - 1
+    );
+}
+
+
+/* Target implementation:
+ * Where a board is drawn.
+ */
+
+Target::Target():
+    batch(NULL),
+    x(0), y(0),
+    scale(1)
+{}
+
+Target::Target(wrapper::Batch &batch_, float x_, float y_, float scale_):
+    batch(&batch_),
+    x(x_), y(y_),
+    scale(scale_)
+{}
+
+/* Returns the layout to draw with: the screen's, or (for a batch) the board
+ * at its own size.
+ */
+const Layout &Target::get_layout() const {
+    return batch != NULL ? UNSCALED : layout;
+}
+
+
+/* DealtCard implementation:
+ * A card as it is shown on the board.
+ */
+
+DealtCard::DealtCard(engine::Card card_, bool face_up_, bool highlighted_):
+    card(card_),
+    face_up(face_up_),
+    highlighted(highlighted_)
+{}
+
+/* Draws the appropriate card sprite at a given position. */
+void DealtCard::draw(int x, int y, const Target &target) const {
+    draw_image(face_up ? card : BACK_IMAGE, x, y, highlighted, target);
+}
+
+
+/* CardStack implementation:
+ * One of the tableau's stacks as it is shown on the board.
+ */
+
+CardStack::CardStack(const engine::Pile &pile_):
+    pile(pile_)
+{}
+
+/* Returns the card at a given index (counting from the bottom). */
+DealtCard CardStack::card(size_t i) const {
+    return DealtCard(pile.cards[i], i >= pile.face_down);
+}
+
+/* Draws the CardStack at a given position, optionally skipping a provided
+ * number of cards and highlighting another (both counting from the top of
+ * the stack). Highlighting an empty stack highlights the space it's in.
+ *
+ * Face-up cards are drawn with more spacing.
+ */
+void CardStack::draw(
+    int x, int y, int skip, int highlight, const Target &target
+) const {
+    const Layout &placement = target.get_layout();
+    size_t shown = pile.size - static_cast<size_t>(skip);
+
+    if (shown == 0 && highlight != 0) {
+        draw_image(BASE_IMAGE, x, y, true, target);
+    }
+
+    int draw_y = y;
+
+    for (size_t i = 0; i < shown; ++i) {
+        DealtCard dealt_card = card(i);
+        dealt_card.highlighted = i + highlight >= shown;
+        dealt_card.draw(x, draw_y, target);
+
+        if (i >= pile.face_down) {
+            draw_y += placement.face_up_spacing;
+        } else {
+            draw_y += placement.face_down_spacing;
+        }
+    }
+}
+
+/* Returns a bounding box representing the top card in the CardStack,
+ * starting at a specified position. If the stack is empty, it behaves as if
+ * it has one card.
+ */
+wrapper::BBox CardStack::get_top_card_bbox(
+    int start_x, int start_y, const Layout &layout_
+) const {
+    int y = start_y;
+
+    for (size_t i = 0; i + 1 < pile.size; ++i) {
+        if (i >= pile.face_down) {
+            y += layout_.face_up_spacing;
+        } else {
+            y += layout_.face_down_spacing;
+        }
+    }
+
+    return layout_.card_bbox(start_x, y);
+}
+
+
+/* Overlay implementation:
+ * Differences from the position to show on the board.
+ */
+
+Overlay::Overlay():
+    skip_waste(false),
+    skip_foundation(-1),
+    skip_stack(-1),
+    skip_count(0),
+    hinting(false)
+{}
+
+
+/* functions */
+
+/* Loads the card sprites. This must be done after initializing the wrapper. */
+void board::load_sprites() {
+    // (This is in another file to save space. Is this good practice?
+    // Probably not... but honestly, I'd rather do this than have 55 lines of
+    // *very* repetitive code sitting here.)
+    #include "load_cards.cpp"
+}
+
+/* Lays the board out to fit a screen of a given size, resampling the card
+ * sprites to match (so they are scaled once here, not every time they are
+ * drawn). This must be done after loading the sprites.
+ */
+void board::resize(int screen_width, int screen_height) {
+    layout = Layout(screen_width, screen_height);
+
+    for (wrapper::Sprite &card : cards) {
+        card.set_scale(layout.scale);
+    }
+
+    cards_back.set_scale(layout.scale);
+    cards_base.set_scale(layout.scale);
+}
+
+/* Loads the card images into the atlas, in the same order as cards, followed
+ * by the back (BACK_IMAGE) and the empty space (BASE_IMAGE). This must be
+ * done after initializing the wrapper.
+ * Returns whether it was successful.
+ */
+bool board::load_atlas() {
+    const char *ranks[13] = {
+        "ace", "2", "3", "4", "5", "6", "7", "8", "9", "10",
+        "jack", "queen", "king"
+    };
+    const char *suits[4] = {"clubs", "diamonds", "hearts", "spades"};
+
+    std::vector<std::string> files;
+
+    for (const char *suit : suits) {
+        for (const char *rank : ranks) {
+            files.push_back(
+                std::string("assets/cards/") + rank + "_" + suit + ".bmp"
+            );
+        }
+    }
+
+    files.push_back("assets/cards/back.bmp");
+    files.push_back("assets/cards/base.bmp");
+
+    return atlas.load(files);
+}
+
+/* Draws a foundation at a given position, optionally showing the
+ * second-to-top card instead of the top one, and optionally highlighted.
+ */
+void board::draw_foundation(
+    const engine::Foundation &foundation, int x, int y, bool second_to_top,
+    bool highlighted, const Target &target
+) {
+    int shown = foundation.next - static_cast<int>(second_to_top);
+
+    if (shown <= 0) {
+        draw_image(BASE_IMAGE, x, y, highlighted, target);
+    } else {
+        DealtCard(
+            engine::make_card(shown - 1, foundation.suit), true, highlighted
+        ).draw(x, y, target);
+    }
+}
+
+/* Draws a position (without clearing the screen first), either to the screen
+ * or into a batch.
+ */
+void board::draw(
+    const engine::State &state, const Overlay &overlay, const Target &target
+) {
+    // work out which cards the hint (if any) highlights
+    bool hinting = overlay.hinting;
+    const engine::Move &hinted = overlay.hint;
+
+    bool hint_stock = hinting && hinted.type == engine::DRAW;
+    bool hint_waste = hinting && (
+        hinted.type == engine::WASTE_TO_FOUNDATION
+        || hinted.type == engine::WASTE_TO_TABLEAU
+    );
+
+    // (foundations and tableau stacks can be moved from or to)
+    auto hint_foundation = [&](size_t i) -> bool {
+        if (!hinting) {
+            return false;
+        }
+
+        switch (hinted.type) {
+            case engine::WASTE_TO_FOUNDATION:
+            case engine::TABLEAU_TO_FOUNDATION:
+                return hinted.to == i;
+
+            case engine::FOUNDATION_TO_TABLEAU:
+                return hinted.from == i;
+
+            default: return false;
+        }
+    };
+
+    auto hint_stack = [&](size_t i) -> int {
+        if (!hinting) {
+            return 0;
+        }
+
+        switch (hinted.type) {
+            case engine::FLIP:
+            case engine::TABLEAU_TO_FOUNDATION:
+                return hinted.from == i ? 1 : 0;
+
+            case engine::TABLEAU_TO_TABLEAU:
+                if (hinted.from == i) {
+                    return hinted.count;
+                }
+
+                return hinted.to == i ? 1 : 0;
+
+            case engine::WASTE_TO_TABLEAU:
+            case engine::FOUNDATION_TO_TABLEAU:
+                return hinted.to == i ? 1 : 0;
+
+            default: return 0;
+        }
+    };
+
+    const Layout &placement = target.get_layout();
+
+    // draw stock
+    if (state.stock_size == 0) {
+        draw_image(
+            BASE_IMAGE, placement.stock_x, placement.stock_y, hint_stock,
+            target
+        );
+    } else {
+        int extra_cards = state.stock_size / 10;
+
+        for (int i = 0; i <= extra_cards; ++i) {
+            int offset = placement.stock_spacing * i;
+
+            DealtCard(0, false, hint_stock && i == extra_cards).draw(
+                placement.stock_x - offset, placement.stock_y - offset,
+                target
+            );
+        }
+    }
+
+    // draw taken cards
+    int first_taken = state.waste_size - state.taken;
+
+    for (
+        int i = 0;
+        i < state.taken - static_cast<int>(overlay.skip_waste);
+        ++i
+    ) {
+        DealtCard(
+            state.waste[first_taken + i], true,
+            hint_waste && i == state.taken - 1
+        ).draw(
+            placement.waste_x + placement.waste_spacing_x * i,
+            placement.waste_y + placement.waste_spacing_y * i, target
+        );
+    }
+
+    // draw foundations
+    for (int i = 0; i < 4; ++i) {
+        draw_foundation(
+            state.foundations[i], placement.foundation_x[i],
+            placement.foundation_y, overlay.skip_foundation == i,
+            hint_foundation(i), target
+        );
+    }
+
+    // draw tableau
+    for (int i = 0; i < 7; ++i) {
+        // draw stack, skipping cards if being dragged from
+        CardStack(state.tableau[i]).draw(
+            placement.stack_x[i], placement.stack_y,
+            overlay.skip_stack == i ? overlay.skip_count : 0,
+            hint_stack(i), target
+        );
+    }
+}
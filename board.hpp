@@ -0,0 +1,185 @@
+/* klondike/board.hpp
+ * by python-b5
+ *
+ * Draws a position on the screen: the stock, the taken cards, the
+ * foundations and the tableau.
+ */
+
+
+// project includes
+#include "wrapper.hpp"
+#include "engine.hpp"
+
+// standard libraries
+#include <cstddef>
+
+
+#ifndef BOARD
+    #define BOARD
+
+    namespace board {
+        // constants
+        // (the size of the board, which the window starts out fitting; it is
+        // scaled to fit the screen from there, see Layout)
+        const int WIDTH = 617;
+        const int HEIGHT = 417;
+
+        // (the size of the card images, at the board's own size)
+        const int CARD_WIDTH = 71;
+        const int CARD_HEIGHT = 96;
+
+        // (the background color from Microsoft Solitaire)
+        const wrapper::Color BACKGROUND(0, 128, 0);
+
+        // (tinting cards yellow is enough to make them stand out without new
+        // sprites)
+        const wrapper::Color HINT_TINT(255, 255, 128);
+
+
+        // (where the back and the empty space are in the atlas, after the
+        // cards themselves)
+        const int BACK_IMAGE = 52;
+        const int BASE_IMAGE = 53;
+
+
+        // card sprites (see load_sprites()), and the same images packed
+        // into one atlas for drawing in batches (see load_atlas())
+        extern wrapper::Sprite cards[52];
+        extern wrapper::Sprite cards_back;
+        extern wrapper::Sprite cards_base;
+
+        extern wrapper::Atlas atlas;
+
+
+        /* Where everything on the board goes on the screen, in pixels: the
+         * board scaled as large as fits (keeping its shape), centered
+         * horizontally. It is worked out once whenever the screen changes
+         * size (see resize()), and both drawing and working out what was
+         * clicked go by it.
+         */
+        struct Layout {
+            float scale;
+            int x, y;
+
+            // (the size cards are drawn at)
+            int card_width;
+            int card_height;
+
+            // how far each card is offset from the one under it: in the stock
+            // (for every ten cards), in the taken cards, and in a tableau
+            // stack (face-down and face-up)
+            int stock_spacing;
+            int waste_spacing_x;
+            int waste_spacing_y;
+            int face_down_spacing;
+            int face_up_spacing;
+
+            // where the bottom card of each pile goes
+            int stock_x, stock_y;
+            int waste_x, waste_y;
+            int foundation_x[4];
+            int foundation_y;
+            int stack_x[7];
+            int stack_y;
+
+            // (the game's status indicator, in the gap between the taken
+            // cards and the foundations, where no card can ever be drawn)
+            wrapper::BBox status;
+
+            Layout();
+            Layout(int screen_width, int screen_height);
+
+            wrapper::BBox card_bbox(int card_x, int card_y) const;
+        };
+
+        // the layout the screen is drawn with (at the board's own size until
+        // resize() is called)
+        extern Layout layout;
+
+
+        /* Where to draw a board: straight to the screen at full size, or
+         * queued into a batch of atlas images, offset and scaled (for
+         * showing many boards at once).
+         */
+        struct Target {
+            wrapper::Batch *batch;
+            float x, y;
+            float scale;
+
+            Target();
+            Target(wrapper::Batch &batch_, float x_, float y_, float scale_);
+
+            const Layout &get_layout() const;
+        };
+
+
+        /* A dealt playing card for displaying on-screen, optionally
+         * highlighted (for showing hints).
+         */
+        struct DealtCard {
+            engine::Card card;
+            bool face_up;
+            bool highlighted;
+
+            DealtCard(
+                engine::Card card_, bool face_up_, bool highlighted_ = false
+            );
+
+            void draw(int x, int y, const Target &target = Target()) const;
+        };
+
+        /* A stack of dealt cards, for displaying one of the tableau's stacks
+         * on-screen. The cards themselves are owned by the engine.
+         */
+        struct CardStack {
+            const engine::Pile &pile;
+
+            CardStack(const engine::Pile &pile_);
+
+            DealtCard card(size_t i) const;
+
+            void draw(
+                int x, int y, int skip = 0, int highlight = 0,
+                const Target &target = Target()
+            ) const;
+            wrapper::BBox get_top_card_bbox(
+                int start_x, int start_y, const Layout &layout_ = layout
+            ) const;
+        };
+
+        /* What to show differently from the position itself: the cards left
+         * out because they are being dragged (from the top of the waste, a
+         * foundation or a tableau stack, with -1 meaning none), and the move
+         * a hint is highlighting, if any.
+         */
+        struct Overlay {
+            bool skip_waste;
+            int skip_foundation;
+            int skip_stack;
+            size_t skip_count;
+
+            bool hinting;
+            engine::Move hint;
+
+            Overlay();
+        };
+
+
+        // functions
+        void load_sprites();
+        bool load_atlas();
+
+        void resize(int screen_width, int screen_height);
+
+        void draw_foundation(
+            const engine::Foundation &foundation, int x, int y,
+            bool second_to_top, bool highlighted = false,
+            const Target &target = Target()
+        );
+
+        void draw(
+            const engine::State &state, const Overlay &overlay = Overlay(),
+            const Target &target = Target()
+        );
+    }
+#endif
@@ -0,0 +1,253 @@
+/* klondike/capture.cpp
+ * by python-b5
+ *
+ * Records frames to disk on a background thread, as a sequence of bitmaps or
+ * one raw stream of pixels.
+ *
+ * Frames are read back into a fixed pool of buffers and queued for a writer
+ * thread, so the thread drawing them only ever copies pixels. If the writer
+ * falls behind and every buffer is in use, frames are dropped (and counted)
+ * instead of making the game wait, so recording never holds up a frame.
+ *
+ * Raw streams are just the frames' pixels one after another: 32-bit ARGB,
+ * which is "bgra" byte order on a little-endian machine. They can be encoded
+ * with something like:
+ *   ffmpeg -f rawvideo -pixel_format bgra -video_size 617x417 -framerate 60
+ *          -i klondike.raw klondike.mp4
+ */
+
+
+// project includes
+#include "capture.hpp"
+
+// standard libraries
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+
+// external libraries
+#include <SDL2/SDL.h>
+
+
+/* FrameCapture implementation:
+ * A pool of frame buffers and the thread that writes them out.
+ */
+
+FrameCapture::FrameCapture():
+    format(CAPTURE_IMAGES),
+    width(0),
+    height(0),
+    output(NULL),
+    queue_start(0),
+    queue_size(0),
+    stopping(false),
+    captured(0),
+    written(0),
+    dropped(0),
+    failed(false)
+{}
+
+FrameCapture::~FrameCapture() {
+    stop();
+}
+
+/* Starts capturing frames of a given size to a path (a directory for
+ * bitmaps, or a file for a raw stream), with a given number of buffers for
+ * frames waiting to be written.
+ * Returns whether it was successful.
+ */
+bool FrameCapture::start(
+    const std::string &path_, CaptureFormat format_, int width_, int height_,
+    int pool_size
+) {
+    stop();
+
+    path = path_;
+    format = format_;
+    width = width_;
+    height = height_;
+
+    if (format == CAPTURE_RAW) {
+        output = std::fopen(path.c_str(), "wb");
+
+        if (output == NULL) {
+            return false;
+        }
+    }
+
+    // allocate everything now, so capturing a frame never allocates
+    pool.assign(
+        pool_size, std::vector<uint32_t>(static_cast<size_t>(width) * height)
+    );
+
+    free_buffers.clear();
+    free_buffers.reserve(pool_size);
+
+    for (std::vector<uint32_t> &buffer : pool) {
+        free_buffers.push_back(buffer.data());
+    }
+
+    queue.assign(pool_size, NULL);
+    queue_start = 0;
+    queue_size = 0;
+
+    stopping = false;
+
+    captured.store(0);
+    written.store(0);
+    dropped.store(0);
+    failed.store(false);
+
+    writer = std::thread(&FrameCapture::run, this);
+
+    return true;
+}
+
+/* Stops capturing, waiting for every frame already captured to be written. */
+void FrameCapture::stop() {
+    if (!writer.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    wake.notify_one();
+    writer.join();
+
+    if (output != NULL) {
+        std::fclose(output);
+        output = NULL;
+    }
+
+    pool.clear();
+    free_buffers.clear();
+    queue.clear();
+}
+
+/* Checks if frames are being captured. */
+bool FrameCapture::is_running() const {
+    return writer.joinable();
+}
+
+/* Takes a free buffer to read a frame into, which must then be submitted.
+ * Returns NULL if there isn't one (the frame is counted as dropped), or if
+ * writing has failed.
+ */
+uint32_t *FrameCapture::acquire() {
+    if (!writer.joinable() || failed.load(std::memory_order_relaxed)) {
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (free_buffers.empty()) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    uint32_t *buffer = free_buffers.back();
+    free_buffers.pop_back();
+
+    return buffer;
+}
+
+/* Queues a buffer taken with acquire() (now holding a frame) to be written. */
+void FrameCapture::submit(uint32_t *buffer) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // (there are only as many buffers as places in the queue, so it can
+        // never be full)
+        queue[(queue_start + queue_size) % queue.size()] = buffer;
+        ++queue_size;
+    }
+
+    captured.fetch_add(1, std::memory_order_relaxed);
+    wake.notify_one();
+}
+
+/* Returns how many frames have been captured, written and dropped. */
+CaptureStats FrameCapture::get_stats() const {
+    CaptureStats stats;
+
+    stats.captured = captured.load();
+    stats.written = written.load();
+    stats.dropped = dropped.load();
+
+    return stats;
+}
+
+/* The writer thread's loop: writes queued frames in order, handing each
+ * buffer back once it's done, until stopped with nothing left to write.
+ */
+void FrameCapture::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    unsigned long frame = 0;
+
+    while (true) {
+        wake.wait(lock, [this] { return stopping || queue_size != 0; });
+
+        if (queue_size == 0) {
+            break;
+        }
+
+        uint32_t *buffer = queue[queue_start];
+        queue_start = (queue_start + 1) % queue.size();
+        --queue_size;
+
+        lock.unlock();
+
+        // (once a write fails, the rest would too, so frames stop being
+        // captured)
+        if (!failed.load() && write(buffer, frame)) {
+            written.fetch_add(1);
+        } else {
+            failed.store(true);
+        }
+
+        ++frame;
+
+        lock.lock();
+        free_buffers.push_back(buffer);
+    }
+}
+
+/* Writes out a frame.
+ * Returns whether it was successful.
+ */
+bool FrameCapture::write(const uint32_t *pixels, unsigned long frame) {
+    size_t size = static_cast<size_t>(width) * height;
+
+    if (format == CAPTURE_RAW) {
+        return std::fwrite(pixels, 4, size, output) == size;
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "/frame-%06lu.bmp", frame);
+
+    // (the surface only borrows the pixels, so nothing is copied)
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(
+        const_cast<uint32_t *>(pixels), width, height, 32, width * 4,
+        SDL_PIXELFORMAT_ARGB8888
+    );
+
+    if (surface == NULL) {
+        return false;
+    }
+
+    bool success = SDL_SaveBMP(surface, (path + name).c_str()) == 0;
+    SDL_FreeSurface(surface);
+
+    return success;
+}
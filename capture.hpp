@@ -0,0 +1,94 @@
+/* klondike/capture.hpp
+ * by python-b5
+ *
+ * Records frames to disk on a background thread, as a sequence of bitmaps or
+ * one raw stream of pixels.
+ */
+
+
+// standard libraries
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+
+#ifndef CAPTURE
+    #define CAPTURE
+
+    /* How captured frames are written: as numbered bitmaps in a directory,
+     * or as one file of raw 32-bit pixels, one frame after another.
+     */
+    enum CaptureFormat {
+        CAPTURE_IMAGES,
+        CAPTURE_RAW
+    };
+
+    /* How many frames have been captured, written to disk, and dropped
+     * because the writer had fallen too far behind.
+     */
+    struct CaptureStats {
+        unsigned long captured;
+        unsigned long written;
+        unsigned long dropped;
+    };
+
+    class FrameCapture {
+        std::string path;
+        CaptureFormat format;
+        int width;
+        int height;
+
+        std::FILE *output;
+
+        // every buffer is allocated up front; each is either free, queued
+        // for the writer, or being written
+        std::vector<std::vector<uint32_t>> pool;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+
+        std::vector<uint32_t *> free_buffers;
+        std::vector<uint32_t *> queue;
+        size_t queue_start;
+        size_t queue_size;
+
+        bool stopping;
+        std::thread writer;
+
+        std::atomic<unsigned long> captured;
+        std::atomic<unsigned long> written;
+        std::atomic<unsigned long> dropped;
+        std::atomic<bool> failed;
+
+        void run();
+        bool write(const uint32_t *pixels, unsigned long frame);
+
+        public:
+            static const int DEFAULT_POOL_SIZE = 8;
+
+            FrameCapture();
+            ~FrameCapture();
+
+            FrameCapture(const FrameCapture &) = delete;
+            FrameCapture &operator=(const FrameCapture &) = delete;
+
+            bool start(
+                const std::string &path, CaptureFormat format, int width,
+                int height, int pool_size = DEFAULT_POOL_SIZE
+            );
+            void stop();
+
+            bool is_running() const;
+
+            uint32_t *acquire();
+            void submit(uint32_t *buffer);
+
+            CaptureStats get_stats() const;
+    };
+#endif
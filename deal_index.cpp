@@ -0,0 +1,406 @@
+/* klondike/deal_index.cpp
+ * by python-b5
+ *
+ * A precomputed index of which deals can be won, and how hard they are.
+ *
+ * Layout (all values are little-endian):
+ *   - a 64-byte header: "KLDI", a version byte, the draw count and pass limit
+ *     of the rules the deals were solved with (a draw count of 0, as in
+ *     older indexes, means the default rules) and a reserved byte, then the
+ *     first deal, the number of deals, the number of winnable deals and the
+ *     number of winnable deals of each difficulty (4 bytes each), padded with
+ *     zeroes
+ *   - a bitmap with one bit per deal, set if it can be won
+ *   - the number of moves in each deal's solution (1 byte per deal)
+ *   - each deal's verdict (bits 2-3) and difficulty (bits 0-1) (1 byte per
+ *     deal)
+ *   - padding up to a multiple of 4 bytes
+ *   - the offsets of every winnable deal (4 bytes each), followed by the
+ *     offsets of the winnable deals of each difficulty in turn
+ *
+ * The lists at the end mean a deal meeting some requirement can be picked in
+ * constant time, without searching the rest of the file. (They are read in
+ * place, so this assumes a little-endian machine.)
+ */
+
+
+// project includes
+#include "deal_index.hpp"
+#include "solver.hpp"
+#include "mapped_file.hpp"
+
+// standard libraries
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstring>
+
+// POSIX libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+// constants
+const uint8_t MAGIC[4] = {'K', 'L', 'D', 'I'};
+const uint8_t VERSION = 1;
+const size_t HEADER_SIZE = 64;
+
+// (indexes written from deals in memory are still written a block at a time)
+const uint32_t WRITE_BLOCK_SIZE = 65536;
+
+
+/* helper functions */
+
+/* Reads a 4-byte value from a buffer. */
+static uint32_t read_u32(const uint8_t *buffer) {
+    return buffer[0] | buffer[1] << 8 | buffer[2] << 16
+           | static_cast<uint32_t>(buffer[3]) << 24;
+}
+
+/* Writes a 4-byte value to a buffer. */
+static void write_u32(uint8_t *buffer, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        buffer[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+
+/* Returns the size of the bitmap and metadata, including padding. */
+static size_t table_size(uint32_t deal_count) {
+    size_t size = (deal_count + 7) / 8 + 2 * static_cast<size_t>(deal_count);
+    return (size + 3) & ~static_cast<size_t>(3);
+}
+
+
+/* DealIndex implementation:
+ * A memory-mapped deal index. Opening one only maps it, so it takes the same
+ * time no matter how many deals it covers.
+ */
+
+DealIndex::DealIndex():
+    rules(engine::DEFAULT_RULES),
+    first_deal(0),
+    deal_count(0),
+    winnable_count(0)
+{}
+
+/* Opens a deal index, checking that it is well-formed.
+ * Returns whether it was successful.
+ */
+bool DealIndex::open(const std::string &path) {
+    close();
+
+    if (!file.open(path) || file.get_size() < HEADER_SIZE) {
+        close();
+        return false;
+    }
+
+    const uint8_t *data = file.get_data();
+
+    if (std::memcmp(data, MAGIC, 4) != 0 || data[4] != VERSION) {
+        close();
+        return false;
+    }
+
+    uint32_t first = read_u32(data + 8);
+    uint32_t count = read_u32(data + 12);
+    uint32_t winnable_total = read_u32(data + 16);
+
+    uint32_t counts[4];
+    size_t bucket_total = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        counts[i] = read_u32(data + 20 + 4 * i);
+        bucket_total += counts[i];
+    }
+
+    size_t expected = HEADER_SIZE + table_size(count)
+                      + 4 * (static_cast<size_t>(winnable_total) + bucket_total);
+
+    if (
+        file.get_size() != expected || winnable_total > count
+        || bucket_total != winnable_total
+    ) {
+        close();
+        return false;
+    }
+
+    first_deal = first;
+    deal_count = count;
+
+    rules = engine::DEFAULT_RULES;
+
+    if (data[5] != 0) {
+        rules.draw_count = data[5];
+        rules.pass_limit = data[6];
+    }
+
+    bitmap = data + HEADER_SIZE;
+    metadata = bitmap + (count + 7) / 8;
+
+    // (the lists start on a 4-byte boundary, and mappings start on a page
+    // boundary, so they can be read directly)
+    const uint32_t *list = reinterpret_cast<const uint32_t *>(
+        data + HEADER_SIZE + table_size(count)
+    );
+
+    winnable = list;
+    winnable_count = winnable_total;
+    list += winnable_total;
+
+    for (int i = 0; i < 4; ++i) {
+        buckets[i] = list;
+        bucket_counts[i] = counts[i];
+        list += counts[i];
+    }
+
+    return true;
+}
+
+/* Closes the deal index, if one is open. */
+void DealIndex::close() {
+    file.close();
+
+    first_deal = 0;
+    deal_count = 0;
+    winnable_count = 0;
+}
+
+/* Returns the rules the index's deals were solved with. */
+engine::Rules DealIndex::get_rules() const {
+    return rules;
+}
+
+/* Checks if a deal is covered by the index. */
+bool DealIndex::contains(uint32_t deal) const {
+    return deal - first_deal < deal_count;
+}
+
+/* Returns what is known about a deal, which must be covered by the index. */
+DealInfo DealIndex::get_info(uint32_t deal) const {
+    uint32_t offset = deal - first_deal;
+    uint8_t flags = metadata[deal_count + offset];
+
+    DealInfo info;
+
+    info.verdict = static_cast<solver::Verdict>(flags >> 2 & 0x3);
+    info.moves = metadata[offset];
+    info.difficulty = flags & 0x3;
+
+    return info;
+}
+
+/* Checks if a deal is known to be winnable. */
+bool DealIndex::is_winnable(uint32_t deal) const {
+    uint32_t offset = deal - first_deal;
+
+    return contains(deal) && (bitmap[offset / 8] >> (offset % 8) & 1);
+}
+
+/* Picks a winnable deal, optionally of a given difficulty (-1 for any), using
+ * a random number.
+ * Returns whether there was a deal to pick.
+ */
+bool DealIndex::pick(uint32_t random, int difficulty, uint32_t &deal) const {
+    const uint32_t *list = winnable;
+    uint32_t count = winnable_count;
+
+    if (difficulty >= 0 && difficulty < 4) {
+        list = buckets[difficulty];
+        count = bucket_counts[difficulty];
+    }
+
+    if (count == 0) {
+        return false;
+    }
+
+    deal = first_deal + list[random % count];
+
+    return true;
+}
+
+/* Writes an index covering a contiguous range of deals, solved with a given
+ * set of rules. The deals are read a block at a time, twice over: once to
+ * count the winnable ones, then again to fill in the file through a mapping
+ * (each part of the file is at a known place by then). So no more than a
+ * block is ever held in memory, however many deals there are.
+ * Returns whether it was successful.
+ */
+bool DealIndex::write(
+    const std::string &path, uint32_t first_deal, uint32_t deal_count,
+    uint32_t block_size, const BlockReader &read_block,
+    const engine::Rules &rules
+) {
+    uint32_t block_total = (static_cast<uint64_t>(deal_count) + block_size - 1)
+                           / block_size;
+    std::vector<DealInfo> results;
+
+    auto read = [&](uint32_t block) {
+        results.resize(std::min<uint64_t>(
+            block_size, deal_count - static_cast<uint64_t>(block) * block_size
+        ));
+
+        return read_block(block, results);
+    };
+
+    // count winnable deals, to find where each list goes
+    uint32_t winnable_total = 0;
+    uint32_t bucket_sizes[4] = {};
+
+    for (uint32_t block = 0; block < block_total; ++block) {
+        if (!read(block)) {
+            return false;
+        }
+
+        for (const DealInfo &info : results) {
+            if (info.verdict == solver::WINNABLE) {
+                ++winnable_total;
+                ++bucket_sizes[info.difficulty & 0x3];
+            }
+        }
+    }
+
+    size_t size = HEADER_SIZE + table_size(deal_count)
+                  + 8 * static_cast<size_t>(winnable_total);
+
+    // write to a temporary file first, so a half-written index is never left
+    // behind
+    // (its space is allocated up front, so running out is caught here rather
+    // than by a crash while writing through the mapping; it reads as zeroes,
+    // so the bitmap and padding start out clear)
+    std::string temp_path = path + ".tmp";
+    int output = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (output < 0) {
+        return false;
+    }
+
+    void *mapping = MAP_FAILED;
+
+    if (posix_fallocate(output, 0, size) == 0) {
+        mapping = mmap(
+            NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, output, 0
+        );
+    }
+
+    if (mapping == MAP_FAILED) {
+        ::close(output);
+        std::remove(temp_path.c_str());
+
+        return false;
+    }
+
+    uint8_t *data = static_cast<uint8_t *>(mapping);
+
+    // header
+    std::memcpy(data, MAGIC, 4);
+    data[4] = VERSION;
+    data[5] = rules.draw_count;
+    data[6] = rules.pass_limit;
+
+    write_u32(data + 8, first_deal);
+    write_u32(data + 12, deal_count);
+    write_u32(data + 16, winnable_total);
+
+    for (int i = 0; i < 4; ++i) {
+        write_u32(data + 20 + 4 * i, bucket_sizes[i]);
+    }
+
+    // bitmap, metadata and lists, filled in together
+    // (list 0 holds every winnable deal, and lists 1-4 those of each
+    // difficulty; each has a place to write next and an end)
+    uint8_t *bitmap = data + HEADER_SIZE;
+    uint8_t *move_counts = bitmap + (deal_count + 7) / 8;
+    uint8_t *metadata = move_counts + deal_count;
+    uint8_t *lists = data + HEADER_SIZE + table_size(deal_count);
+
+    size_t list_next[5];
+    size_t list_end[5];
+
+    list_next[0] = 0;
+    list_end[0] = winnable_total;
+
+    for (int i = 0; i < 4; ++i) {
+        list_next[i + 1] = list_end[i];
+        list_end[i + 1] = list_end[i] + bucket_sizes[i];
+    }
+
+    bool success = true;
+
+    for (uint32_t block = 0; success && block < block_total; ++block) {
+        success = read(block);
+
+        for (size_t j = 0; success && j < results.size(); ++j) {
+            const DealInfo &info = results[j];
+            uint32_t i = block * block_size + j;
+
+            move_counts[i] = info.moves;
+            metadata[i] = info.verdict << 2 | (info.difficulty & 0x3);
+
+            if (info.verdict != solver::WINNABLE) {
+                continue;
+            }
+
+            int bucket = 1 + (info.difficulty & 0x3);
+
+            // (if the deals read differently the second time, the lists
+            // won't fit them)
+            if (
+                list_next[0] == list_end[0]
+                || list_next[bucket] == list_end[bucket]
+            ) {
+                success = false;
+                break;
+            }
+
+            bitmap[i / 8] |= 1 << (i % 8);
+            write_u32(lists + 4 * list_next[0]++, i);
+            write_u32(lists + 4 * list_next[bucket]++, i);
+        }
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        success = success && list_next[i] == list_end[i];
+    }
+
+    success = (munmap(mapping, size) == 0) && success;
+    success = (::close(output) == 0) && success;
+
+    if (!success) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+
+    return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+/* Writes an index covering a contiguous range of deals that are already in
+ * memory.
+ * Returns whether it was successful.
+ */
+bool DealIndex::write(
+    const std::string &path, uint32_t first_deal,
+    const std::vector<DealInfo> &deals, const engine::Rules &rules
+) {
+    return write(
+        path, first_deal, deals.size(), WRITE_BLOCK_SIZE,
+        [&deals](uint32_t block, std::vector<DealInfo> &results) {
+            std::copy(
+                deals.begin() + static_cast<size_t>(block) * WRITE_BLOCK_SIZE,
+                deals.begin() + static_cast<size_t>(block) * WRITE_BLOCK_SIZE
+                + results.size(),
+                results.begin()
+            );
+
+            return true;
+        },
+        rules
+    );
+}
@@ -0,0 +1,86 @@
+/* klondike/deal_index.hpp
+ * by python-b5
+ *
+ * A precomputed index of which deals can be won, and how hard they are.
+ */
+
+
+// project includes
+#include "engine.hpp"
+#include "solver.hpp"
+#include "mapped_file.hpp"
+
+// standard libraries
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef DEAL_INDEX
+    #define DEAL_INDEX
+
+    /* What the solver found out about a deal. */
+    struct DealInfo {
+        solver::Verdict verdict;
+
+        // moves in the solution found (capped at 255), and its difficulty
+        // from 0 to 3; both are only set for winnable deals
+        uint8_t moves;
+        uint8_t difficulty;
+    };
+
+    class DealIndex {
+        MappedFile file;
+        engine::Rules rules;
+
+        uint32_t first_deal;
+        uint32_t deal_count;
+
+        const uint8_t *bitmap;
+        const uint8_t *metadata;
+
+        // offsets (from the first deal) of all winnable deals, then of the
+        // winnable deals of each difficulty
+        const uint32_t *winnable;
+        uint32_t winnable_count;
+
+        const uint32_t *buckets[4];
+        uint32_t bucket_counts[4];
+
+        public:
+            DealIndex();
+
+            bool open(const std::string &path);
+            void close();
+
+            engine::Rules get_rules() const;
+
+            bool contains(uint32_t deal) const;
+            DealInfo get_info(uint32_t deal) const;
+            bool is_winnable(uint32_t deal) const;
+
+            bool pick(uint32_t random, int difficulty, uint32_t &deal) const;
+
+            /* Fills in the results for one block of deals, given its
+             * number (results is already sized to the block).
+             * Returns whether it was successful.
+             */
+            typedef std::function<
+                bool(uint32_t block, std::vector<DealInfo> &results)
+            > BlockReader;
+
+            static bool write(
+                const std::string &path, uint32_t first_deal,
+                uint32_t deal_count, uint32_t block_size,
+                const BlockReader &read_block,
+                const engine::Rules &rules = engine::DEFAULT_RULES
+            );
+            static bool write(
+                const std::string &path, uint32_t first_deal,
+                const std::vector<DealInfo> &deals,
+                const engine::Rules &rules = engine::DEFAULT_RULES
+            );
+    };
+#endif
@@ -0,0 +1,929 @@
+/* klondike/engine.cpp
+ * by python-b5
+ *
+ * The rules of Klondike, kept separate from any drawing or input so they can
+ * be used both by the game itself and by headless tools.
+ */
+
+
+// project includes
+#include "engine.hpp"
+
+// standard libraries
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdlib>
+#include <cstring>
+
+// using declarations
+using namespace engine;
+
+
+/* helper functions */
+
+/* Checks if a card can be added to a foundation. */
+static bool can_add(const Foundation &foundation, Card card) {
+    return (foundation.next == 0 || card_suit(card) == foundation.suit)
+        && card_rank(card) == foundation.next;
+}
+
+/* Adds a card to a foundation (which must be a valid move). */
+static void add(Foundation &foundation, Card card) {
+    if (foundation.next == 0) {
+        foundation.suit = card_suit(card);
+    }
+
+    ++foundation.next;
+}
+
+/* Checks if a card can be placed on a tableau stack. */
+static bool can_stack(const Pile &pile, Card card) {
+    // only kings can be at the bottom of a stack
+    if (pile.size == 0) {
+        return card_rank(card) == 12;
+    }
+
+    // card must be one less and the opposite color than the one below it in
+    // the stack, which must be face-up
+    Card top = pile.cards[pile.size - 1];
+
+    return pile.face_down < pile.size
+        && card_rank(card) + 1 == card_rank(top)
+        && card_red(card) != card_red(top);
+}
+
+/* Updates the number of cards taken after the top one is played from the
+ * waste. When drawing one card at a time, the card beneath is shown straight
+ * away; otherwise, it only is once more cards are drawn.
+ */
+template <typename V>
+static void take_from_waste(State &state) {
+    if (V::DRAW_COUNT == 1) {
+        state.taken = state.waste_size != 0;
+    } else {
+        --state.taken;
+    }
+}
+
+
+/* functions */
+
+/* Generates the next number in a SplitMix64 sequence, stepping its seed.
+ * (std::random_shuffle isn't guaranteed to shuffle the same way everywhere,
+ * and deals need to be reproducible from their number; the tools use it too,
+ * so their runs can be repeated from a seed.)
+ */
+uint64_t engine::next_random(uint64_t &seed) {
+    uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+    return z ^ (z >> 31);
+}
+
+/* Shuffles a deck using a deal number and deals it into a position.
+ * Cards are dealt from the top of the stock, which is the end of the array.
+ */
+void engine::deal(State &state, uint32_t deal_number) {
+    // create shuffled deck of cards
+    Card deck[52];
+
+    for (int i = 0; i < 52; ++i) {
+        deck[i] = static_cast<Card>(i);
+    }
+
+    uint64_t seed = deal_number;
+
+    for (int i = 51; i > 0; --i) {
+        int j = static_cast<int>(next_random(seed) % (i + 1));
+
+        Card temp = deck[i];
+        deck[i] = deck[j];
+        deck[j] = temp;
+    }
+
+    // deal cards
+    int remaining = 52;
+
+    for (int i = 0; i < 7; ++i) {
+        Pile &pile = state.tableau[i];
+
+        for (int card = 0; card <= i; ++card) {
+            pile.cards[card] = deck[--remaining];
+        }
+
+        pile.size = i + 1;
+        pile.face_down = i;
+    }
+
+    for (Foundation &foundation : state.foundations) {
+        foundation.next = 0;
+        foundation.suit = 0;
+    }
+
+    // the remainder of the deck becomes the stock
+    for (int i = 0; i < remaining; ++i) {
+        state.stock[i] = deck[i];
+    }
+
+    state.stock_size = remaining;
+    state.waste_size = 0;
+    state.taken = 0;
+    state.passes = 0;
+}
+
+/* Deals a new game with a given set of rules, clearing its undo log. */
+void engine::deal(Game &game, uint32_t deal_number, const Rules &rules) {
+    deal(game.state, deal_number);
+
+    game.rules = rules;
+    game.deal_number = deal_number;
+    game.undo_next = 0;
+    game.undo_size = 0;
+}
+
+/* Checks if a set of rules is one of the supported variants. */
+bool engine::is_supported(const Rules &rules) {
+    for (const Rules &variant : VARIANTS) {
+        if (
+            variant.draw_count == rules.draw_count
+            && variant.pass_limit == rules.pass_limit
+        ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Parses rules written as the draw count, optionally followed by a slash and
+ * the pass limit (e.g. "1" or "3/3").
+ * Returns whether they were well-formed and are supported.
+ */
+bool engine::parse_rules(const char *text, Rules &rules) {
+    char *end;
+    unsigned long draw_count = std::strtoul(text, &end, 10);
+    unsigned long pass_limit = UNLIMITED_PASSES;
+
+    if (*end == '/') {
+        pass_limit = std::strtoul(end + 1, &end, 10);
+    }
+
+    // (checked before narrowing, so that e.g. 259 isn't taken as 3)
+    if (*end != '\0' || draw_count > UINT8_MAX || pass_limit > UINT8_MAX) {
+        return false;
+    }
+
+    rules.draw_count = draw_count;
+    rules.pass_limit = pass_limit;
+
+    return is_supported(rules);
+}
+
+/* Checks if a move is legal in a given position. */
+template <typename V>
+bool engine::is_legal(const State &state, const Move &move) {
+    switch (move.type) {
+        // drawing is always possible unless every card from the stock has
+        // been used, or the stock has been gone through as many times as
+        // allowed
+        case DRAW:
+            if (state.stock_size != 0) {
+                return true;
+            }
+
+            return state.waste_size != 0 && (
+                V::PASS_LIMIT == UNLIMITED_PASSES
+                || state.passes + 1 < V::PASS_LIMIT
+            );
+
+        case FLIP: {
+            if (move.from >= 7) {
+                return false;
+            }
+
+            const Pile &pile = state.tableau[move.from];
+
+            return pile.size != 0 && pile.face_down == pile.size;
+        }
+
+        case WASTE_TO_FOUNDATION:
+            return move.to < 4 && state.taken != 0 && can_add(
+                state.foundations[move.to],
+                state.waste[state.waste_size - 1]
+            );
+
+        case WASTE_TO_TABLEAU:
+            return move.to < 7 && state.taken != 0 && can_stack(
+                state.tableau[move.to],
+                state.waste[state.waste_size - 1]
+            );
+
+        case TABLEAU_TO_FOUNDATION: {
+            if (move.from >= 7 || move.to >= 4) {
+                return false;
+            }
+
+            const Pile &pile = state.tableau[move.from];
+
+            return pile.face_down < pile.size && can_add(
+                state.foundations[move.to], pile.cards[pile.size - 1]
+            );
+        }
+
+        case TABLEAU_TO_TABLEAU: {
+            if (move.from >= 7 || move.to >= 7 || move.from == move.to) {
+                return false;
+            }
+
+            const Pile &pile = state.tableau[move.from];
+
+            // only face-up cards can be moved
+            return move.count != 0
+                && move.count <= pile.size - pile.face_down
+                && state.tableau[move.to].size + move.count <= PILE_CAPACITY
+                && can_stack(
+                    state.tableau[move.to],
+                    pile.cards[pile.size - move.count]
+                );
+        }
+
+        case FOUNDATION_TO_TABLEAU:
+            return move.from < 4 && move.to < 7
+                && state.foundations[move.from].next != 0
+                && can_stack(
+                    state.tableau[move.to],
+                    foundation_top(state.foundations[move.from])
+                );
+
+        default:
+            return false;
+    }
+}
+
+/* Checks if a move is legal under a set of rules. */
+bool engine::is_legal(const Rules &rules, const State &state, const Move &move) {
+    return with_variant(rules, [&](auto variant) {
+        return is_legal<decltype(variant)>(state, move);
+    });
+}
+
+/* Finds every legal move in a position, writing them to an array that must
+ * hold at least MAX_MOVES moves.
+ * Moves to the foundations only ever target the foundation returned by
+ * find_foundation(), since moving to any other would be equivalent.
+ * Returns the number of moves found.
+ */
+template <typename V>
+int engine::legal_moves(const State &state, Move *moves) {
+    int count = 0;
+
+    // flips
+    for (int i = 0; i < 7; ++i) {
+        const Pile &pile = state.tableau[i];
+
+        if (pile.size != 0 && pile.face_down == pile.size) {
+            moves[count++] = Move(FLIP, i);
+        }
+    }
+
+    // moves to the foundations
+    if (state.taken != 0) {
+        int to = find_foundation(state, state.waste[state.waste_size - 1]);
+
+        if (to >= 0) {
+            moves[count++] = Move(WASTE_TO_FOUNDATION, 0, to);
+        }
+    }
+
+    for (int i = 0; i < 7; ++i) {
+        const Pile &pile = state.tableau[i];
+
+        if (pile.face_down < pile.size) {
+            int to = find_foundation(state, pile.cards[pile.size - 1]);
+
+            if (to >= 0) {
+                moves[count++] = Move(TABLEAU_TO_FOUNDATION, i, to);
+            }
+        }
+    }
+
+    // moves between stacks
+    // (face-up cards always form a run going down one rank at a time, so the
+    // only card in it that can go on a given stack is found directly)
+    for (int from = 0; from < 7; ++from) {
+        const Pile &pile = state.tableau[from];
+
+        if (pile.face_down == pile.size) {
+            continue;
+        }
+
+        int run_start = pile.face_down;
+        int run_rank = card_rank(pile.cards[run_start]);
+
+        for (int to = 0; to < 7; ++to) {
+            const Pile &target = state.tableau[to];
+
+            if (to == from) {
+                continue;
+            }
+
+            // find the index of the card that would go on the target
+            int i;
+
+            if (target.size == 0) {
+                i = run_rank == 12 ? run_start : -1;
+            } else if (target.face_down == target.size) {
+                i = -1;
+            } else {
+                i = run_start + run_rank
+                    - (card_rank(target.cards[target.size - 1]) - 1);
+            }
+
+            if (i < run_start || i >= pile.size) {
+                continue;
+            }
+
+            Move move(TABLEAU_TO_TABLEAU, from, to, pile.size - i);
+
+            if (is_legal(state, move)) {
+                moves[count++] = move;
+            }
+        }
+    }
+
+    // moves onto the tableau from the waste and foundations
+    for (int to = 0; to < 7; ++to) {
+        Move move(WASTE_TO_TABLEAU, 0, to);
+
+        if (is_legal(state, move)) {
+            moves[count++] = move;
+        }
+
+        for (int from = 0; from < 4; ++from) {
+            move = Move(FOUNDATION_TO_TABLEAU, from, to);
+
+            if (is_legal(state, move)) {
+                moves[count++] = move;
+            }
+        }
+    }
+
+    // drawing
+    if (is_legal<V>(state, Move(DRAW))) {
+        moves[count++] = Move(DRAW);
+    }
+
+    return count;
+}
+
+/* Finds every legal move under a set of rules. */
+int engine::legal_moves(const Rules &rules, const State &state, Move *moves) {
+    return with_variant(rules, [&](auto variant) {
+        return legal_moves<decltype(variant)>(state, moves);
+    });
+}
+
+/* Finds the foundation a card can be added to, preferring one that already
+ * holds its suit over an empty one.
+ * Returns the foundation's index, or -1 if there isn't one.
+ */
+int engine::find_foundation(const State &state, Card card) {
+    int empty = -1;
+
+    for (int i = 0; i < 4; ++i) {
+        const Foundation &foundation = state.foundations[i];
+
+        if (foundation.next == 0) {
+            if (empty < 0) {
+                empty = i;
+            }
+        } else if (foundation.suit == card_suit(card)) {
+            return card_rank(card) == foundation.next ? i : -1;
+        }
+    }
+
+    return card_rank(card) == 0 ? empty : -1;
+}
+
+/* Checks if moving a card to the foundations is "safe": no card could ever
+ * need to go on top of it in the tableau, so there's never a reason to keep
+ * it there. That holds for aces and twos (nothing but an ace could go on a
+ * two), and for any card whose opposite-colored cards one rank below are
+ * already on the foundations, as long as the other suit of its own color is
+ * up to two ranks below. (Without that, one of those opposite-colored cards
+ * could be brought back down from the foundations onto it, to hold a card of
+ * the other suit of its color that is still needed.)
+ */
+bool engine::is_safe(const State &state, Card card) {
+    int rank = card_rank(card);
+
+    if (rank <= 1) {
+        return true;
+    }
+
+    // (every suit but the card's own must have been started, too)
+    int started = 0;
+
+    for (const Foundation &foundation : state.foundations) {
+        if (foundation.next == 0 || foundation.suit == card_suit(card)) {
+            continue;
+        }
+
+        bool opposite = card_red(make_card(0, foundation.suit))
+                        != card_red(card);
+
+        if (foundation.next < (opposite ? rank : rank - 1)) {
+            return false;
+        }
+
+        ++started;
+    }
+
+    return started == 3;
+}
+
+/* Finds a safe move to the foundations (from the waste, unless told not to,
+ * or the tableau), if there is one.
+ * Returns whether one was found.
+ */
+bool engine::find_safe_move(const State &state, Move &move, bool from_waste) {
+    if (from_waste && state.taken != 0) {
+        Card card = state.waste[state.waste_size - 1];
+        int to = find_foundation(state, card);
+
+        if (to >= 0 && is_safe(state, card)) {
+            move = Move(WASTE_TO_FOUNDATION, 0, to);
+            return true;
+        }
+    }
+
+    for (int i = 0; i < 7; ++i) {
+        const Pile &pile = state.tableau[i];
+
+        if (pile.face_down == pile.size) {
+            continue;
+        }
+
+        Card card = pile.cards[pile.size - 1];
+        int to = find_foundation(state, card);
+
+        if (to >= 0 && is_safe(state, card)) {
+            move = Move(TABLEAU_TO_FOUNDATION, i, to);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Applies a move to a position, which must be legal.
+ * Returns the information needed to revert it.
+ */
+template <typename V>
+Undo engine::apply(State &state, const Move &move) {
+    Undo undo;
+
+    undo.move = move;
+    undo.taken = state.taken;
+
+    switch (move.type) {
+        case DRAW:
+            if (state.stock_size == 0) {
+                // if the stock is empty, reset it
+                for (int i = 0; i < state.waste_size; ++i) {
+                    state.stock[i] = state.waste[state.waste_size - 1 - i];
+                }
+
+                state.stock_size = state.waste_size;
+                state.waste_size = 0;
+                state.taken = 0;
+
+                if (V::PASS_LIMIT != UNLIMITED_PASSES) {
+                    ++state.passes;
+                }
+
+                undo.move.count = 0;
+            } else {
+                // take as many cards from the stock as the rules say if
+                // possible, otherwise take the remainder
+                int i;
+
+                for (i = 0; i < V::DRAW_COUNT && state.stock_size != 0; ++i) {
+                    state.waste[state.waste_size++]
+                        = state.stock[--state.stock_size];
+                }
+
+                state.taken = i;
+                undo.move.count = i;
+            }
+        break;
+
+        case FLIP:
+            --state.tableau[move.from].face_down;
+        break;
+
+        case WASTE_TO_FOUNDATION:
+            add(state.foundations[move.to], state.waste[--state.waste_size]);
+            take_from_waste<V>(state);
+        break;
+
+        case WASTE_TO_TABLEAU: {
+            Pile &to = state.tableau[move.to];
+
+            to.cards[to.size++] = state.waste[--state.waste_size];
+            take_from_waste<V>(state);
+        } break;
+
+        case TABLEAU_TO_FOUNDATION: {
+            Pile &from = state.tableau[move.from];
+
+            add(state.foundations[move.to], from.cards[--from.size]);
+        } break;
+
+        case TABLEAU_TO_TABLEAU: {
+            Pile &from = state.tableau[move.from];
+            Pile &to = state.tableau[move.to];
+
+            from.size -= move.count;
+
+            for (int i = 0; i < move.count; ++i) {
+                to.cards[to.size++] = from.cards[from.size + i];
+            }
+        } break;
+
+        case FOUNDATION_TO_TABLEAU: {
+            Foundation &from = state.foundations[move.from];
+            Pile &to = state.tableau[move.to];
+
+            to.cards[to.size++] = foundation_top(from);
+            --from.next;
+        } break;
+    }
+
+    return undo;
+}
+
+/* Applies a move under a set of rules. */
+Undo engine::apply(const Rules &rules, State &state, const Move &move) {
+    return with_variant(rules, [&](auto variant) {
+        return apply<decltype(variant)>(state, move);
+    });
+}
+
+/* Reverts the most recently applied move in a position. (This works the same
+ * under any rules, since the undo record holds everything that differs.)
+ */
+void engine::revert(State &state, const Undo &undo) {
+    const Move &move = undo.move;
+
+    switch (move.type) {
+        case DRAW:
+            if (move.count == 0) {
+                // undo a reset by moving the stock back into the waste
+                for (int i = 0; i < state.stock_size; ++i) {
+                    state.waste[i] = state.stock[state.stock_size - 1 - i];
+                }
+
+                state.waste_size = state.stock_size;
+                state.stock_size = 0;
+
+                // (passes are only counted when there's a limit on them)
+                if (state.passes != 0) {
+                    --state.passes;
+                }
+            } else {
+                for (int i = 0; i < move.count; ++i) {
+                    state.stock[state.stock_size++]
+                        = state.waste[--state.waste_size];
+                }
+            }
+        break;
+
+        case FLIP:
+            ++state.tableau[move.from].face_down;
+        break;
+
+        case WASTE_TO_FOUNDATION: {
+            Foundation &to = state.foundations[move.to];
+
+            state.waste[state.waste_size++] = foundation_top(to);
+            --to.next;
+        } break;
+
+        case WASTE_TO_TABLEAU: {
+            Pile &to = state.tableau[move.to];
+
+            state.waste[state.waste_size++] = to.cards[--to.size];
+        } break;
+
+        case TABLEAU_TO_FOUNDATION: {
+            Pile &from = state.tableau[move.from];
+            Foundation &to = state.foundations[move.to];
+
+            from.cards[from.size++] = foundation_top(to);
+            --to.next;
+        } break;
+
+        case TABLEAU_TO_TABLEAU: {
+            Pile &from = state.tableau[move.from];
+            Pile &to = state.tableau[move.to];
+
+            to.size -= move.count;
+
+            for (int i = 0; i < move.count; ++i) {
+                from.cards[from.size++] = to.cards[to.size + i];
+            }
+        } break;
+
+        case FOUNDATION_TO_TABLEAU: {
+            Foundation &from = state.foundations[move.from];
+            Pile &to = state.tableau[move.to];
+
+            // (the suit is restored too, since another suit may have been
+            // started on the foundation after it was emptied)
+            from.suit = card_suit(to.cards[--to.size]);
+            ++from.next;
+        } break;
+    }
+
+    state.taken = undo.taken;
+}
+
+/* Plays a move in a game if it is legal under the game's rules, recording it
+ * in the undo log.
+ * Returns whether the move was legal.
+ */
+bool engine::play(Game &game, const Move &move) {
+    if (!is_legal(game.rules, game.state, move)) {
+        return false;
+    }
+
+    game.undo_log[game.undo_next] = apply(game.rules, game.state, move);
+    game.undo_next = (game.undo_next + 1) % UNDO_DEPTH;
+
+    if (game.undo_size < UNDO_DEPTH) {
+        ++game.undo_size;
+    }
+
+    return true;
+}
+
+/* Takes back the most recent move in a game.
+ * Returns whether there was a move to take back.
+ */
+bool engine::undo(Game &game) {
+    if (game.undo_size == 0) {
+        return false;
+    }
+
+    game.undo_next = (game.undo_next + UNDO_DEPTH - 1) % UNDO_DEPTH;
+    --game.undo_size;
+
+    revert(game.state, game.undo_log[game.undo_next]);
+
+    return true;
+}
+
+/* Returns the top card of a foundation, which must not be empty. */
+Card engine::foundation_top(const Foundation &foundation) {
+    return make_card(foundation.next - 1, foundation.suit);
+}
+
+/* Checks if a position has been won (i.e. all foundations have 13 cards). */
+bool engine::won(const State &state) {
+    for (const Foundation &foundation : state.foundations) {
+        if (foundation.next != 13) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Hashes a position, only looking at the parts of it that are in use. */
+uint64_t engine::hash(const State &state) {
+    // FNV-1a
+    uint64_t result = 0xCBF29CE484222325ULL;
+
+    auto mix = [&result](uint8_t byte) {
+        result = (result ^ byte) * 0x100000001B3ULL;
+    };
+
+    for (const Pile &pile : state.tableau) {
+        mix(pile.size);
+        mix(pile.face_down);
+
+        for (int i = 0; i < pile.size; ++i) {
+            mix(pile.cards[i]);
+        }
+    }
+
+    for (const Foundation &foundation : state.foundations) {
+        mix(foundation.next);
+        mix(foundation.next == 0 ? 0 : foundation.suit);
+    }
+
+    mix(state.stock_size);
+
+    for (int i = 0; i < state.stock_size; ++i) {
+        mix(state.stock[i]);
+    }
+
+    mix(state.waste_size);
+
+    for (int i = 0; i < state.waste_size; ++i) {
+        mix(state.waste[i]);
+    }
+
+    mix(state.taken);
+    mix(state.passes);
+
+    return result;
+}
+
+/* Checks whether two positions are the same, going by everything hash()
+ * covers (so positions that are the same always hash the same). This is
+ * much quicker than hashing both.
+ */
+bool engine::same_position(const State &a, const State &b) {
+    for (int i = 0; i < 7; ++i) {
+        const Pile &pile_a = a.tableau[i];
+        const Pile &pile_b = b.tableau[i];
+
+        if (
+            pile_a.size != pile_b.size || pile_a.face_down != pile_b.face_down
+            || std::memcmp(pile_a.cards, pile_b.cards, pile_a.size) != 0
+        ) {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        const Foundation &foundation_a = a.foundations[i];
+        const Foundation &foundation_b = b.foundations[i];
+
+        if (
+            foundation_a.next != foundation_b.next || (
+                foundation_a.next != 0
+                && foundation_a.suit != foundation_b.suit
+            )
+        ) {
+            return false;
+        }
+    }
+
+    return a.stock_size == b.stock_size && a.waste_size == b.waste_size
+           && a.taken == b.taken && a.passes == b.passes
+           && std::memcmp(a.stock, b.stock, a.stock_size) == 0
+           && std::memcmp(a.waste, b.waste, a.waste_size) == 0;
+}
+
+/* Checks that a position is one the rules could have led to: every card is
+ * somewhere exactly once, the foundations and face-up cards form runs, and
+ * the stock, waste, cards taken and passes made are all within bounds.
+ * Returns the first problem found, or NULL if there are none.
+ */
+template <typename V>
+const char *engine::check_state(const State &state) {
+    // (every card is marked off in a mask; if there are 52 cards, all valid,
+    // and every one of them is marked, none can be repeated)
+    uint64_t seen = 0;
+    int count = 0;
+    bool invalid = false;
+
+    auto see = [&](const Card *cards, int size) {
+        for (int i = 0; i < size; ++i) {
+            invalid |= cards[i] >= 52;
+            seen |= 1ULL << (cards[i] & 63);
+        }
+
+        count += size;
+    };
+
+    for (const Pile &pile : state.tableau) {
+        if (pile.size > PILE_CAPACITY) {
+            return "a tableau stack holds too many cards";
+        }
+
+        if (pile.face_down > pile.size) {
+            return "face-down cards sit above face-up ones";
+        }
+
+        see(pile.cards, pile.size);
+
+        for (int i = pile.face_down + 1; i < pile.size; ++i) {
+            if (
+                card_rank(pile.cards[i]) + 1 != card_rank(pile.cards[i - 1])
+                || card_red(pile.cards[i]) == card_red(pile.cards[i - 1])
+            ) {
+                return "face-up cards don't form a run";
+            }
+        }
+    }
+
+    for (const Foundation &foundation : state.foundations) {
+        if (
+            foundation.next > 13
+            || (foundation.next != 0 && foundation.suit > 3)
+        ) {
+            return "a foundation holds an invalid run";
+        }
+
+        if (foundation.next != 0) {
+            seen |= ((1ULL << foundation.next) - 1) << (13 * foundation.suit);
+            count += foundation.next;
+        }
+    }
+
+    if (state.stock_size + state.waste_size > STOCK_CAPACITY) {
+        return "the stock and waste hold too many cards";
+    }
+
+    see(state.stock, state.stock_size);
+    see(state.waste, state.waste_size);
+
+    if (invalid) {
+        return "a card isn't a card";
+    }
+
+    if (seen != (1ULL << 52) - 1) {
+        return "a card is missing";
+    }
+
+    if (count != 52) {
+        return "a card is repeated";
+    }
+
+    if (state.taken > state.waste_size || state.taken > V::DRAW_COUNT) {
+        return "more cards are taken than were drawn";
+    }
+
+    if (
+        V::PASS_LIMIT != UNLIMITED_PASSES
+        && state.passes >= V::PASS_LIMIT
+    ) {
+        return "the stock was gone through too many times";
+    }
+
+    return NULL;
+}
+
+/* Checks a position under a set of rules. */
+const char *engine::check_state(const Rules &rules, const State &state) {
+    return with_variant(rules, [&](auto variant) {
+        return check_state<decltype(variant)>(state);
+    });
+}
+
+/* Packs an undo record into 16 bits.
+ * Layout (from the lowest bit): type (3), from (3), to (3), count (5),
+ * taken (2).
+ */
+uint16_t engine::encode(const Undo &undo) {
+    return static_cast<uint16_t>(
+        (undo.move.type & 0x7)
+        | (undo.move.from & 0x7) << 3
+        | (undo.move.to & 0x7) << 6
+        | (undo.move.count & 0x1F) << 9
+        | (undo.taken & 0x3) << 14
+    );
+}
+
+/* Unpacks an undo record packed by encode(). */
+Undo engine::decode(uint16_t encoded) {
+    Undo undo;
+
+    undo.move.type = encoded & 0x7;
+    undo.move.from = (encoded >> 3) & 0x7;
+    undo.move.to = (encoded >> 6) & 0x7;
+    undo.move.count = (encoded >> 9) & 0x1F;
+    undo.taken = (encoded >> 14) & 0x3;
+
+    return undo;
+}
+
+
+/* explicit instantiations */
+
+template bool engine::is_legal<DrawThree>(const State &, const Move &);
+template bool engine::is_legal<DrawOne>(const State &, const Move &);
+template bool engine::is_legal<DrawThreeVegas>(const State &, const Move &);
+template bool engine::is_legal<DrawOneVegas>(const State &, const Move &);
+
+template int engine::legal_moves<DrawThree>(const State &, Move *);
+template int engine::legal_moves<DrawOne>(const State &, Move *);
+template int engine::legal_moves<DrawThreeVegas>(const State &, Move *);
+template int engine::legal_moves<DrawOneVegas>(const State &, Move *);
+
+template Undo engine::apply<DrawThree>(State &, const Move &);
+template Undo engine::apply<DrawOne>(State &, const Move &);
+template Undo engine::apply<DrawThreeVegas>(State &, const Move &);
+template Undo engine::apply<DrawOneVegas>(State &, const Move &);
+
+template const char *engine::check_state<DrawThree>(const State &);
+template const char *engine::check_state<DrawOne>(const State &);
+template const char *engine::check_state<DrawThreeVegas>(const State &);
+template const char *engine::check_state<DrawOneVegas>(const State &);
@@ -0,0 +1,282 @@
+/* klondike/engine.hpp
+ * by python-b5
+ *
+ * The rules of Klondike, kept separate from any drawing or input so they can
+ * be used both by the game itself and by headless tools.
+ */
+
+
+// standard libraries
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef ENGINE
+    #define ENGINE
+
+    namespace engine {
+        // constants
+        // (a tableau stack can hold up to 6 face-down cards and 13 face-up
+        // ones, and the stock can hold every card that wasn't dealt)
+        const int PILE_CAPACITY = 19;
+        const int STOCK_CAPACITY = 24;
+        const int UNDO_DEPTH = 48;
+
+        // (the most moves that can be legal at once: 7 flips, 8 moves to the
+        // foundations, 42 between stacks, 35 onto the tableau from the waste
+        // and foundations, and a draw)
+        const int MAX_MOVES = 96;
+
+        // (a pass limit of 0 means the stock can be gone through any number
+        // of times)
+        const int UNLIMITED_PASSES = 0;
+
+
+        /* A card suit. */
+        enum Suit {
+            CLUBS,
+            DIAMONDS,
+            HEARTS,
+            SPADES
+        };
+
+        /* A playing card, numbered 13 * suit + rank.
+         * Rank order (from 0): Ace, 2-10, Jack, Queen, King
+         * (this is the same order the card sprites are loaded in)
+         */
+        typedef uint8_t Card;
+
+        inline Card make_card(int rank, int suit) {
+            return static_cast<Card>(13 * suit + rank);
+        }
+
+        inline int card_rank(Card card) {
+            return card % 13;
+        }
+
+        inline int card_suit(Card card) {
+            return card / 13;
+        }
+
+        inline bool card_red(Card card) {
+            return card_suit(card) == DIAMONDS || card_suit(card) == HEARTS;
+        }
+
+
+        /* A tableau stack. Cards below face_down are face-down, and cards at
+         * or above it are face-up.
+         */
+        struct Pile {
+            Card cards[PILE_CAPACITY];
+            uint8_t size;
+            uint8_t face_down;
+        };
+
+        /* One of the four foundations. The suit is only meaningful while it
+         * holds at least one card.
+         */
+        struct Foundation {
+            uint8_t next;
+            uint8_t suit;
+        };
+
+        /* The full position of a game. Everything is stored inline, so it can
+         * be copied around freely.
+         *
+         * The waste holds every card taken from the stock (with the most
+         * recent on top), while taken is how many of them are currently shown
+         * face-up next to the stock. Only the top one can be played, and only
+         * while at least one is shown. passes is how many times the stock
+         * has been reset, which is only counted when there's a limit on it.
+         */
+        struct State {
+            Pile tableau[7];
+            Foundation foundations[4];
+
+            Card stock[STOCK_CAPACITY];
+            uint8_t stock_size;
+
+            Card waste[STOCK_CAPACITY];
+            uint8_t waste_size;
+
+            uint8_t taken;
+            uint8_t passes;
+        };
+
+
+        /* A set of rules: how many cards are drawn from the stock at once,
+         * and how many times the stock can be gone through.
+         */
+        struct Rules {
+            uint8_t draw_count;
+            uint8_t pass_limit;
+        };
+
+        /* The same rules as a type, so code can be specialized for each
+         * variant instead of checking the rules as it goes.
+         */
+        template <int DRAW_COUNT_, int PASS_LIMIT_>
+        struct Variant {
+            static const int DRAW_COUNT = DRAW_COUNT_;
+            static const int PASS_LIMIT = PASS_LIMIT_;
+        };
+
+        // the supported variants: draw 3 (the default, as in Microsoft
+        // Solitaire) and draw 1, either with no limit on passes or with the
+        // usual "Vegas" limits
+        typedef Variant<3, UNLIMITED_PASSES> DrawThree;
+        typedef Variant<1, UNLIMITED_PASSES> DrawOne;
+        typedef Variant<3, 3> DrawThreeVegas;
+        typedef Variant<1, 1> DrawOneVegas;
+
+        const Rules DEFAULT_RULES = {3, UNLIMITED_PASSES};
+
+        const int VARIANT_COUNT = 4;
+        const Rules VARIANTS[VARIANT_COUNT] = {
+            {3, UNLIMITED_PASSES}, {1, UNLIMITED_PASSES}, {3, 3}, {1, 1}
+        };
+
+
+        /* The kinds of move a player can make. */
+        enum MoveType {
+            DRAW,
+            FLIP,
+            WASTE_TO_FOUNDATION,
+            WASTE_TO_TABLEAU,
+            TABLEAU_TO_FOUNDATION,
+            TABLEAU_TO_TABLEAU,
+            FOUNDATION_TO_TABLEAU
+        };
+
+        /* A single move. from and to are tableau or foundation indexes
+         * (whichever the move type calls for), and count is the number of
+         * cards moved (for draws, it is filled in when the move is applied;
+         * 0 means the stock was reset).
+         *
+         * The constructors are defined here so arrays of moves (which the
+         * solver makes a lot of) don't need a function call per element.
+         */
+        struct Move {
+            uint8_t type;
+            uint8_t from;
+            uint8_t to;
+            uint8_t count;
+
+            Move() {}
+
+            Move(MoveType type_, int from_ = 0, int to_ = 0, int count_ = 1):
+                type(type_),
+                from(static_cast<uint8_t>(from_)),
+                to(static_cast<uint8_t>(to_)),
+                count(static_cast<uint8_t>(count_))
+            {}
+        };
+
+        /* The information needed to take back a move. */
+        struct Undo {
+            Move move;
+            uint8_t taken;
+        };
+
+        /* A game in progress: its position, rules, deal number and undo log.
+         * The undo log is a ring buffer holding the most recent UNDO_DEPTH
+         * moves.
+         */
+        struct Game {
+            State state;
+            Rules rules;
+            uint32_t deal_number;
+
+            Undo undo_log[UNDO_DEPTH];
+            uint8_t undo_next;
+            uint8_t undo_size;
+        };
+
+
+        // functions
+        uint64_t next_random(uint64_t &seed);
+
+        void deal(State &state, uint32_t deal_number);
+        void deal(
+            Game &game, uint32_t deal_number,
+            const Rules &rules = DEFAULT_RULES
+        );
+
+        bool is_supported(const Rules &rules);
+        bool parse_rules(const char *text, Rules &rules);
+
+        template <typename V>
+        bool is_legal(const State &state, const Move &move);
+        bool is_legal(const Rules &rules, const State &state, const Move &move);
+
+        template <typename V>
+        int legal_moves(const State &state, Move *moves);
+        int legal_moves(const Rules &rules, const State &state, Move *moves);
+
+        int find_foundation(const State &state, Card card);
+
+        bool is_safe(const State &state, Card card);
+        bool find_safe_move(
+            const State &state, Move &move, bool from_waste = true
+        );
+
+        template <typename V>
+        Undo apply(State &state, const Move &move);
+        Undo apply(const Rules &rules, State &state, const Move &move);
+
+        void revert(State &state, const Undo &undo);
+
+        bool play(Game &game, const Move &move);
+        bool undo(Game &game);
+
+        Card foundation_top(const Foundation &foundation);
+        bool won(const State &state);
+        uint64_t hash(const State &state);
+        bool same_position(const State &a, const State &b);
+
+        template <typename V>
+        const char *check_state(const State &state);
+        const char *check_state(const Rules &rules, const State &state);
+
+        uint16_t encode(const Undo &undo);
+        Undo decode(uint16_t encoded);
+
+
+        /* Calls a function with the variant matching a set of rules (as a
+         * default-constructed value of its type), so everything below it runs
+         * specialized for that variant. Unsupported rules use the default
+         * variant.
+         */
+        template <typename Function>
+        auto with_variant(const Rules &rules, Function function)
+            -> decltype(function(DrawThree()))
+        {
+            if (rules.draw_count == 1) {
+                if (rules.pass_limit == UNLIMITED_PASSES) {
+                    return function(DrawOne());
+                } else if (rules.pass_limit == 1) {
+                    return function(DrawOneVegas());
+                }
+            } else if (rules.draw_count == 3 && rules.pass_limit == 3) {
+                return function(DrawThreeVegas());
+            }
+
+            return function(DrawThree());
+        }
+
+
+        // (the default variant's versions are defined here, so they cost
+        // nothing over calling the specialized ones directly)
+        inline bool is_legal(const State &state, const Move &move) {
+            return is_legal<DrawThree>(state, move);
+        }
+
+        inline int legal_moves(const State &state, Move *moves) {
+            return legal_moves<DrawThree>(state, moves);
+        }
+
+        inline Undo apply(State &state, const Move &move) {
+            return apply<DrawThree>(state, move);
+        }
+    }
+#endif
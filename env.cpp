@@ -0,0 +1,277 @@
+/* klondike/env.cpp
+ * by python-b5
+ *
+ * A batch of games stepped together, for training agents. Observations,
+ * legal move masks, rewards and done flags are all written into buffers the
+ * caller owns, so stepping never allocates.
+ *
+ * Actions are numbered so every move has exactly one number: moves to the
+ * foundations don't say which one (there's only ever one that fits), and
+ * moves between stacks don't say how many cards (there's only ever one card
+ * in a run that can go on a given stack). The reward for a step is the change
+ * in the number of cards on the foundations, so winning a game earns 52 in
+ * total. Illegal actions do nothing (but still count as a step).
+ */
+
+
+// project includes
+#include "env.hpp"
+#include "engine.hpp"
+#include "klondike_env.h"
+
+// standard libraries
+#include <new>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+// using declarations
+using namespace env;
+using namespace engine;
+
+
+/* helper functions */
+
+/* Counts the cards on the foundations. */
+static uint8_t count_foundation_cards(const State &state) {
+    int count = 0;
+
+    for (const Foundation &foundation : state.foundations) {
+        count += foundation.next;
+    }
+
+    return static_cast<uint8_t>(count);
+}
+
+
+/* Batch implementation:
+ * A batch of games stepped together.
+ */
+
+/* Creates a batch of games, each with its own stream of deals drawn from a
+ * seed. Games end after a given number of steps if they haven't been won.
+ */
+Batch::Batch(size_t size, uint64_t seed, uint32_t step_limit_):
+    states(size),
+    seeds(size),
+    deal_numbers(size),
+    steps(size),
+    foundation_cards(size),
+    step_limit(step_limit_)
+{
+    for (size_t i = 0; i < size; ++i) {
+        seeds[i] = next_random(seed);
+    }
+
+    reset();
+}
+
+/* Deals a game its next deal. */
+void Batch::deal(size_t i) {
+    deal_numbers[i] = static_cast<uint32_t>(next_random(seeds[i]));
+    engine::deal(states[i], deal_numbers[i]);
+
+    steps[i] = 0;
+    foundation_cards[i] = 0;
+}
+
+size_t Batch::get_size() const {
+    return states.size();
+}
+
+uint32_t Batch::get_deal_number(size_t i) const {
+    return deal_numbers[i];
+}
+
+const State &Batch::get_state(size_t i) const {
+    return states[i];
+}
+
+/* Deals every game again. */
+void Batch::reset() {
+    for (size_t i = 0; i < states.size(); ++i) {
+        deal(i);
+    }
+}
+
+/* Plays one action in every game, writing each game's reward and whether it
+ * ended.
+ */
+void Batch::step(const int32_t *actions, float *rewards, uint8_t *dones) {
+    for (size_t i = 0; i < states.size(); ++i) {
+        State &state = states[i];
+
+        // find the legal move the action stands for, if any
+        Move moves[MAX_MOVES];
+        int count = legal_moves(state, moves);
+
+        for (int j = 0; j < count; ++j) {
+            if (encode_action(moves[j]) == actions[i]) {
+                apply(state, moves[j]);
+                break;
+            }
+        }
+
+        uint8_t cards = count_foundation_cards(state);
+
+        rewards[i] = static_cast<float>(cards - foundation_cards[i]);
+        foundation_cards[i] = cards;
+
+        bool done = cards == 52 || ++steps[i] >= step_limit;
+        dones[i] = done;
+
+        if (done) {
+            deal(i);
+        }
+    }
+}
+
+/* Writes every game's observation, OBSERVATION_SIZE values each:
+ *   - the 19 slots of each tableau stack (bottom first)
+ *   - the top card of each foundation
+ *   - the taken cards (oldest first, with the playable one last)
+ *   - the stock size, waste size and number of cards taken
+ * Cards are observed as FACE_DOWN while face-down, and the stock's contents
+ * aren't observed at all, so agents only see what a player would.
+ */
+void Batch::observe(uint8_t *observations) const {
+    for (const State &state : states) {
+        uint8_t *out = observations;
+
+        for (const Pile &pile : state.tableau) {
+            for (int j = 0; j < PILE_CAPACITY; ++j) {
+                if (j >= pile.size) {
+                    *out++ = 0;
+                } else if (j < pile.face_down) {
+                    *out++ = FACE_DOWN;
+                } else {
+                    *out++ = pile.cards[j] + 1;
+                }
+            }
+        }
+
+        for (const Foundation &foundation : state.foundations) {
+            *out++ = foundation.next == 0 ? 0 : foundation_top(foundation) + 1;
+        }
+
+        for (int j = 0; j < 3; ++j) {
+            *out++ = j < state.taken
+                     ? state.waste[state.waste_size - state.taken + j] + 1
+                     : 0;
+        }
+
+        *out++ = state.stock_size;
+        *out++ = state.waste_size;
+        *out++ = state.taken;
+
+        observations += OBSERVATION_SIZE;
+    }
+}
+
+/* Writes every game's legal move mask, ACTION_COUNT values each (1 for legal
+ * actions, 0 for the rest).
+ */
+void Batch::mask(uint8_t *masks) const {
+    for (const State &state : states) {
+        for (int j = 0; j < ACTION_COUNT; ++j) {
+            masks[j] = 0;
+        }
+
+        Move moves[MAX_MOVES];
+        int count = legal_moves(state, moves);
+
+        for (int j = 0; j < count; ++j) {
+            masks[encode_action(moves[j])] = 1;
+        }
+
+        masks += ACTION_COUNT;
+    }
+}
+
+
+/* functions */
+
+/* Numbers a move from 0 to ACTION_COUNT - 1. */
+int env::encode_action(const Move &move) {
+    switch (move.type) {
+        case DRAW:
+            return 0;
+
+        case FLIP:
+            return 1 + move.from;
+
+        case WASTE_TO_FOUNDATION:
+            return 8;
+
+        case WASTE_TO_TABLEAU:
+            return 9 + move.to;
+
+        case TABLEAU_TO_FOUNDATION:
+            return 16 + move.from;
+
+        case TABLEAU_TO_TABLEAU:
+            return 23 + 7 * move.from + move.to;
+
+        default:
+            return 72 + 7 * move.from + move.to;
+    }
+}
+
+
+/* C interface */
+
+struct klondike_env {
+    Batch batch;
+
+    klondike_env(size_t size, uint64_t seed, uint32_t step_limit):
+        batch(size, seed, step_limit)
+    {}
+};
+
+int klondike_env_action_count(void) {
+    return ACTION_COUNT;
+}
+
+int klondike_env_observation_size(void) {
+    return OBSERVATION_SIZE;
+}
+
+/* Creates a batch of games.
+ * Returns NULL if it couldn't be allocated.
+ */
+klondike_env *klondike_env_create(
+    size_t size, uint64_t seed, uint32_t step_limit
+) {
+    try {
+        return new klondike_env(size, seed, step_limit);
+    } catch (const std::bad_alloc &) {
+        return NULL;
+    }
+}
+
+void klondike_env_destroy(klondike_env *env) {
+    delete env;
+}
+
+size_t klondike_env_size(const klondike_env *env) {
+    return env->batch.get_size();
+}
+
+void klondike_env_reset(klondike_env *env) {
+    env->batch.reset();
+}
+
+void klondike_env_step(
+    klondike_env *env, const int32_t *actions, float *rewards, uint8_t *dones
+) {
+    env->batch.step(actions, rewards, dones);
+}
+
+void klondike_env_observe(const klondike_env *env, uint8_t *observations) {
+    env->batch.observe(observations);
+}
+
+void klondike_env_mask(const klondike_env *env, uint8_t *masks) {
+    env->batch.mask(masks);
+}
@@ -0,0 +1,77 @@
+/* klondike/env.hpp
+ * by python-b5
+ *
+ * A batch of games stepped together, for training agents. Observations,
+ * legal move masks, rewards and done flags are all written into buffers the
+ * caller owns, so stepping never allocates.
+ */
+
+
+// project includes
+#include "engine.hpp"
+
+// standard libraries
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef ENV
+    #define ENV
+
+    namespace env {
+        // constants
+        // (a draw, 7 flips, the waste to the foundations, the waste to each
+        // stack, each stack to the foundations, each stack to each stack, and
+        // each foundation to each stack)
+        const int ACTION_COUNT = 1 + 7 + 1 + 7 + 7 + 7 * 7 + 4 * 7;
+
+        // (every tableau slot, the top of each foundation, the taken cards,
+        // and the stock/waste sizes and number of cards taken)
+        const int OBSERVATION_SIZE = 7 * engine::PILE_CAPACITY + 4 + 3 + 3;
+
+        // (the value observed for a face-down card; face-up cards are
+        // observed as their number plus 1, and empty slots as 0)
+        const uint8_t FACE_DOWN = 53;
+
+
+        // functions
+        int encode_action(const engine::Move &move);
+
+
+        /* A batch of games. Each game's position is a fixed-size struct, so
+         * they all live in one contiguous array; everything else about them
+         * is kept as one array per field.
+         *
+         * Games that end (by being won or reaching the step limit) are dealt
+         * again straight away, within the same step.
+         */
+        class Batch {
+            std::vector<engine::State> states;
+
+            std::vector<uint64_t> seeds;
+            std::vector<uint32_t> deal_numbers;
+            std::vector<uint32_t> steps;
+            std::vector<uint8_t> foundation_cards;
+
+            uint32_t step_limit;
+
+            void deal(size_t i);
+
+            public:
+                Batch(size_t size, uint64_t seed, uint32_t step_limit_);
+
+                size_t get_size() const;
+                uint32_t get_deal_number(size_t i) const;
+                const engine::State &get_state(size_t i) const;
+
+                void reset();
+                void step(
+                    const int32_t *actions, float *rewards, uint8_t *dones
+                );
+
+                void observe(uint8_t *observations) const;
+                void mask(uint8_t *masks) const;
+        };
+    }
+#endif
@@ -0,0 +1,377 @@
+/* klondike/hint.cpp
+ * by python-b5
+ *
+ * Finds a good next move within a fixed time budget, for showing hints.
+ *
+ * The search looks a few moves ahead from each candidate move (the same ones
+ * the solver considers), scoring positions by how much progress they show.
+ * It searches one move deeper at a time, so when the budget runs out, the
+ * result of the deepest finished search is always ready.
+ *
+ * Given an endgame tablebase, endgames it says can be won are scored by how
+ * far they are from being solved out, and a position that is one is hinted
+ * straight from the table. Given a solver cache, moves into positions it
+ * knows can't be won are only ever hinted if there's nothing else.
+ *
+ * There is also a greedy player, which looks no moves ahead at all, for the
+ * tools that play many games with a simple bot.
+ */
+
+
+// project includes
+#include "hint.hpp"
+#include "engine.hpp"
+#include "solver.hpp"
+#include "tablebase.hpp"
+#include "solver_cache.hpp"
+
+// standard libraries
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+
+// using declarations
+using namespace hint;
+using namespace engine;
+
+
+// constants
+const size_t TABLE_SIZE = 1 << 14;
+
+// (the clock is only checked every so often, since reading it costs more than
+// searching a position)
+const size_t CLOCK_INTERVAL = 16;
+
+const int WON_SCORE = 100000;
+const int SOLVED_OUT_SCORE = 50000;
+
+
+/* helper functions */
+
+/* Scores how much progress a position shows. */
+static int evaluate(const State &state) {
+    if (won(state)) {
+        return WON_SCORE;
+    }
+
+    if (solver::solved_out(state)) {
+        return SOLVED_OUT_SCORE;
+    }
+
+    int score = 0;
+
+    for (const Foundation &foundation : state.foundations) {
+        score += 100 * foundation.next;
+    }
+
+    for (const Pile &pile : state.tableau) {
+        score -= 30 * pile.face_down;
+
+        if (pile.size == 0) {
+            score += 5;
+        }
+    }
+
+    score -= 3 * (state.stock_size + state.waste_size);
+
+    return score;
+}
+
+/* Rates a move for the greedy player; higher is better.
+ * Returns -1 for moves it never makes.
+ */
+static int greedy_priority(const State &state, const Move &move) {
+    switch (move.type) {
+        case FLIP:
+            return 90;
+
+        case WASTE_TO_FOUNDATION:
+        case TABLEAU_TO_FOUNDATION:
+            return 80;
+
+        case TABLEAU_TO_TABLEAU: {
+            const Pile &from = state.tableau[move.from];
+            int start = from.size - move.count;
+
+            // only whole runs that reveal a card, or parts of runs that free
+            // a card for the foundations
+            if (start == from.face_down) {
+                return from.face_down != 0 ? 70 + from.face_down : -1;
+            }
+
+            return find_foundation(state, from.cards[start - 1]) >= 0 ? 60 : -1;
+        }
+
+        case WASTE_TO_TABLEAU:
+            return 50;
+
+        case DRAW:
+            return 10;
+
+        default:
+            return -1;
+    }
+}
+
+
+/* Hinter implementation:
+ * A reusable hint search.
+ */
+
+Hinter::Hinter():
+    table_hashes(TABLE_SIZE),
+    table_depths(TABLE_SIZE),
+    tablebase(NULL),
+    cache(NULL),
+    nodes(0),
+    timed_out(false)
+{}
+
+/* Sets the endgame tablebase to use (or NULL for none). */
+void Hinter::set_tablebase(const Tablebase *tablebase_) {
+    tablebase = tablebase_;
+}
+
+/* Sets the solver cache to check moves against (or NULL for none). */
+void Hinter::set_cache(const SolverCache *cache_) {
+    cache = cache_;
+}
+
+/* Records that a position is being searched to a given depth, in a table that
+ * simply overwrites on collisions.
+ * Returns whether it had already been searched at least that deep.
+ */
+bool Hinter::check_table(uint64_t hash, int depth) {
+    size_t slot = hash & (TABLE_SIZE - 1);
+
+    if (table_hashes[slot] == hash && table_depths[slot] >= depth) {
+        return true;
+    }
+
+    table_hashes[slot] = hash;
+    table_depths[slot] = depth;
+
+    return false;
+}
+
+/* Searches a position a given number of moves deep. The position is modified
+ * during the search but restored before returning.
+ * Returns the best score reachable, less one for each move it takes (so
+ * quicker progress is preferred).
+ */
+template <typename V>
+int Hinter::search(State &state, int depth) {
+    if (++nodes % CLOCK_INTERVAL == 0) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            timed_out = true;
+        }
+    }
+
+    int best = evaluate(state);
+
+    if (depth == 0 || best >= SOLVED_OUT_SCORE) {
+        return best;
+    }
+
+    // (endgames the table can't win are searched as usual, since it doesn't
+    // consider taking cards back off the foundations)
+    int distance;
+
+    if (
+        tablebase != NULL && tablebase->lookup(state, distance)
+        && distance != Tablebase::LOSS
+    ) {
+        return SOLVED_OUT_SCORE - distance;
+    }
+
+    if (timed_out || check_table(hash(state), depth)) {
+        return best;
+    }
+
+    solver::Candidate candidates[solver::MAX_CANDIDATES];
+    int count = solver::find_candidates<V>(state, candidates);
+
+    for (int i = 0; i < count && !timed_out; ++i) {
+        Undo undos[solver::MAX_DRAWS + 1];
+        int draws = candidates[i].draws;
+
+        for (int draw = 0; draw < draws; ++draw) {
+            undos[draw] = apply<V>(state, Move(DRAW));
+        }
+
+        undos[draws] = apply<V>(state, candidates[i].move);
+
+        best = std::max(best, search<V>(state, depth - 1) - 1);
+
+        for (int undo = draws; undo >= 0; --undo) {
+            revert(state, undos[undo]);
+        }
+    }
+
+    return best;
+}
+
+/* Finds the best move in a position under a set of rules, looking at most a
+ * given number of moves ahead, and giving up on looking further once a time
+ * budget (in seconds) runs out. (With a generous budget, the result only
+ * depends on the position.)
+ */
+Hint Hinter::find(
+    const State &state, const Rules &rules, double budget, int max_depth
+) {
+    deadline = std::chrono::steady_clock::now()
+               + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                   std::chrono::duration<double>(budget)
+               );
+    nodes = 0;
+    timed_out = false;
+
+    return with_variant(rules, [&](auto variant) {
+        return find_best<decltype(variant)>(state, rules, max_depth);
+    });
+}
+
+/* Runs the search for find(), specialized for a variant of the rules. */
+template <typename V>
+Hint Hinter::find_best(
+    const State &state, const Rules &rules, int max_depth
+) {
+    Hint hint;
+
+    hint.found = false;
+    hint.depth = 0;
+    hint.timed_out = false;
+
+    // a winnable endgame can be played straight from the table
+    Move line[Tablebase::MAX_LINE];
+
+    if (tablebase != NULL && tablebase->best_line(state, line) != 0) {
+        hint.found = true;
+        hint.move = line[0];
+        hint.depth = 1;
+
+        return hint;
+    }
+
+    State copy = state;
+
+    solver::Candidate candidates[solver::MAX_CANDIDATES];
+    int count = solver::find_candidates<V>(copy, candidates);
+
+    if (count == 0) {
+        return hint;
+    }
+
+    // search one move deeper each time, until the budget runs out
+    for (int depth = 1; depth <= max_depth && !timed_out; ++depth) {
+        std::fill(table_hashes.begin(), table_hashes.end(), 0);
+
+        int best = 0;
+        int best_score = 0;
+        bool finished = true;
+
+        for (int i = 0; i < count; ++i) {
+            Undo undos[solver::MAX_DRAWS + 1];
+            int draws = candidates[i].draws;
+
+            for (int draw = 0; draw < draws; ++draw) {
+                undos[draw] = apply<V>(copy, Move(DRAW));
+            }
+
+            undos[draws] = apply<V>(copy, candidates[i].move);
+
+            // (moves the cache knows can't win are ranked below all others)
+            CacheEntry entry;
+            int score;
+
+            if (
+                cache != NULL && cache->lookup(copy, rules, 0, entry)
+                && entry.verdict == solver::UNWINNABLE
+            ) {
+                score = -WON_SCORE;
+            } else {
+                score = search<V>(copy, depth - 1);
+            }
+
+            for (int undo = draws; undo >= 0; --undo) {
+                revert(copy, undos[undo]);
+            }
+
+            if (timed_out) {
+                finished = false;
+                break;
+            }
+
+            if (i == 0 || score > best_score) {
+                best = i;
+                best_score = score;
+            }
+        }
+
+        // only use an unfinished search if there is nothing better
+        if (finished || !hint.found) {
+            const solver::Candidate &candidate = candidates[best];
+
+            hint.found = true;
+            hint.move = candidate.draws != 0 ? Move(DRAW) : candidate.move;
+            hint.depth = depth;
+        }
+
+        // there's no point looking further once the game can be won
+        if (best_score >= SOLVED_OUT_SCORE) {
+            break;
+        }
+    }
+
+    hint.timed_out = timed_out;
+
+    return hint;
+}
+
+
+/* functions */
+
+/* Measures how close a position is to being won, for noticing when a bot has
+ * stopped going anywhere.
+ */
+int hint::progress(const State &state) {
+    int score = 0;
+
+    for (const Foundation &foundation : state.foundations) {
+        score += 4 * foundation.next;
+    }
+
+    for (const Pile &pile : state.tableau) {
+        score -= pile.face_down;
+    }
+
+    return score - state.stock_size - state.waste_size;
+}
+
+/* Picks the greedy player's move: a safe move to the foundations if there is
+ * one, or otherwise the most obviously useful legal move.
+ * Returns whether there was one it would make.
+ */
+bool hint::greedy_move(const State &state, const Rules &rules, Move &move) {
+    if (find_safe_move(state, move)) {
+        return true;
+    }
+
+    Move moves[MAX_MOVES];
+    int count = legal_moves(rules, state, moves);
+    int best = -1;
+
+    for (int i = 0; i < count; ++i) {
+        int priority = greedy_priority(state, moves[i]);
+
+        if (priority > best) {
+            move = moves[i];
+            best = priority;
+        }
+    }
+
+    return best >= 0;
+}
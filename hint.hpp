@@ -0,0 +1,89 @@
+/* klondike/hint.hpp
+ * by python-b5
+ *
+ * Finds a good next move within a fixed time budget, for showing hints.
+ */
+
+
+// project includes
+#include "engine.hpp"
+#include "solver.hpp"
+
+// standard libraries
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef HINT
+    #define HINT
+
+    class Tablebase;
+    class SolverCache;
+
+    namespace hint {
+        // constants
+        // (2 ms leaves plenty of a 60 FPS frame for everything else)
+        const double DEFAULT_BUDGET = 0.002;
+        const int MAX_DEPTH = 16;
+
+
+        /* A suggested move. depth is how many moves ahead the search looked
+         * before settling on it.
+         */
+        struct Hint {
+            bool found;
+            engine::Move move;
+
+            int depth;
+            bool timed_out;
+        };
+
+
+        class Hinter {
+            // positions searched this iteration, and how many moves deep
+            // (the table is allocated once, so finding a hint never allocates)
+            std::vector<uint64_t> table_hashes;
+            std::vector<uint8_t> table_depths;
+
+            const Tablebase *tablebase;
+            const SolverCache *cache;
+
+            std::chrono::steady_clock::time_point deadline;
+            size_t nodes;
+            bool timed_out;
+
+            bool check_table(uint64_t hash, int depth);
+
+            template <typename V>
+            int search(engine::State &state, int depth);
+
+            template <typename V>
+            Hint find_best(
+                const engine::State &state, const engine::Rules &rules,
+                int max_depth
+            );
+
+            public:
+                Hinter();
+
+                void set_tablebase(const Tablebase *tablebase);
+                void set_cache(const SolverCache *cache);
+
+                Hint find(
+                    const engine::State &state,
+                    const engine::Rules &rules = engine::DEFAULT_RULES,
+                    double budget = DEFAULT_BUDGET, int max_depth = MAX_DEPTH
+                );
+        };
+
+
+        // functions
+        int progress(const engine::State &state);
+        bool greedy_move(
+            const engine::State &state, const engine::Rules &rules,
+            engine::Move &move
+        );
+    }
+#endif
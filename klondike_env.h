@@ -0,0 +1,48 @@
+/* klondike/klondike_env.h
+ * by python-b5
+ *
+ * A C interface to env::Batch, for loading the environment from other
+ * languages. Buffers are laid out game by game:
+ *   actions       int32[size]
+ *   rewards       float[size]
+ *   dones         uint8[size]
+ *   observations  uint8[size * klondike_env_observation_size()]
+ *   masks         uint8[size * klondike_env_action_count()]
+ */
+
+
+#ifndef KLONDIKE_ENV_H
+#define KLONDIKE_ENV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct klondike_env klondike_env;
+
+int klondike_env_action_count(void);
+int klondike_env_observation_size(void);
+
+klondike_env *klondike_env_create(
+    size_t size, uint64_t seed, uint32_t step_limit
+);
+void klondike_env_destroy(klondike_env *env);
+
+size_t klondike_env_size(const klondike_env *env);
+
+void klondike_env_reset(klondike_env *env);
+void klondike_env_step(
+    klondike_env *env, const int32_t *actions, float *rewards, uint8_t *dones
+);
+
+void klondike_env_observe(const klondike_env *env, uint8_t *observations);
+void klondike_env_mask(const klondike_env *env, uint8_t *masks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
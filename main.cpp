@@ -10,212 +10,112 @@
 
 // project includes
 #include "wrapper.hpp"
+#include "board.hpp"
+#include "engine.hpp"
+#include "save.hpp"
+#include "replay.hpp"
+#include "solver.hpp"
+#include "deal_index.hpp"
+#include "hint.hpp"
+#include "monitor.hpp"
+#include "tablebase.hpp"
+#include "solver_cache.hpp"
+#include "stats.hpp"
 
 // standard libraries
-#include <queue>
-#include <stack>
+#include <string>
 #include <vector>
 #include <algorithm>
-#include <functional>
+#include <cstdint>
 
 // C standard libraries
 #include <ctime>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 
-// declare card sprites
-wrapper::Sprite cards[52];
-wrapper::Sprite cards_back;
-wrapper::Sprite cards_base;
+// constants
+const char *SAVE_PATH = "klondike.sav";
+const char *REPLAY_PATH = "klondike.rpl";
+const char *DEAL_INDEX_PATH = "deals.idx";
+const char *TABLEBASE_PATH = "endgames.tb";
+const char *SOLVER_CACHE_PATH = "klondike.cache";
+const char *STATS_PATH = "klondike.stats";
 
+// (while recording or playing back input, deals are picked with this seed
+// instead of the time, so a script always plays the same games)
+const unsigned int INPUT_SEED = 1;
 
-/* A card suit. */
-enum Suit {
-    CLUBS,
-    DIAMONDS,
-    HEARTS,
-    SPADES
-};
-
-/* The type of card being dragged, if any.
- * (this enum was a terrible mistake and is responsible for numerous ugly switch
- * statements across this file) */
-enum DragType {
-    NONE,
-    TOP_CARD,
-    FOUNDATION_1, FOUNDATION_2, FOUNDATION_3, FOUNDATION_4,
-    TABLEAU_1, TABLEAU_2, TABLEAU_3, TABLEAU_4, TABLEAU_5, TABLEAU_6, TABLEAU_7
-};
-
-
-/* A playing card.
- * Order (from 0): Ace, 2-10, Jack, Queen, King (same as in-game)
- */
-struct Card {
-    int index;
-    Suit suit;
-
-    Card(int index_, Suit suit_):
-        index(index_),
-        suit(suit_)
-    {}
-};
-
-
-/* A dealt playing card for displaying on-screen. */
-struct DealtCard {
-    Card card;
-    bool face_up;
-
-    DealtCard(const Card &card_, bool face_up_):
-        card(card_),
-        face_up(face_up_)
-    {}
-
-    /* Draws the appropriate card sprite at a given position. */
-    void draw(int x, int y) const {
-        if (face_up) {
-            cards[13 * card.suit + card.index].draw(x, y);
-        } else {
-            cards_back.draw(x, y);
-        }
-    }
-};
-
-
-/* A stack of dealt cards.
- * This isn't *actually* a stack, since it needs to be iterated through to be
- * drawn.
- */
-struct CardStack {
-    std::vector<DealtCard> cards;
-
-    CardStack() {}
-
-    CardStack(std::vector<DealtCard> cards_):
-        cards(cards_)
-    {
-        // move face-up cards to the top of the stack
-        size_t size = cards.size();
-
-        for (size_t i = 0; i < size; ++i) {
-            if (cards[i].face_up) {
-                std::vector<DealtCard>::iterator iter = cards.begin() + i;
-                std::rotate(iter, iter + 1, cards.end());
-
-                --i;
-                --size;
-            }
-        }
-    }
-
-    /* Draws the CardStack at a given position, optionally skipping a provided
-     * number of cards (counting from the top of the stack).
-     *
-     * Face-up cards are drawn with more spacing.
-     */
-    void draw(int x, int y, int skip = 0) {
-        int draw_y = y;
-
-        for (size_t i = 0; i < cards.size() - skip; ++i) {
-            cards[i].draw(x, draw_y);
-
-            if (cards[i].face_up) {
-                draw_y += 15;
-            } else {
-                draw_y += 3;
-            }
-        }
-    }
 
-    /* Returns a bounding box representing the top card in the CardStack,
-     * starting at a specified position. If the stack is empty, it behaves as if
-     * it has one card.
-     */
-    wrapper::BBox get_top_card_bbox(int start_x, int start_y) {
-        wrapper::BBox bbox;
+// declare sprites (besides the cards, which the board has)
+wrapper::Sprite you_win;
 
-        bbox.x1 = start_x;
-        bbox.y1 = start_y;
-        bbox.x2 = start_x + 70;
-        bbox.y2 = start_y + 95;
+// every game played is recorded here
+replay::Recorder recorder;
 
-        if (cards.empty()) {
-            return bbox;
-        }
+// how every game went is logged here, along with when the current one was
+// dealt (or resumed) and how many moves have been made in it
+stats::Log game_log;
+uint32_t game_started = 0;
+uint32_t game_moves = 0;
 
-        for (size_t i = 0; i < cards.size(); ++i) {
-            if (i != cards.size() - 1) {
-                if (cards[i].face_up) {
-                    bbox.y1 += 15;
-                    bbox.y2 += 15;
-                } else {
-                    bbox.y1 += 3;
-                    bbox.y2 += 3;
-                }
-            }
-        }
+// the rules new games are dealt with (F3 cycles through the variants)
+engine::Rules rules = engine::DEFAULT_RULES;
 
-        return bbox;
-    }
-};
+// deals can be picked from an index so they are always winnable, optionally
+// of a given difficulty (from 0 to 3, or -1 for any)
+DealIndex deal_index;
+bool winnable_only = false;
+int difficulty = -1;
 
+// hints are searched for with a reusable table, so asking for one mid-game
+// doesn't allocate
+hint::Hinter hinter;
 
-/* One of the four foundations. */
-struct Foundation {
-    int next = 0;
-    Suit suit;
+// endgames can be looked up instead of searched, if a tablebase is available
+Tablebase tablebase;
 
-    /* Adds a card to the Foundation if it is the correct next card.
-     * Returns whether the move was correct.
-     */
-    bool add(const Card &card) {
-        if ((next == 0 || card.suit == suit) && card.index == next) {
-            if (next == 0) {
-                suit = card.suit;
-            }
+// positions the monitor has solved are kept between sessions, so they never
+// need searching again (and hints can steer clear of ones that lose)
+SolverCache solver_cache;
 
-            ++next;
+// safe moves to the foundations are played automatically, except right after
+// an undo (since the move undone would just be played again) until the player
+// moves again
+bool autoplay = true;
+bool autoplay_paused = false;
 
-            return true;
-        }
+// whether the game can still be won is worked out in the background, after
+// every move
+Monitor monitor;
 
-        return false;
-    }
 
-    /* Draws the Foundation at a given position, optionally showing the
-     * second-to-top card instead of the top one.
-     */
-    void draw(int x, int y, bool second_to_top) {
-        if (next == 0) {
-            cards_base.draw(x, y);
-        } else {
-            if (second_to_top && next == 1) {
-                cards_base.draw(x, y);
-            } else {
-                DealtCard(
-                    Card(next - 1 - static_cast<int>(second_to_top), suit),
-                    true
-                ).draw(x, y);
-            }
-        }
-    }
+/* Where the card(s) being dragged were taken from, if anywhere. */
+enum DragType {
+    NONE,
+    TOP_CARD,
+    FOUNDATION,
+    TABLEAU
 };
 
 
 /* Finds the index closest to a given X position, using a provided function to
  * calculate the distance.
+ * (The function is a template parameter rather than an std::function so the
+ * lambdas passed in don't need to be wrapped, which could allocate.)
  */
+template <typename GetDistance>
 size_t closest_index(
-    int x, std::vector<size_t> indexes,
-    std::function<int(int, size_t)> get_distance
+    int x, const size_t *indexes, size_t count, GetDistance get_distance
 ) {
     size_t closest = 0;
     int closest_distance = 0;
 
     bool checked_any = false;
 
-    for (size_t i : indexes) {
+    for (size_t j = 0; j < count; ++j) {
+        size_t i = indexes[j];
         int distance = get_distance(x, i);
 
         if (!checked_any || distance < closest_distance) {
@@ -230,144 +130,335 @@ size_t closest_index(
 }
 
 
-/* Runs a game of Klondike.
+/* Picks a random deal number, from the deal index if only winnable deals are
+ * wanted (and the index was built for the rules being played with).
  */
-void play_game() {
-    // create shuffled deck of cards
-    std::vector<Card> deck_vector;
-
-    for (int suit_index = 0; suit_index < 4; ++suit_index) {
-        Suit suit;
-
-        switch (suit_index) {
-            case 0: suit = CLUBS; break;
-            case 1: suit = DIAMONDS; break;
-            case 2: suit = HEARTS; break;
-            case 3: suit = SPADES; break;
-        }
-
-        for (int card_index = 0; card_index < 13; ++card_index) {
-            deck_vector.push_back(Card(card_index, suit));
-        }
+uint32_t random_deal() {
+    uint32_t deal;
+    engine::Rules index_rules = deal_index.get_rules();
+
+    if (
+        winnable_only
+        && index_rules.draw_count == rules.draw_count
+        && index_rules.pass_limit == rules.pass_limit
+        && deal_index.pick(std::rand(), difficulty, deal)
+    ) {
+        return deal;
     }
 
-    std::srand(std::time(NULL));
-    std::random_shuffle(deck_vector.begin(), deck_vector.end());
+    return static_cast<uint32_t>(std::rand());
+}
+
+/* Shows the rules being played with in the window's title. (It's formatted
+ * into a fixed buffer, since this happens on every new deal, which mustn't
+ * allocate.)
+ */
+void show_rules(const engine::Rules &rules) {
+    char title[32];
+
+    if (rules.pass_limit == engine::UNLIMITED_PASSES) {
+        std::snprintf(
+            title, sizeof(title), "klondike (draw %d)", rules.draw_count
+        );
+    } else {
+        std::snprintf(
+            title, sizeof(title), "klondike (draw %d, %d %s)",
+            rules.draw_count, rules.pass_limit,
+            rules.pass_limit == 1 ? "pass" : "passes"
+        );
+    }
 
-    // after dealing, the remainder of the deck is called the "stock", so it's
-    // named that here for later even though we haven't dealt yet
-    std::stack<Card, std::vector<Card>> stock(deck_vector);
+    wrapper::set_title(title);
+}
 
-    // cards taken from the stock
-    std::vector<Card> taken;
+/* Reports how quickly an input script was played back: the frame rate, and
+ * how long frames took.
+ */
+void report_benchmark() {
+    std::vector<float> times = wrapper::get_frame_times();
 
-    // history of cards taken from the stock, so the stock can be reset if
-    // necessary
-    std::stack<Card> stock_history;
+    if (times.empty()) {
+        return;
+    }
 
-    // deal cards
-    CardStack tableau[7];
+    std::sort(times.begin(), times.end());
 
-    for (size_t i = 0; i < 7; ++i) {
-        // card is unsigned to avoid compiler warning
-        for (unsigned int card = 1; card <= i + 1; ++card) {
-            if (card == i + 1) {
-                tableau[i].cards.push_back(DealtCard(stock.top(), true));
-            } else {
-                tableau[i].cards.push_back(DealtCard(stock.top(), false));
-            }
+    double total = 0;
 
-            stock.pop();
-        }
+    for (float time : times) {
+        total += time;
     }
 
-    // create foundations
-    Foundation foundations[4] = {
-        Foundation(),
-        Foundation(),
-        Foundation(),
-        Foundation()
+    auto percentile = [&](double fraction) -> float {
+        return times[static_cast<size_t>(fraction * (times.size() - 1))];
     };
-    
-    // create bounding boxes
-    // (some fields aren't set here since they are changed each frame)
-    wrapper::BBox stock_bbox;
 
-    stock_bbox.x2 = 85;
-    stock_bbox.y2 = 110;
+    std::printf(
+        "%zu frames in %.2f s (%.0f frames/s)\n", times.size(), total / 1000,
+        times.size() / (total / 1000)
+    );
+    std::printf(
+        "frame time: median %.3f ms, 90th percentile %.3f ms, "
+        "99th percentile %.3f ms, worst %.3f ms\n",
+        percentile(0.5), percentile(0.9), percentile(0.99), times.back()
+    );
 
-    wrapper::BBox top_card_bbox;
+    const wrapper::FrameStats &stats = wrapper::get_frame_stats();
 
-    wrapper::BBox foundation_bboxes[4];
+    #ifndef NDEBUG
+        std::printf(
+            "%lu frame(s) allocated memory (%lu allocation(s))\n",
+            stats.allocating_frames, stats.allocations
+        );
+    #else
+        (void) stats;
+    #endif
+}
+
+/* Logs how the current game went, now that it has been won or abandoned.
+ * (This only queues the result, so it never waits for the disk.)
+ */
+void log_game(const engine::Game &game, bool won) {
+    stats::GameResult result;
+
+    result.finished_at = static_cast<uint32_t>(std::time(NULL));
+    result.deal_number = game.deal_number;
+    result.rules = game.rules;
+
+    result.duration = SDL_GetTicks() - game_started;
+    result.moves = std::min<uint32_t>(game_moves, UINT16_MAX);
+    result.won = won;
+
+    game_log.add(result);
+}
+
+/* Deals a new game with a random deal number, recording it. */
+void new_game(engine::Game &game) {
+    engine::deal(game, random_deal(), rules);
+    recorder.new_game(game.deal_number, rules);
+    monitor.reset(game.state, rules);
+    show_rules(rules);
+
+    game_started = SDL_GetTicks();
+    game_moves = 0;
+
+    autoplay_paused = false;
+}
 
-    for (size_t i = 0; i < 4; ++i) {
-        foundation_bboxes[i].x1 = 273 + 86 * i;
-        foundation_bboxes[i].y1 = 15;
-        foundation_bboxes[i].x2 = foundation_bboxes[i].x1 + 70;
-        foundation_bboxes[i].y2 = 110;
+/* Plays a move, recording it if it was legal.
+ * Returns whether it was legal.
+ */
+bool play_move(engine::Game &game, const engine::Move &move) {
+    if (!engine::play(game, move)) {
+        return false;
     }
 
-    // type of card(s) being dragged
-    DragType drag_type = NONE;
+    recorder.move(move);
+    monitor.moved(game.state);
+
+    ++game_moves;
+
+    autoplay_paused = false;
+
+    return true;
+}
+
+/* Takes back the last move, recording it if there was one. */
+void undo_move(engine::Game &game) {
+    if (engine::undo(game)) {
+        recorder.undo();
+        monitor.undone(game.state);
 
-    // cards being dragged
-    std::vector<DealtCard> dragged_cards;
+        autoplay_paused = true;
+    }
+}
+
+
+/* Lays the board out to fit the screen, resampling the sprites to match. */
+void resize() {
+    board::resize(wrapper::get_screen_width(), wrapper::get_screen_height());
+    you_win.set_scale(board::layout.scale);
+}
+
+
+/* Runs a game of Klondike, which must already have been dealt (or loaded).
+ * Returns whether the window was closed (as opposed to a new game being
+ * requested).
+ */
+bool play_game(engine::Game &game) {
+    // the game's position and where everything is on the screen, named for
+    // convenience (the layout only changes when the window is resized)
+    const engine::State &state = game.state;
+    const board::Layout &layout = board::layout;
+
+    // create bounding boxes
+    // (they are set each frame, since they move as cards are played and as
+    // the window is resized)
+    wrapper::BBox stock_bbox;
+    wrapper::BBox top_card_bbox;
+    wrapper::BBox foundation_bboxes[4];
+
+    // where the card(s) being dragged were taken from, and how many there are
+    DragType drag_type = NONE;
+    size_t drag_index = 0;
+    size_t drag_count = 0;
 
     // distances from the top-left corner of the card when dragging started
     int drag_offset_x = 0;
     int drag_offset_y = 0;
 
+    // returns one of the cards being dragged (counting from the bottom)
+    auto dragged_card = [&](size_t i) -> board::DealtCard {
+        switch (drag_type) {
+            case TOP_CARD:
+                return board::DealtCard(
+                    state.waste[state.waste_size - 1], true
+                );
+
+            case FOUNDATION:
+                return board::DealtCard(
+                    engine::foundation_top(state.foundations[drag_index]),
+                    true
+                );
+
+            default: {
+                const engine::Pile &pile = state.tableau[drag_index];
+                return board::DealtCard(
+                    pile.cards[pile.size - drag_count + i], true
+                );
+            }
+        }
+    };
+
+    // the hint being shown, if any, and the position it was found for
+    // (it stops being shown as soon as the position changes)
+    hint::Hint shown_hint;
+    uint64_t hint_position = 0;
+
+    shown_hint.found = false;
+
+    // whether the move that made the game unwinnable has been reported
+    bool culprit_reported = false;
+
+    // whether the game is being finished automatically
+    bool completing = false;
+
     // whether the game has been won
     bool won = false;
 
     // mainloop
-    for (bool closed = false; !closed; closed = wrapper::update()) {
+    bool closed = false;
+
+    for (; !closed; closed = wrapper::update()) {
+        // fit the board to the window again if it was resized
+        if (wrapper::screen_changed()) {
+            resize();
+        }
+
         // get mouse pos
         int mouse_x = wrapper::get_mouse_x();
         int mouse_y = wrapper::get_mouse_y();
 
         /* game logic */
 
-        if (wrapper::mouse_clicked()) {
-            // taking cards off the stock
-            if (stock_bbox.collision(mouse_x, mouse_y)) {
-                // remove existing taken cards as long as there are still cards
-                // in the stock or stock history
-                if (!(stock.empty() && stock_history.empty())) {
-                    taken.clear();
+        // deal a new game (F2 is the same shortcut Microsoft Solitaire uses)
+        if (wrapper::key_pressed(SDL_SCANCODE_F2)) {
+            return false;
+        }
+
+        // switch to the next variant of the rules, dealing a new game with
+        // them
+        if (wrapper::key_pressed(SDL_SCANCODE_F3)) {
+            for (int i = 0; i < engine::VARIANT_COUNT; ++i) {
+                const engine::Rules &variant = engine::VARIANTS[i];
+
+                if (
+                    variant.draw_count == rules.draw_count
+                    && variant.pass_limit == rules.pass_limit
+                ) {
+                    rules = engine::VARIANTS[(i + 1) % engine::VARIANT_COUNT];
+                    break;
                 }
+            }
 
-                if (stock.empty()) {
-                    // if the stock is empty, reset it
-                    while (!stock_history.empty()) {
-                        stock.push(stock_history.top());
-                        stock_history.pop();
-                    }
-                } else {
-                    // take 3 cards from the stock if possible, otherwise take
-                    // the remainder
-                    int i;
+            return false;
+        }
 
-                    for (i = 0; i < 3 && !stock.empty(); ++i) {
-                        taken.push_back(stock.top());
-                        stock_history.push(stock.top());
+        // take back the last move
+        if (drag_type == NONE && wrapper::key_pressed(SDL_SCANCODE_BACKSPACE)) {
+            undo_move(game);
+        }
 
-                        stock.pop();
-                    }
+        // check on the background analysis (this never waits for it)
+        MonitorStatus status = monitor.poll();
+
+        if (status.culprit < 0) {
+            culprit_reported = false;
+        } else if (!culprit_reported) {
+            std::fprintf(
+                stderr,
+                "klondike: the game became unwinnable %d move(s) ago"
+                " (press U to go back to before it)\n",
+                status.culprit
+            );
+
+            culprit_reported = true;
+        }
+
+        // go back to right before the move that made the game unwinnable
+        if (
+            drag_type == NONE && status.culprit >= 0
+            && wrapper::key_pressed(SDL_SCANCODE_U)
+        ) {
+            for (int i = 0; i <= status.culprit; ++i) {
+                undo_move(game);
+            }
+        }
+
+        // show a hint (the search has a small time budget, so this never
+        // holds up a frame noticeably)
+        if (drag_type == NONE && wrapper::key_pressed(SDL_SCANCODE_H)) {
+            shown_hint = hinter.find(state, game.rules);
+            hint_position = engine::hash(state);
+        }
 
-                    // update the top card's bounding box
-                    top_card_bbox.x1 = 101 + 15 * (i - 1);
-                    top_card_bbox.y1 = 15 + 2 * (i - 1);
-                    top_card_bbox.x2 = top_card_bbox.x1 + 70;
-                    top_card_bbox.y2 = top_card_bbox.y1 + 95;
+        // update the bounding boxes (the stock's moves with the cards on top
+        // of it)
+        int stock_offset = layout.stock_spacing * (state.stock_size / 10);
+
+        stock_bbox = layout.card_bbox(
+            layout.stock_x - stock_offset, layout.stock_y - stock_offset
+        );
+        stock_bbox.x2 = layout.stock_x + layout.card_width - 1;
+        stock_bbox.y2 = layout.stock_y + layout.card_height - 1;
+
+        top_card_bbox = layout.card_bbox(
+            layout.waste_x + layout.waste_spacing_x * (state.taken - 1),
+            layout.waste_y + layout.waste_spacing_y * (state.taken - 1)
+        );
+
+        for (size_t i = 0; i < 4; ++i) {
+            foundation_bboxes[i] = layout.card_bbox(
+                layout.foundation_x[i], layout.foundation_y
+            );
+        }
+
+        if (wrapper::mouse_clicked()) {
+            // taking cards off the stock (or resetting it if it's empty), or
+            // finishing the game if there's nothing left to do but that
+            if (stock_bbox.collision(mouse_x, mouse_y)) {
+                if (solver::solved_out(state)) {
+                    completing = true;
+                } else {
+                    play_move(game, engine::Move(engine::DRAW));
                 }
             }
 
             // dragging the top card
-            if (!taken.empty() && top_card_bbox.collision(mouse_x, mouse_y)) {
+            if (state.taken != 0 && top_card_bbox.collision(mouse_x, mouse_y)) {
                 // set drag type and dragged cards
                 drag_type = TOP_CARD;
-                dragged_cards = {DealtCard(taken.back(), true)};
+                drag_count = 1;
 
                 // set drag offsets
                 drag_offset_x = mouse_x - top_card_bbox.x1;
@@ -378,21 +469,12 @@ void play_game() {
             for (size_t i = 0; i < 4; ++i) {
                 if (
                     foundation_bboxes[i].collision(mouse_x, mouse_y)
-                    && foundations[i].next != 0
+                    && state.foundations[i].next != 0
                 ) {
-                    // set drag type
-                    switch (i) {
-                        case 0: drag_type = FOUNDATION_1; break;
-                        case 1: drag_type = FOUNDATION_2; break;
-                        case 2: drag_type = FOUNDATION_3; break;
-                        case 3: drag_type = FOUNDATION_4; break;
-                    }
-
-                    // set dragged cards
-                    dragged_cards = {DealtCard(Card(
-                        foundations[i].next - 1,
-                        foundations[i].suit
-                    ), true)};
+                    // set drag type and dragged cards
+                    drag_type = FOUNDATION;
+                    drag_index = i;
+                    drag_count = 1;
 
                     // set drag offsets
                     drag_offset_x = mouse_x - foundation_bboxes[i].x1;
@@ -402,89 +484,74 @@ void play_game() {
 
             // tableau interactions
             for (size_t i = 0; i < 7; ++i) {
+                board::CardStack stack(state.tableau[i]);
+                engine::Move flip(engine::FLIP, i);
+
                 // flip the top card if it was clicked and is face-down
                 if (
-                    tableau[i].get_top_card_bbox(15 + 86 * i, 126)
-                              .collision(mouse_x, mouse_y)
-                    && !tableau[i].cards.back().face_up
+                    stack.get_top_card_bbox(layout.stack_x[i], layout.stack_y)
+                         .collision(mouse_x, mouse_y)
+                    && engine::is_legal(game.rules, state, flip)
                 ) {
-                    tableau[i].cards.back().face_up = true;
+                    play_move(game, flip);
                 } else {
                     // dragging cards from the tableau
 
                     // find indexes of the first face-up card and the card
                     // clicked on (which is the lowest card in the stack being
                     // dragged)
-                    size_t first_face_up = 0;
-                    bool first_face_up_found = false;
+                    size_t first_face_up = stack.pile.face_down;
 
                     size_t clicked_card = 0;
                     bool clicked_card_found = false;
 
                     wrapper::BBox bbox;
 
-                    bbox.x1 = 15 + 86 * i;
-                    bbox.y1 = 126;
-                    bbox.x2 = 85 + 86 * i;
+                    bbox.x1 = layout.stack_x[i];
+                    bbox.y1 = layout.stack_y;
+                    bbox.x2 = bbox.x1 + layout.card_width - 1;
 
-                    for (size_t j = 0; j < tableau[i].cards.size(); ++j) {
-                        if (
-                            !first_face_up_found && tableau[i].cards[j].face_up
-                        ) {
-                            first_face_up = j;
-                            first_face_up_found = true;
-                        }
+                    for (size_t j = 0; j < stack.pile.size; ++j) {
+                        bool face_up = j >= first_face_up;
 
-                        if (j == tableau[i].cards.size() - 1) {
-                            bbox.y2 = bbox.y1 + 95;
-                        } else if (tableau[i].cards[j].face_up) {
-                            bbox.y2 = bbox.y1 + 14;
+                        if (j == stack.pile.size - 1u) {
+                            bbox.y2 = bbox.y1 + layout.card_height - 1;
+                        } else if (face_up) {
+                            bbox.y2 = bbox.y1 + layout.face_up_spacing - 1;
                         } else {
-                            bbox.y2 = bbox.y1 + 2;
+                            bbox.y2 = bbox.y1 + layout.face_down_spacing - 1;
                         }
 
                         if (
-                            !clicked_card_found && first_face_up_found
+                            !clicked_card_found && face_up
                             && bbox.collision(mouse_x, mouse_y)
                         ) {
                             clicked_card = j;
                             clicked_card_found = true;
                         }
 
-                        if (tableau[i].cards[j].face_up) {
-                            bbox.y1 += 15;
+                        if (face_up) {
+                            bbox.y1 += layout.face_up_spacing;
                         } else {
-                            bbox.y1 += 3;
+                            bbox.y1 += layout.face_down_spacing;
                         }
                     }
 
                     // check if any card was clicked on (a.k.a if this tableau
                     // is being dragged from)
                     if (clicked_card_found) {
-                        // set drag type
-                        switch (i) {
-                            case 0: drag_type = TABLEAU_1; break;
-                            case 1: drag_type = TABLEAU_2; break;
-                            case 2: drag_type = TABLEAU_3; break;
-                            case 3: drag_type = TABLEAU_4; break;
-                            case 4: drag_type = TABLEAU_5; break;
-                            case 5: drag_type = TABLEAU_6; break;
-                            case 6: drag_type = TABLEAU_7; break;
-                        }
-
-                        // set dragged cards
-                        for (
-                            size_t j = clicked_card;
-                            j < tableau[i].cards.size();
-                            ++j
-                        ) {
-                            dragged_cards.push_back(tableau[i].cards[j]);
-                        }
+                        // set drag type and dragged cards
+                        drag_type = TABLEAU;
+                        drag_index = i;
+                        drag_count = stack.pile.size - clicked_card;
 
                         // set drag offsets
-                        drag_offset_x = mouse_x - 15 - 86 * i;
-                        drag_offset_y = mouse_y - 126 - 3 * first_face_up
-                                        - 15 * (clicked_card - first_face_up);
+                        drag_offset_x = mouse_x - layout.stack_x[i];
+                        drag_offset_y = mouse_y - layout.stack_y
+                                        - layout.face_down_spacing
+                                          * first_face_up
+                                        - layout.face_up_spacing
+                                          * (clicked_card - first_face_up);
                     }
                 }
             }
@@ -494,308 +561,461 @@ void play_game() {
         // release action
         if (drag_type != NONE && !wrapper::mouse_down()) {
             // create bounding box for dragged cards
-            wrapper::BBox dragged_cards_bbox(
-                mouse_x - drag_offset_x, mouse_y - drag_offset_y,
-                mouse_x - drag_offset_x + 70, mouse_y - drag_offset_y
-                                              + 15 * dragged_cards.size() + 80
+            wrapper::BBox dragged_cards_bbox = layout.card_bbox(
+                mouse_x - drag_offset_x, mouse_y - drag_offset_y
             );
 
+            dragged_cards_bbox.y2 += layout.face_up_spacing * (drag_count - 1);
+
+            // (moves go to whichever pile is closest to the middle of the
+            // dragged cards)
+            int dragged_middle = mouse_x - drag_offset_x
+                                 + layout.card_width / 2;
+
             // whether the move was valid/successful
             bool valid = false;
 
             // dragging onto foundations
-            // (only one card can be dragged here at once)
-            if (dragged_cards.size() == 1) {
+            // (only one card can be dragged here at once, and never from
+            // another foundation)
+            if (drag_count == 1 && drag_type != FOUNDATION) {
                 // find all foundations the dragged cards are colliding with
-                std::vector<size_t> colliding_foundations;
+                size_t colliding_foundations[4];
+                size_t colliding_foundations_count = 0;
 
                 for (size_t i = 0; i < 4; ++i) {
                     if (dragged_cards_bbox.collision(foundation_bboxes[i])) {
-                        colliding_foundations.push_back(i);
+                        colliding_foundations[colliding_foundations_count++]
+                            = i;
                     }
                 }
 
-                if (!colliding_foundations.empty()) {
+                if (colliding_foundations_count != 0) {
                     // get foundation closest to mouse cursor
                     size_t closest = closest_index(
-                        mouse_x - drag_offset_x + 35, colliding_foundations,
-                        [](int x, size_t i) -> int {
+                        dragged_middle,
+                        colliding_foundations, colliding_foundations_count,
+                        [&](int x, size_t i) -> int {
                             return std::abs(
-                                static_cast<int>(x - (308 + 86 * i))
+                                x - layout.foundation_x[i]
+                                - layout.card_width / 2
                             );
                         }
                     );
 
-                    // check if the move is valid, performing it if so
-                    valid = foundations[closest].add(dragged_cards[0].card);
+                    // perform the move if it is valid
+                    if (drag_type == TOP_CARD) {
+                        valid = play_move(game, engine::Move(
+                            engine::WASTE_TO_FOUNDATION, 0, closest
+                        ));
+                    } else {
+                        valid = play_move(game, engine::Move(
+                            engine::TABLEAU_TO_FOUNDATION, drag_index, closest
+                        ));
+                    }
                 }
             }
 
             // dragging onto tableau
             if (!valid) {
                 // find all stacks the dragged cards are colliding with
-                std::vector<size_t> colliding_stacks;
+                size_t colliding_stacks[7];
+                size_t colliding_stacks_count = 0;
 
                 for (size_t i = 0; i < 7; ++i) {
                     if (dragged_cards_bbox.collision(
-                        tableau[i].get_top_card_bbox(15 + 86 * i, 126)
+                        board::CardStack(state.tableau[i]).get_top_card_bbox(
+                            layout.stack_x[i], layout.stack_y
+                        )
                     )) {
-                        colliding_stacks.push_back(i);
+                        colliding_stacks[colliding_stacks_count++] = i;
                     }
                 }
 
-                if (!colliding_stacks.empty()) {
+                if (colliding_stacks_count != 0) {
                     // get stack closest to mouse cursor
                     size_t closest = closest_index(
-                        mouse_x - drag_offset_x + 35, colliding_stacks,
-                        [](int x, size_t i) -> int {
+                        dragged_middle,
+                        colliding_stacks, colliding_stacks_count,
+                        [&](int x, size_t i) -> int {
                             return std::abs(
-                                static_cast<int>(x - (50 + 86 * i))
+                                x - layout.stack_x[i] - layout.card_width / 2
                             );
                         }
                     );
 
-                    // check if the move is valid, performing it if so
-                    Suit tableau_suit = tableau[closest].cards.back().card.suit;
-                    Suit dragged_suit = dragged_cards[0].card.suit;
-
-                    if (
-                        // only kings can be at the bottom of a stack
-                        (
-                            tableau[closest].cards.empty()
-                            && dragged_cards[0].card.index == 12
-                        ) || (
-                            tableau[closest].cards.back().face_up && (
-                                // card must be one less and the opposite color
-                                // than the one below it in the stack
-                                (
-                                    (
-                                        dragged_cards[0].card.index + 1
-                                        == tableau[closest].cards.back().card
-                                           .index
-                                    ) && (
-                                        (
-                                            (
-                                                dragged_suit == DIAMONDS
-                                                || dragged_suit == HEARTS
-                                            ) && (
-                                                tableau_suit == CLUBS
-                                                || tableau_suit == SPADES
-                                            )
-                                        ) || (
-                                            (
-                                                dragged_suit == CLUBS
-                                                || dragged_suit == SPADES
-                                            ) && (
-                                                tableau_suit == DIAMONDS
-                                                || tableau_suit == HEARTS
-                                            )
-                                        )
-                                    )
-                                )
-                            )
-                        )
-                    ) {
-                        for (const DealtCard &card : dragged_cards) {
-                            tableau[closest].cards.push_back(
-                                DealtCard(card.card, true)
-                            );
-                        }
-
-                        valid = true;
-                    }
-                }
-            }
-
-            // remove dragged cards from their origin if they were used (i.e.
-            // the move was valid)
-            if (valid) {
-                size_t origin_foundation = 4;
-                size_t origin_stack = 7;
-
-                switch (drag_type) {
-                    // remove from taken cards (and stock history, so it doesn't
-                    // appear in the stock anymore)
-                    case TOP_CARD:
-                        taken.pop_back();
-                        stock_history.pop();
-                    break;
-
-                    case FOUNDATION_1: origin_foundation = 0; break;
-                    case FOUNDATION_2: origin_foundation = 1; break;
-                    case FOUNDATION_3: origin_foundation = 2; break;
-                    case FOUNDATION_4: origin_foundation = 3; break;
-
-                    case TABLEAU_1: origin_stack = 0; break;
-                    case TABLEAU_2: origin_stack = 1; break;
-                    case TABLEAU_3: origin_stack = 2; break;
-                    case TABLEAU_4: origin_stack = 3; break;
-                    case TABLEAU_5: origin_stack = 4; break;
-                    case TABLEAU_6: origin_stack = 5; break;
-                    case TABLEAU_7: origin_stack = 6; break;
-
-                    // required to avoid compiler warning
-                    default: break;
-                }
-
-                // remove from foundation
-                if (origin_foundation != 4) {
-                    // can only drag one card from a foundation at once
-                    --foundations[origin_foundation].next;
-                }
-
-                // remove from tableau stack
-                if (origin_stack != 7) {
-                    for (size_t i = 0; i < dragged_cards.size(); ++i) {
-                        tableau[origin_stack].cards.pop_back();
+                    // perform the move if it is valid
+                    switch (drag_type) {
+                        case TOP_CARD:
+                            play_move(game, engine::Move(
+                                engine::WASTE_TO_TABLEAU, 0, closest
+                            ));
+                        break;
+
+                        case FOUNDATION:
+                            play_move(game, engine::Move(
+                                engine::FOUNDATION_TO_TABLEAU,
+                                drag_index, closest
+                            ));
+                        break;
+
+                        case TABLEAU:
+                            play_move(game, engine::Move(
+                                engine::TABLEAU_TO_TABLEAU,
+                                drag_index, closest, drag_count
+                            ));
+                        break;
+
+                        // required to avoid compiler warning
+                        default: break;
                     }
                 }
             }
 
             // reset drag values; the offsets don't need to be reset
             drag_type = NONE;
-            dragged_cards.clear();
+            drag_count = 0;
         }
 
-        /* drawing */
-
-        // fill screen with the background color from Microsoft Solitaire
-        wrapper::clear(wrapper::Color(0, 128, 0));
-
-        // draw stock
-        if (stock.empty()) {
-            cards_base.draw(15, 15);
-        } else {
-            int extra_cards = stock.size() / 10;
-
-            for (int i = 0; i <= extra_cards; ++i) {
-                cards_back.draw(15 - 2 * i, 15 - 2 * i);
-            }
-
-            // update the stock's bounding box
-            stock_bbox.x1 = 15 - 2 * extra_cards;
-            stock_bbox.y1 = stock_bbox.x1;
+        // finish the game (the same shortcut as clicking the empty stock)
+        if (wrapper::key_pressed(SDL_SCANCODE_A) && solver::solved_out(state)) {
+            completing = true;
         }
 
-        // draw taken cards
-        for (
-            size_t i = 0;
-            i < taken.size() - static_cast<int>(drag_type == TOP_CARD);
-            ++i
+        // play a safe move, one per frame so they can be followed
+        // (once a game is solved out, there is always a safe move until it is
+        // won, so finishing it just means playing them all)
+        engine::Move safe;
+
+        if (
+            drag_type == NONE && (completing || (autoplay && !autoplay_paused))
+            && engine::find_safe_move(state, safe)
         ) {
-            DealtCard(taken[i], true).draw(101 + 15 * i, 15 + 2 * i);
+            play_move(game, safe);
         }
 
-        // draw foundations
-        for (size_t i = 0; i < 4; ++i) {
-            // get whether this foundation is being dragged from
-            bool dragging_foundation;
+        /* drawing */
 
-            switch (drag_type) {
-                case FOUNDATION_1: dragging_foundation = (i == 0); break;
-                case FOUNDATION_2: dragging_foundation = (i == 1); break;
-                case FOUNDATION_3: dragging_foundation = (i == 2); break;
-                case FOUNDATION_4: dragging_foundation = (i == 3); break;
+        // leave out the cards being dragged, and show the hint (if any, and
+        // if it's still for this position)
+        board::Overlay overlay;
 
-                default: dragging_foundation = false; break;
-            }
+        overlay.skip_waste = drag_type == TOP_CARD;
+        overlay.skip_foundation = drag_type == FOUNDATION ? drag_index : -1;
+        overlay.skip_stack = drag_type == TABLEAU ? drag_index : -1;
+        overlay.skip_count = drag_count;
 
-            foundations[i].draw(273 + 86 * i, 15, dragging_foundation);
-        }
+        overlay.hinting = shown_hint.found && drag_type == NONE
+                          && engine::hash(state) == hint_position;
+        overlay.hint = shown_hint.move;
 
-        // draw tableau
-        for (size_t i = 0; i < 7; ++i) {
-            // get whether this stack is being dragged from
-            bool dragging_stack;
-
-            switch (drag_type) {
-                case TABLEAU_1: dragging_stack = (i == 0); break;
-                case TABLEAU_2: dragging_stack = (i == 1); break;
-                case TABLEAU_3: dragging_stack = (i == 2); break;
-                case TABLEAU_4: dragging_stack = (i == 3); break;
-                case TABLEAU_5: dragging_stack = (i == 4); break;
-                case TABLEAU_6: dragging_stack = (i == 5); break;
-                case TABLEAU_7: dragging_stack = (i == 6); break;
-
-                default: dragging_stack = false; break;
-            }
+        wrapper::clear(board::BACKGROUND);
 
-            // draw stack, skipping cards if being dragged from
-            tableau[i].draw(
-                15 + 86 * i, 126,
-                dragging_stack ? dragged_cards.size() : 0
-            );
+        board::draw(state, overlay);
+
+        // draw the status indicator: gray while searching, then green if the
+        // game can still be won, red if it can't, and yellow if the search
+        // gave up
+        if (status.searching) {
+            wrapper::fill_rect(layout.status, wrapper::Color(160, 160, 160));
+        } else if (status.verdict == solver::WINNABLE) {
+            wrapper::fill_rect(layout.status, wrapper::Color(128, 255, 128));
+        } else if (status.verdict == solver::UNWINNABLE) {
+            wrapper::fill_rect(layout.status, wrapper::Color(255, 64, 64));
+        } else {
+            wrapper::fill_rect(layout.status, wrapper::Color(255, 224, 64));
         }
 
         // draw any cards being dragged
         if (drag_type != NONE) {
-            for (size_t i = 0; i < dragged_cards.size(); ++i) {
-                dragged_cards[i].draw(
+            for (size_t i = 0; i < drag_count; ++i) {
+                dragged_card(i).draw(
                     mouse_x - drag_offset_x,
-                    mouse_y - drag_offset_y + 15 * i
+                    mouse_y - drag_offset_y + layout.face_up_spacing * i
                 );
             }
         }
 
-        // exit loop if game has been won (i.e all foundations have 13 cards)
-        bool just_won = true;
-
-        for (const Foundation &foundation : foundations) {
-            // next could also be called "height", but this is the only place
-            // where that name would really make more sense
-            if (foundation.next != 13) {
-                just_won = false;
-                break;
-            }
-        }
+        // exit loop if game has been won (logging it now, so the time spent
+        // looking at the "You won!" text isn't counted)
+        if (engine::won(state)) {
+            log_game(game, true);
 
-        if (just_won) {
             won = true;
             break;
         }
     }
 
     // after the game has been won, display the "You won!" text until the game
-    // is closed
+    // is closed or a new game is requested (by clicking or pressing F2)
     // (being in a separate mainloop means all game logic is disabled and the
     // screen will no longer refresh)
+    // (if the window is resized, though, the board has to be drawn again to
+    // fit it)
     if (won) {
-        wrapper::Sprite("assets/you_win.bmp").draw(0, 0);
+        you_win.draw(layout.x, layout.y);
+
+        while (!(closed = wrapper::update())) {
+            if (wrapper::screen_changed()) {
+                resize();
 
-        while (!wrapper::update()) {
-            continue;
+                wrapper::clear(board::BACKGROUND);
+                board::draw(state);
+                you_win.draw(layout.x, layout.y);
+            }
+
+            if (
+                wrapper::mouse_clicked()
+                || wrapper::key_pressed(SDL_SCANCODE_F2)
+            ) {
+                break;
+            }
         }
     }
+
+    return closed;
 }
 
 
 int main(int argc, char *argv[]) {
+    // parse arguments:
+    //   [fps]               refresh rate (see below)
+    //   --winnable          only deal games the deal index says are winnable
+    //   --difficulty <0-3>  only deal winnable games of a given difficulty
+    //   --index <path>      deal index to use (deals.idx by default)
+    //   --tablebase <path>  endgame tablebase to use (endgames.tb by default)
+    //   --no-cache          don't keep solver results between sessions
+    //   --no-autoplay       don't play safe moves automatically
+    //   --draw-one          draw one card at a time instead of three
+    //   --vegas             limit passes through the stock (to 3 when
+    //                       drawing three, or 1 when drawing one)
+    //   --record <path>     record every frame to a file of raw pixels
+    //   --record-images <directory>
+    //                       record every frame as a numbered bitmap
+    //   --record-input <path>
+    //                       record the mouse and keyboard to an input script
+    //   --benchmark <path>  play an input script back without a window, as
+    //                       fast as possible, and report how long frames took
+    // (when recording or playing back input, the saved game isn't resumed
+    // or overwritten, so a script always starts from the same deal)
+    int fps = 60;
+    const char *index_path = DEAL_INDEX_PATH;
+    const char *tablebase_path = TABLEBASE_PATH;
+    bool use_cache = true;
+    bool vegas = false;
+    const char *record_path = NULL;
+    CaptureFormat record_format = CAPTURE_RAW;
+    const char *input_record_path = NULL;
+    const char *benchmark_path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--winnable") == 0) {
+            winnable_only = true;
+        } else if (std::strcmp(argv[i], "--difficulty") == 0 && i + 1 < argc) {
+            winnable_only = true;
+            difficulty = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+            index_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--tablebase") == 0 && i + 1 < argc) {
+            tablebase_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = false;
+        } else if (std::strcmp(argv[i], "--no-autoplay") == 0) {
+            autoplay = false;
+        } else if (std::strcmp(argv[i], "--draw-one") == 0) {
+            rules.draw_count = 1;
+        } else if (std::strcmp(argv[i], "--vegas") == 0) {
+            vegas = true;
+        } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+            record_format = CAPTURE_RAW;
+        } else if (
+            std::strcmp(argv[i], "--record-images") == 0 && i + 1 < argc
+        ) {
+            record_path = argv[++i];
+            record_format = CAPTURE_IMAGES;
+        } else if (
+            std::strcmp(argv[i], "--record-input") == 0 && i + 1 < argc
+        ) {
+            input_record_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            benchmark_path = argv[++i];
+        } else {
+            fps = std::atoi(argv[i]);
+        }
+    }
+
+    if (vegas) {
+        rules.pass_limit = rules.draw_count == 1 ? 1 : 3;
+    }
+
+    // the index is only mapped, so opening it costs nothing up front
+    if (winnable_only && !deal_index.open(index_path)) {
+        std::fprintf(
+            stderr, "klondike: couldn't open deal index %s; dealing any game\n",
+            index_path
+        );
+    }
+
+    // the tablebase is optional, so there's no need to complain if it's missing
+    if (tablebase.open(tablebase_path)) {
+        hinter.set_tablebase(&tablebase);
+        monitor.set_tablebase(&tablebase);
+    }
+
+    bool scripted = input_record_path != NULL || benchmark_path != NULL;
+
+    // (if the cache can't be opened, positions are just always searched;
+    // benchmarks leave it out, so results found by earlier runs don't make
+    // later ones quicker)
+    if (
+        use_cache && benchmark_path == NULL
+        && solver_cache.open(SOLVER_CACHE_PATH)
+    ) {
+        hinter.set_cache(&solver_cache);
+        monitor.set_cache(&solver_cache);
+    }
+
     // initialize the game, using a specific refresh rate if provided;
     // otherwise, use 60 FPS, since it's the most common
     // (There's no cross-platform way to determine refresh rate, so using a
     // command-line argument is the best we can do. This shouldn't cause any
     // problems since the game isn't framerate-dependent.)
+    // (benchmarks are drawn offscreen, without waiting between frames, at
+    // whatever sizes the script was recorded at, so it's loaded first)
+    if (
+        benchmark_path != NULL
+        && !wrapper::start_input_playback(benchmark_path)
+    ) {
+        std::fprintf(
+            stderr, "klondike: couldn't load input script %s\n",
+            benchmark_path
+        );
+
+        return 1;
+    }
+
     bool success;
 
-    success = wrapper::initialize(
-        617, 417, (argc == 2) ? std::atoi(argv[1]) : 60,
-        "klondike", "icon.bmp"
-    );
+    if (benchmark_path != NULL) {
+        success = wrapper::initialize_headless(board::WIDTH, board::HEIGHT);
+    } else {
+        success = wrapper::initialize(
+            board::WIDTH, board::HEIGHT, fps,
+            "klondike", "icon.bmp", true
+        );
+    }
 
     if (!success) {
         return 1;
     }
 
-    // load card sprites
-    // (This is in another file to save space. Is this good practice? Probably
-    // not... but honestly, I'd rather do this than have 55 lines of *very*
-    // repetitive code sitting here.)
-    #include "load_cards.cpp"
+    if (
+        input_record_path != NULL
+        && !wrapper::start_input_recording(input_record_path)
+    ) {
+        std::fprintf(
+            stderr, "klondike: couldn't record input to %s\n",
+            input_record_path
+        );
+    }
+
+    // load sprites
+    board::load_sprites();
+
+    you_win = wrapper::Sprite("assets/you_win.bmp");
+
+    // (the window may not start out at the board's size, on a HiDPI display)
+    resize();
+
+    // (frames are written on another thread, so recording doesn't slow the
+    // game down; if it can't keep up, frames are dropped instead)
+    if (
+        record_path != NULL
+        && !wrapper::start_capture(record_path, record_format)
+    ) {
+        std::fprintf(
+            stderr, "klondike: couldn't record to %s\n", record_path
+        );
+    }
+
+    // record games played (if the log can't be opened, the game still runs,
+    // but nothing is recorded; benchmark games aren't real ones, so they
+    // aren't)
+    // (the same goes for the statistics log, which is written on another
+    // thread so the mainloop never waits for it)
+    if (benchmark_path == NULL) {
+        recorder.open(REPLAY_PATH);
+        game_log.open(STATS_PATH);
+    }
+
+    // resume the game that was in progress when the window was last closed,
+    // or deal a new one if there isn't one
+    std::srand(scripted ? INPUT_SEED : std::time(NULL));
+
+    engine::Game game;
+
+    monitor.start();
 
-    // play Klondike game
-    play_game();
+    if (
+        !scripted && save::read(SAVE_PATH, game) && !engine::won(game.state)
+    ) {
+        // (new games keep the rules of the one being resumed)
+        rules = game.rules;
+
+        recorder.resume(game.deal_number, rules);
+        monitor.reset(game.state, rules);
+        show_rules(rules);
+
+        // (a resumed game's time and moves only count from here on)
+        game_started = SDL_GetTicks();
+    } else {
+        new_game(game);
+    }
+
+    // play Klondike games until the window is closed, reusing the same state
+    // for each one
+    // (games left unfinished for a new one count as lost; one left
+    // unfinished by closing the window isn't over, since it will be resumed)
+    while (!play_game(game)) {
+        if (!engine::won(game.state)) {
+            log_game(game, false);
+        }
+
+        new_game(game);
+    }
+
+    // save the game if it was closed midway through, so it can be resumed
+    // (unless input was scripted, since the saved game was never resumed)
+    if (!scripted) {
+        if (engine::won(game.state)) {
+            std::remove(SAVE_PATH);
+        } else {
+            save::write(SAVE_PATH, game);
+        }
+    }
+
+    if (benchmark_path != NULL) {
+        report_benchmark();
+    }
+
+    // finish recording, reporting any frames that had to be dropped
+    if (record_path != NULL) {
+        wrapper::stop_capture();
+        CaptureStats capture_stats = wrapper::get_capture_stats();
+
+        std::fprintf(
+            stderr, "klondike: recorded %lu of %lu frame(s) (%lu dropped)\n",
+            capture_stats.written,
+            capture_stats.captured + capture_stats.dropped,
+            capture_stats.dropped
+        );
+    }
 
     // quit wrapper
+    monitor.stop();
+    recorder.close();
+    game_log.close();
     wrapper::quit();
 
     return 0;
@@ -0,0 +1,95 @@
+/* klondike/mapped_file.cpp
+ * by python-b5
+ *
+ * A read-only memory-mapped file.
+ */
+
+
+// project includes
+#include "mapped_file.hpp"
+
+// standard libraries
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// POSIX libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/* MappedFile implementation:
+ * A read-only memory-mapped file. Pages are only read from disk as they are
+ * touched, so opening even a very large file is instant.
+ */
+
+MappedFile::MappedFile():
+    data(NULL),
+    size(0)
+{}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+/* Maps a file into memory, unmapping any file that was already mapped.
+ * Returns whether it was successful.
+ */
+bool MappedFile::open(const std::string &path) {
+    close();
+
+    int file = ::open(path.c_str(), O_RDONLY);
+
+    if (file < 0) {
+        return false;
+    }
+
+    struct stat info;
+
+    if (fstat(file, &info) != 0) {
+        ::close(file);
+        return false;
+    }
+
+    // empty files can't be mapped, but are still valid
+    if (info.st_size != 0) {
+        void *mapping = mmap(
+            NULL, info.st_size, PROT_READ, MAP_SHARED, file, 0
+        );
+
+        if (mapping == MAP_FAILED) {
+            ::close(file);
+            return false;
+        }
+
+        data = static_cast<const uint8_t *>(mapping);
+        size = info.st_size;
+    }
+
+    // the mapping stays valid after the file is closed
+    ::close(file);
+
+    return true;
+}
+
+/* Unmaps the file, if one is mapped. */
+void MappedFile::close() {
+    if (data != NULL) {
+        munmap(const_cast<uint8_t *>(data), size);
+
+        data = NULL;
+        size = 0;
+    }
+}
+
+/* Returns the mapped file's contents. */
+const uint8_t *MappedFile::get_data() const {
+    return data;
+}
+
+/* Returns the size of the mapped file. */
+size_t MappedFile::get_size() const {
+    return size;
+}
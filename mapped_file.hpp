@@ -0,0 +1,35 @@
+/* klondike/mapped_file.hpp
+ * by python-b5
+ *
+ * A read-only memory-mapped file.
+ */
+
+
+// standard libraries
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef MAPPED_FILE
+    #define MAPPED_FILE
+
+    class MappedFile {
+        const uint8_t *data;
+        size_t size;
+
+        public:
+            MappedFile();
+            ~MappedFile();
+
+            // mappings can't be shared
+            MappedFile(const MappedFile &) = delete;
+            MappedFile &operator=(const MappedFile &) = delete;
+
+            bool open(const std::string &path);
+            void close();
+
+            const uint8_t *get_data() const;
+            size_t get_size() const;
+    };
+#endif
@@ -0,0 +1,368 @@
+/* klondike/monitor.cpp
+ * by python-b5
+ *
+ * Keeps track of whether the game in progress can still be won, solving each
+ * new position on a background thread.
+ *
+ * Every move cancels whatever the worker was doing and hands it the new
+ * position, so the game itself never waits on a search. Since every position
+ * before a winnable one is winnable, and every position after an unwinnable
+ * one is unwinnable, a lot of positions (like any reached by undoing) never
+ * need searching. Once the game is known to be unwinnable, the positions
+ * between the last winnable one and the first unwinnable one are bisected to
+ * find the exact move that lost it.
+ *
+ * Given a solver cache, positions solved in earlier games aren't searched
+ * again, and new results are added to it.
+ */
+
+
+// project includes
+#include "monitor.hpp"
+#include "engine.hpp"
+#include "solver.hpp"
+#include "solver_cache.hpp"
+
+// standard libraries
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+// external libraries
+#include <SDL2/SDL.h>
+
+
+// using declarations
+using namespace engine;
+
+
+/* Monitor implementation:
+ * A background winnability checker for one game at a time.
+ */
+
+Monitor::Monitor():
+    node_limit(solver::DEFAULT_NODE_LIMIT),
+    cache(NULL),
+    cancel(false),
+    stopping(false),
+    job_rules(DEFAULT_RULES),
+    job_id(0),
+    job_pending(false),
+    result_id(0),
+    result(solver::UNKNOWN),
+    result_ready(false),
+    rules(DEFAULT_RULES),
+    depth(0),
+    first_depth(0),
+    last_id(0),
+    searching_depth(0),
+    searching(false),
+    last_winnable(0),
+    have_winnable(false),
+    first_unwinnable(0),
+    have_unwinnable(false),
+    current_unknown(false),
+    culprit_unknown(false)
+{}
+
+Monitor::~Monitor() {
+    stop();
+}
+
+/* The worker thread's loop: waits for a job, solves it, and hands back the
+ * result unless the job was replaced or cancelled in the meantime.
+ */
+void Monitor::run() {
+    // the game matters more than the analysis
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        wake.wait(lock, [this] { return stopping || job_pending; });
+
+        if (stopping) {
+            break;
+        }
+
+        State state = job;
+        Rules rules = job_rules;
+        uint32_t id = job_id;
+
+        job_pending = false;
+        cancel.store(false);
+
+        lock.unlock();
+
+        CacheEntry entry;
+        solver::Verdict verdict;
+
+        if (cache != NULL && cache->lookup(state, rules, node_limit, entry)) {
+            verdict = entry.verdict;
+        } else {
+            solver::Result result = solver.solve(
+                state, node_limit, &cancel, rules
+            );
+            verdict = result.verdict;
+
+            // (a cancelled search says nothing about the position)
+            if (cache != NULL && !cancel.load()) {
+                cache->add(state, rules, node_limit, result);
+            }
+        }
+
+        lock.lock();
+
+        if (id == job_id) {
+            result_id = id;
+            result = verdict;
+            result_ready = true;
+        }
+    }
+}
+
+/* Returns the position a given number of moves into the current line. */
+State &Monitor::position(int at) {
+    const int size = UNDO_DEPTH + 1;
+
+    return positions[(at % size + size) % size];
+}
+
+/* Hands the worker a position to search, replacing any search in progress. */
+void Monitor::search(int at) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        job = position(at);
+        job_rules = rules;
+        job_id = ++last_id;
+        job_pending = true;
+
+        cancel.store(true);
+    }
+
+    wake.notify_one();
+
+    searching_depth = at;
+    searching = true;
+}
+
+/* Stops any search in progress, throwing away its result. */
+void Monitor::cancel_search() {
+    if (!searching) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    job_id = ++last_id;
+    job_pending = false;
+
+    cancel.store(true);
+
+    searching = false;
+}
+
+/* Starts the next search needed, if any: the current position if its verdict
+ * isn't known yet, or otherwise a position that narrows down which move made
+ * the game unwinnable.
+ */
+void Monitor::search_next() {
+    bool known_winnable = have_winnable && depth <= last_winnable;
+    bool known_unwinnable = have_unwinnable && depth >= first_unwinnable;
+
+    if (!known_winnable && !known_unwinnable) {
+        if (current_unknown) {
+            cancel_search();
+        } else {
+            search(depth);
+        }
+
+        return;
+    }
+
+    if (known_unwinnable && !culprit_unknown) {
+        // the first unwinnable position is somewhere from low to high
+        int low = have_winnable ? last_winnable + 1 : first_depth;
+        int high = first_unwinnable;
+        int middle = low + (high - low) / 2;
+
+        if (low < high && middle >= first_depth) {
+            search(middle);
+            return;
+        }
+
+        // (the positions needed may have fallen out of the undo log)
+        culprit_unknown = low < high;
+    }
+
+    cancel_search();
+}
+
+/* Sets the endgame tablebase the worker's searches use (or NULL for none).
+ * This must be done before starting it.
+ */
+void Monitor::set_tablebase(const Tablebase *tablebase) {
+    solver.set_tablebase(tablebase);
+}
+
+/* Sets the cache the worker looks positions up in and adds results to (or
+ * NULL for none). This must be done before starting it.
+ */
+void Monitor::set_cache(SolverCache *cache_) {
+    cache = cache_;
+}
+
+/* Starts the worker thread, with a limit on how many positions each search
+ * can look at.
+ */
+void Monitor::start(size_t node_limit_) {
+    stop();
+
+    node_limit = node_limit_;
+    stopping = false;
+
+    worker = std::thread(&Monitor::run, this);
+}
+
+/* Stops the worker thread, cancelling any search in progress. */
+void Monitor::stop() {
+    if (!worker.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        stopping = true;
+        cancel.store(true);
+    }
+
+    wake.notify_one();
+    worker.join();
+}
+
+/* Starts monitoring a new game (or one that was just resumed). */
+void Monitor::reset(const State &state, const Rules &rules_) {
+    rules = rules_;
+    depth = 0;
+    first_depth = 0;
+    position(0) = state;
+
+    have_winnable = false;
+    have_unwinnable = false;
+    current_unknown = false;
+    culprit_unknown = false;
+
+    search_next();
+}
+
+/* Notes that a move was made, given the position it led to. */
+void Monitor::moved(const State &state) {
+    ++depth;
+    position(depth) = state;
+
+    if (depth - first_depth > UNDO_DEPTH) {
+        first_depth = depth - UNDO_DEPTH;
+    }
+
+    current_unknown = false;
+
+    search_next();
+}
+
+/* Notes that a move was undone, given the position it led back to. */
+void Monitor::undone(const State &state) {
+    --depth;
+    position(depth) = state;
+
+    if (depth < first_depth) {
+        first_depth = depth;
+    }
+
+    // going back before the first unwinnable position leaves nothing known
+    // to be unwinnable, while going back to a winnable one's predecessor
+    // leaves the current position winnable
+    if (have_unwinnable && depth < first_unwinnable) {
+        have_unwinnable = false;
+        culprit_unknown = false;
+    }
+
+    if (have_winnable && depth < last_winnable) {
+        last_winnable = depth;
+    }
+
+    current_unknown = false;
+
+    search_next();
+}
+
+/* Picks up the result of the last search (if it has finished), and returns
+ * what is known about the current position.
+ * This never waits for the worker.
+ */
+MonitorStatus Monitor::poll() {
+    bool finished = false;
+    solver::Verdict verdict = solver::UNKNOWN;
+
+    if (searching) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (result_ready && result_id == last_id) {
+            finished = true;
+            verdict = result;
+
+            result_ready = false;
+        }
+    }
+
+    if (finished) {
+        searching = false;
+
+        if (verdict == solver::WINNABLE) {
+            if (!have_winnable || searching_depth > last_winnable) {
+                last_winnable = searching_depth;
+                have_winnable = true;
+            }
+        } else if (verdict == solver::UNWINNABLE) {
+            if (!have_unwinnable || searching_depth < first_unwinnable) {
+                first_unwinnable = searching_depth;
+                have_unwinnable = true;
+            }
+        } else if (searching_depth == depth) {
+            current_unknown = true;
+        } else {
+            culprit_unknown = true;
+        }
+
+        search_next();
+    }
+
+    MonitorStatus status;
+
+    if (have_winnable && depth <= last_winnable) {
+        status.verdict = solver::WINNABLE;
+    } else if (have_unwinnable && depth >= first_unwinnable) {
+        status.verdict = solver::UNWINNABLE;
+    } else {
+        status.verdict = solver::UNKNOWN;
+    }
+
+    status.searching = searching && searching_depth == depth;
+
+    // the move that made the game unwinnable is only known once the position
+    // right before it is known to be winnable
+    if (
+        status.verdict == solver::UNWINNABLE && have_winnable
+        && last_winnable == first_unwinnable - 1
+    ) {
+        status.culprit = depth - first_unwinnable;
+    } else {
+        status.culprit = -1;
+    }
+
+    return status;
+}
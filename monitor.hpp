@@ -0,0 +1,118 @@
+/* klondike/monitor.hpp
+ * by python-b5
+ *
+ * Keeps track of whether the game in progress can still be won, solving each
+ * new position on a background thread.
+ */
+
+
+// project includes
+#include "engine.hpp"
+#include "solver.hpp"
+#include "solver_cache.hpp"
+
+// standard libraries
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef MONITOR
+    #define MONITOR
+
+    /* What is known about the current position. culprit is how many moves
+     * ago the game became unwinnable (0 meaning the last move), or -1 if that
+     * isn't known (yet).
+     */
+    struct MonitorStatus {
+        solver::Verdict verdict;
+        bool searching;
+
+        int culprit;
+    };
+
+    class Monitor {
+        // the worker thread, and the solver only it uses
+        std::thread worker;
+        solver::Solver solver;
+        size_t node_limit;
+
+        // results are looked up in and added to the cache, if there is one
+        SolverCache *cache;
+
+        // the job handed to the worker and the result it hands back, which
+        // are only touched while the mutex is locked
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::atomic<bool> cancel;
+
+        bool stopping;
+
+        engine::State job;
+        engine::Rules job_rules;
+        uint32_t job_id;
+        bool job_pending;
+
+        uint32_t result_id;
+        solver::Verdict result;
+        bool result_ready;
+
+        // the rest is only used by the thread the game runs on: the positions
+        // along the current line of play (as far back as moves can be
+        // undone), numbered by how many moves in they are, and the rules
+        // the game is played with
+        engine::State positions[engine::UNDO_DEPTH + 1];
+        engine::Rules rules;
+        int depth;
+        int first_depth;
+
+        // the last job handed out, and the depth of the position it searches
+        uint32_t last_id;
+        int searching_depth;
+        bool searching;
+
+        // the deepest position known to be winnable, and the shallowest known
+        // to be unwinnable (if there are any); every position before a
+        // winnable one is winnable too, and every one after an unwinnable one
+        // is unwinnable too
+        int last_winnable;
+        bool have_winnable;
+
+        int first_unwinnable;
+        bool have_unwinnable;
+
+        // whether the search gave up on the current position, and whether it
+        // gave up while looking for the move that made the game unwinnable
+        bool current_unknown;
+        bool culprit_unknown;
+
+        void run();
+
+        engine::State &position(int at);
+        void search(int at);
+        void cancel_search();
+        void search_next();
+
+        public:
+            Monitor();
+            ~Monitor();
+
+            void set_tablebase(const Tablebase *tablebase);
+            void set_cache(SolverCache *cache);
+
+            void start(size_t node_limit = solver::DEFAULT_NODE_LIMIT);
+            void stop();
+
+            void reset(
+                const engine::State &state,
+                const engine::Rules &rules = engine::DEFAULT_RULES
+            );
+            void moved(const engine::State &state);
+            void undone(const engine::State &state);
+
+            MonitorStatus poll();
+    };
+#endif
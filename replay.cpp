@@ -0,0 +1,358 @@
+/* klondike/replay.cpp
+ * by python-b5
+ *
+ * A streaming format for recording games as they are played, and for
+ * replaying them without the game itself.
+ *
+ * A replay log starts with "KLRP", a version byte and 3 reserved bytes, and is
+ * followed by a stream of 16-bit little-endian words. Each word is either a
+ * move (packed by engine::encode(), with no taken count) or a control word.
+ * Control words use the otherwise invalid move type 7, with the control code
+ * in the "from" field:
+ *   - NEW_GAME and RESUME are followed by two words holding the deal number
+ *     (low word first). RESUME continues a game restored from a save, whose
+ *     earlier moves are in a previous record of the log.
+ *   - UNDO takes back the previous move.
+ *   - RULES can follow a game's deal number, giving the rules it is played
+ *     with (the draw count in the "to" field, and the pass limit in the
+ *     "count" field). Games without it use the default rules.
+ *
+ * Since words are only ever appended, a log cut short by a crash only loses
+ * its last, incomplete word (which is cut off the next time it is opened for
+ * recording, so the words after it line up).
+ */
+
+
+// project includes
+#include "replay.hpp"
+#include "engine.hpp"
+
+// standard libraries
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstring>
+
+// POSIX libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+// using declarations
+using namespace replay;
+
+
+// constants
+const uint8_t MAGIC[4] = {'K', 'L', 'R', 'P'};
+
+const uint16_t CONTROL_TYPE = 7;
+
+enum ControlCode {
+    NEW_GAME,
+    RESUME,
+    UNDO,
+    RULES
+};
+
+
+/* helper functions */
+
+/* Creates a control word. */
+static uint16_t control_word(ControlCode code) {
+    return CONTROL_TYPE | code << 3;
+}
+
+/* Creates a RULES control word. */
+static uint16_t rules_word(const engine::Rules &rules) {
+    return control_word(RULES) | (rules.draw_count & 0x7) << 6
+           | (rules.pass_limit & 0x1F) << 9;
+}
+
+/* Checks if a word is a RULES control word. */
+static bool is_rules_word(uint16_t word) {
+    return (word & 0x3F) == control_word(RULES);
+}
+
+/* Reads a word from a log. */
+static uint16_t read_word(const uint8_t *words, size_t index) {
+    return words[2 * index] | words[2 * index + 1] << 8;
+}
+
+
+/* Recorder implementation:
+ * Appends games to a replay log as they are played. Every word is flushed as
+ * soon as it is written, so the log is complete up to the last move even if
+ * the game crashes.
+ */
+
+Recorder::Recorder():
+    file(NULL)
+{}
+
+Recorder::~Recorder() {
+    close();
+}
+
+/* Opens a replay log for appending, writing its header if it is new, and
+ * cutting off any word left partly written by a crash.
+ * Returns whether it was successful; if not, nothing is recorded.
+ */
+bool Recorder::open(const std::string &path) {
+    close();
+
+    int output = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+
+    if (output < 0) {
+        return false;
+    }
+
+    struct stat info;
+    uint8_t header[HEADER_SIZE] = {};
+
+    bool failed = fstat(output, &info) != 0;
+
+    if (!failed && static_cast<size_t>(info.st_size) < HEADER_SIZE) {
+        // (a file too short to hold a header never got any words written to
+        // it, so it can just be started over)
+        std::memcpy(header, MAGIC, 4);
+        header[4] = VERSION;
+
+        failed = ftruncate(output, 0) != 0
+                 || write(output, header, HEADER_SIZE)
+                    != static_cast<ssize_t>(HEADER_SIZE);
+    } else if (!failed) {
+        // check the header, and cut off any incomplete word
+        size_t end = HEADER_SIZE + (info.st_size - HEADER_SIZE) / 2 * 2;
+
+        failed = pread(output, header, HEADER_SIZE, 0)
+                 != static_cast<ssize_t>(HEADER_SIZE)
+                 || std::memcmp(header, MAGIC, 4) != 0
+                 || header[4] != VERSION
+                 || (
+                     end != static_cast<size_t>(info.st_size)
+                     && ftruncate(output, end) != 0
+                 );
+    }
+
+    if (!failed) {
+        file = fdopen(output, "ab");
+        failed = file == NULL;
+    }
+
+    if (failed) {
+        ::close(output);
+        return false;
+    }
+
+    return true;
+}
+
+/* Closes the replay log, if one is open. */
+void Recorder::close() {
+    if (file != NULL) {
+        std::fclose(file);
+        file = NULL;
+    }
+}
+
+/* Writes a word to the log. */
+void Recorder::write_word(uint16_t word) {
+    if (file != NULL) {
+        uint8_t bytes[2] = {
+            static_cast<uint8_t>(word & 0xFF), static_cast<uint8_t>(word >> 8)
+        };
+
+        std::fwrite(bytes, 1, 2, file);
+        std::fflush(file);
+    }
+}
+
+/* Writes the control words that start a game record. The rules are only
+ * written if they aren't the default ones, so logs of default games stay the
+ * same.
+ */
+void Recorder::write_game(
+    uint16_t control, uint32_t deal_number, const engine::Rules &rules
+) {
+    write_word(control);
+    write_word(deal_number & 0xFFFF);
+    write_word(deal_number >> 16);
+
+    if (
+        rules.draw_count != engine::DEFAULT_RULES.draw_count
+        || rules.pass_limit != engine::DEFAULT_RULES.pass_limit
+    ) {
+        write_word(rules_word(rules));
+    }
+}
+
+/* Starts recording a newly dealt game. */
+void Recorder::new_game(uint32_t deal_number, const engine::Rules &rules) {
+    write_game(control_word(NEW_GAME), deal_number, rules);
+}
+
+/* Starts recording a game restored from a save. */
+void Recorder::resume(uint32_t deal_number, const engine::Rules &rules) {
+    write_game(control_word(RESUME), deal_number, rules);
+}
+
+/* Records a move, which must have been legal. */
+void Recorder::move(const engine::Move &move) {
+    engine::Undo undo;
+
+    undo.move = move;
+    undo.taken = 0;
+
+    write_word(engine::encode(undo));
+}
+
+/* Records a move being taken back. */
+void Recorder::undo() {
+    write_word(control_word(UNDO));
+}
+
+
+/* functions */
+
+/* Splits a replay log into its games, appending them to a vector. Words before
+ * the first game, and any trailing partial word, are ignored.
+ * Returns whether the log's header was valid.
+ */
+bool replay::split(
+    const uint8_t *data, size_t size, std::vector<GameRecord> &games
+) {
+    if (size < HEADER_SIZE) {
+        return false;
+    }
+
+    for (size_t i = 0; i < 4; ++i) {
+        if (data[i] != MAGIC[i]) {
+            return false;
+        }
+    }
+
+    if (data[4] != VERSION) {
+        return false;
+    }
+
+    const uint8_t *words = data + HEADER_SIZE;
+    size_t word_count = (size - HEADER_SIZE) / 2;
+
+    GameRecord *current = NULL;
+
+    for (size_t i = 0; i < word_count; ++i) {
+        uint16_t word = read_word(words, i);
+
+        bool starts_game = word == control_word(NEW_GAME)
+                           || word == control_word(RESUME);
+
+        if (starts_game) {
+            // a game cut off before its deal number is complete is dropped
+            if (i + 2 >= word_count) {
+                break;
+            }
+
+            GameRecord record;
+
+            record.deal_number = read_word(words, i + 1)
+                                 | read_word(words, i + 2) << 16;
+            record.rules = engine::DEFAULT_RULES;
+            record.resumed = word == control_word(RESUME);
+            record.continues = record.resumed && current != NULL
+                               && current->deal_number == record.deal_number;
+            record.words = words + 2 * (i + 3);
+            record.word_count = 0;
+
+            i += 2;
+
+            if (i + 1 < word_count && is_rules_word(read_word(words, i + 1))) {
+                uint16_t rules = read_word(words, ++i);
+
+                record.rules.draw_count = (rules >> 6) & 0x7;
+                record.rules.pass_limit = (rules >> 9) & 0x1F;
+                record.words += 2;
+            }
+
+            games.push_back(record);
+            current = &games.back();
+        } else if (current != NULL) {
+            ++current->word_count;
+        }
+    }
+
+    return true;
+}
+
+/* Returns the number of records in the chain starting at a given record. */
+size_t replay::chain_length(
+    const std::vector<GameRecord> &games, size_t start
+) {
+    size_t end = start + 1;
+
+    while (end < games.size() && games[end].continues) {
+        ++end;
+    }
+
+    return end - start;
+}
+
+/* Replays a chain of records from its deal, checking every move is legal. The
+ * game is left in its final position.
+ * Chains starting with a resumed game can't be checked (since their earlier
+ * moves aren't in the log), so they are never valid, and neither are games
+ * with unsupported rules.
+ */
+Outcome replay::run(
+    const GameRecord *records, size_t count, engine::Game &game
+) {
+    Outcome outcome;
+
+    outcome.valid = !records[0].resumed
+                    && engine::is_supported(records[0].rules);
+    outcome.won = false;
+    outcome.moves = 0;
+    outcome.undos = 0;
+    outcome.failed_record = 0;
+    outcome.failed_at = 0;
+
+    engine::deal(game, records[0].deal_number, records[0].rules);
+
+    if (!outcome.valid) {
+        return outcome;
+    }
+
+    for (size_t record = 0; record < count; ++record) {
+        const GameRecord &current = records[record];
+
+        for (size_t i = 0; i < current.word_count; ++i) {
+            uint16_t word = read_word(current.words, i);
+
+            bool success;
+
+            if (word == control_word(UNDO)) {
+                success = engine::undo(game);
+                ++outcome.undos;
+            } else {
+                success = engine::play(game, engine::decode(word).move);
+                ++outcome.moves;
+            }
+
+            if (!success) {
+                outcome.valid = false;
+                outcome.failed_record = record;
+                outcome.failed_at = i;
+
+                return outcome;
+            }
+        }
+    }
+
+    outcome.won = engine::won(game.state);
+
+    return outcome;
+}
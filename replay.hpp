@@ -0,0 +1,105 @@
+/* klondike/replay.hpp
+ * by python-b5
+ *
+ * A streaming format for recording games as they are played, and for
+ * replaying them without the game itself.
+ */
+
+
+// project includes
+#include "engine.hpp"
+
+// standard libraries
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+
+
+#ifndef REPLAY
+    #define REPLAY
+
+    namespace replay {
+        // constants
+        const uint8_t VERSION = 1;
+        const size_t HEADER_SIZE = 8;
+
+
+        /* A recorded game, pointing into a replay log's words.
+         * A resumed game continues the record before it if that record has
+         * the same deal number; together they make up a chain.
+         */
+        struct GameRecord {
+            uint32_t deal_number;
+            engine::Rules rules;
+            bool resumed;
+            bool continues;
+
+            const uint8_t *words;
+            size_t word_count;
+        };
+
+        /* The result of replaying a game. */
+        struct Outcome {
+            bool valid;
+            bool won;
+
+            size_t moves;
+            size_t undos;
+
+            // the record and word index of the first invalid word, if the game
+            // wasn't valid
+            size_t failed_record;
+            size_t failed_at;
+        };
+
+
+        class Recorder {
+            std::FILE *file;
+
+            void write_word(uint16_t word);
+            void write_game(
+                uint16_t control, uint32_t deal_number,
+                const engine::Rules &rules
+            );
+
+            public:
+                Recorder();
+                ~Recorder();
+
+                Recorder(const Recorder &) = delete;
+                Recorder &operator=(const Recorder &) = delete;
+
+                bool open(const std::string &path);
+                void close();
+
+                void new_game(
+                    uint32_t deal_number,
+                    const engine::Rules &rules = engine::DEFAULT_RULES
+                );
+                void resume(
+                    uint32_t deal_number,
+                    const engine::Rules &rules = engine::DEFAULT_RULES
+                );
+                void move(const engine::Move &move);
+                void undo();
+        };
+
+
+        // functions
+        bool split(
+            const uint8_t *data, size_t size, std::vector<GameRecord> &games
+        );
+
+        size_t chain_length(
+            const std::vector<GameRecord> &games, size_t start
+        );
+
+        Outcome run(
+            const GameRecord *records, size_t count, engine::Game &game
+        );
+    }
+#endif
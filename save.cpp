@@ -0,0 +1,430 @@
+/* klondike/save.cpp
+ * by python-b5
+ *
+ * A compact, versioned binary format for saving games in progress.
+ *
+ * Layout (all multi-byte values are little-endian):
+ *   - "KLSV" and a version byte
+ *   - the deal number (4 bytes)
+ *   - each foundation's height and suit (1 byte each, height in the low
+ *     nibble)
+ *   - each tableau stack's size and face-down count, followed by its cards
+ *   - the stock's size and cards, then the waste's size, cards and the number
+ *     of cards taken
+ *   - the rules (draw count in the low nibble, pass limit in the high one)
+ *     and the number of passes made (since version 2; version 1 saves are
+ *     read as using the default rules)
+ *   - the number of undo records, followed by each one (oldest first) as
+ *     packed by engine::encode()
+ */
+
+
+// project includes
+#include "save.hpp"
+#include "engine.hpp"
+
+// standard libraries
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+
+
+// using declarations
+using namespace engine;
+
+
+// constants
+const uint8_t MAGIC[4] = {'K', 'L', 'S', 'V'};
+
+
+/* helper functions */
+
+/* Checks that an undo record's move type is a real one, and that the
+ * tableau stacks and foundations it names exist.
+ */
+static bool in_range(const Undo &undo) {
+    const Move &move = undo.move;
+
+    switch (move.type) {
+        case DRAW:
+            return true;
+
+        case FLIP:
+            return move.from < 7;
+
+        case WASTE_TO_FOUNDATION:
+            return move.to < 4;
+
+        case WASTE_TO_TABLEAU:
+            return move.to < 7;
+
+        case TABLEAU_TO_FOUNDATION:
+            return move.from < 7 && move.to < 4;
+
+        case TABLEAU_TO_TABLEAU:
+            return move.from < 7 && move.to < 7;
+
+        case FOUNDATION_TO_TABLEAU:
+            return move.from < 4 && move.to < 7;
+
+        default:
+            return false;
+    }
+}
+
+/* Checks that reverting an undo record in a valid position would only touch
+ * cards that are there, and would leave room for every card it puts back.
+ */
+static bool can_revert(const State &state, const Undo &undo) {
+    const Move &move = undo.move;
+    bool stock_full = state.stock_size + state.waste_size == STOCK_CAPACITY;
+
+    switch (move.type) {
+        case DRAW:
+            return move.count == 0 ? state.waste_size == 0
+                                   : move.count <= state.waste_size;
+
+        case FLIP: {
+            const Pile &pile = state.tableau[move.from];
+            return pile.face_down < pile.size;
+        }
+
+        case WASTE_TO_FOUNDATION:
+            return !stock_full && state.foundations[move.to].next != 0;
+
+        case WASTE_TO_TABLEAU:
+            return !stock_full && state.tableau[move.to].size != 0;
+
+        case TABLEAU_TO_FOUNDATION:
+            return state.tableau[move.from].size < PILE_CAPACITY
+                && state.foundations[move.to].next != 0;
+
+        case TABLEAU_TO_TABLEAU:
+            return move.count <= state.tableau[move.to].size
+                && state.tableau[move.from].size + move.count
+                   <= PILE_CAPACITY;
+
+        case FOUNDATION_TO_TABLEAU:
+            return state.foundations[move.from].next < 13
+                && state.tableau[move.to].size != 0;
+
+        default:
+            return false;
+    }
+}
+
+/* Checks that a game's undo log can be taken back all the way, by reverting
+ * every record (newest first) in a copy of its position. Each one must leave
+ * a valid position, in which the move it records is legal and leads back to
+ * the position before it was reverted.
+ */
+template <typename V>
+static bool check_undo_log(const Game &game) {
+    State state = game.state;
+
+    for (int i = game.undo_size - 1; i >= 0; --i) {
+        const Undo &undo = game.undo_log[i];
+
+        if (!can_revert(state, undo)) {
+            return false;
+        }
+
+        State after = state;
+        revert(state, undo);
+
+        if (
+            check_state<V>(state) != NULL
+            || !is_legal<V>(state, undo.move)
+        ) {
+            return false;
+        }
+
+        State replayed = state;
+        apply<V>(replayed, undo.move);
+
+        if (!same_position(replayed, after)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/* Encodes a game into a buffer, which must be at least MAX_SIZE bytes long.
+ * Returns the number of bytes written.
+ */
+size_t save::encode(const Game &game, uint8_t *buffer) {
+    const State &state = game.state;
+    size_t size = 0;
+
+    // header
+    for (uint8_t byte : MAGIC) {
+        buffer[size++] = byte;
+    }
+
+    buffer[size++] = VERSION;
+
+    for (int i = 0; i < 4; ++i) {
+        buffer[size++] = (game.deal_number >> (8 * i)) & 0xFF;
+    }
+
+    // foundations
+    for (const Foundation &foundation : state.foundations) {
+        buffer[size++] = foundation.next | foundation.suit << 4;
+    }
+
+    // tableau
+    for (const Pile &pile : state.tableau) {
+        buffer[size++] = pile.size;
+        buffer[size++] = pile.face_down;
+
+        for (int i = 0; i < pile.size; ++i) {
+            buffer[size++] = pile.cards[i];
+        }
+    }
+
+    // stock and waste
+    buffer[size++] = state.stock_size;
+
+    for (int i = 0; i < state.stock_size; ++i) {
+        buffer[size++] = state.stock[i];
+    }
+
+    buffer[size++] = state.waste_size;
+
+    for (int i = 0; i < state.waste_size; ++i) {
+        buffer[size++] = state.waste[i];
+    }
+
+    buffer[size++] = state.taken;
+
+    // rules
+    buffer[size++] = game.rules.draw_count | game.rules.pass_limit << 4;
+    buffer[size++] = state.passes;
+
+    // undo log
+    buffer[size++] = game.undo_size;
+
+    for (int i = game.undo_size; i > 0; --i) {
+        uint16_t undo = engine::encode(game.undo_log[
+            (game.undo_next + UNDO_DEPTH - i) % UNDO_DEPTH
+        ]);
+
+        buffer[size++] = undo & 0xFF;
+        buffer[size++] = undo >> 8;
+    }
+
+    return size;
+}
+
+/* Decodes a game from a buffer, checking that it is well-formed, that its
+ * position is a valid one under its rules, and that every move in its undo
+ * log can be taken back.
+ * Returns whether it was successful. The game is only changed if so.
+ */
+bool save::decode(Game &game, const uint8_t *buffer, size_t size) {
+    Game result;
+    State &state = result.state;
+
+    size_t position = 0;
+
+    // reads one byte, failing if there are none left
+    auto read_byte = [&](uint8_t &byte) -> bool {
+        if (position >= size) {
+            return false;
+        }
+
+        byte = buffer[position++];
+        return true;
+    };
+
+    // header
+    uint8_t byte;
+
+    for (uint8_t expected : MAGIC) {
+        if (!read_byte(byte) || byte != expected) {
+            return false;
+        }
+    }
+
+    uint8_t version;
+
+    if (!read_byte(version) || version < 1 || version > VERSION) {
+        return false;
+    }
+
+    result.deal_number = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        if (!read_byte(byte)) {
+            return false;
+        }
+
+        result.deal_number |= static_cast<uint32_t>(byte) << (8 * i);
+    }
+
+    // foundations
+    for (Foundation &foundation : state.foundations) {
+        if (!read_byte(byte)) {
+            return false;
+        }
+
+        foundation.next = byte & 0xF;
+        foundation.suit = byte >> 4;
+
+        if (foundation.next > 13 || foundation.suit > 3) {
+            return false;
+        }
+    }
+
+    // tableau
+    for (Pile &pile : state.tableau) {
+        if (
+            !read_byte(pile.size) || !read_byte(pile.face_down)
+            || pile.size > PILE_CAPACITY || pile.face_down > pile.size
+        ) {
+            return false;
+        }
+
+        for (int i = 0; i < pile.size; ++i) {
+            if (!read_byte(pile.cards[i])) {
+                return false;
+            }
+        }
+    }
+
+    // stock and waste
+    if (!read_byte(state.stock_size) || state.stock_size > STOCK_CAPACITY) {
+        return false;
+    }
+
+    for (int i = 0; i < state.stock_size; ++i) {
+        if (!read_byte(state.stock[i])) {
+            return false;
+        }
+    }
+
+    if (!read_byte(state.waste_size) || state.waste_size > STOCK_CAPACITY) {
+        return false;
+    }
+
+    for (int i = 0; i < state.waste_size; ++i) {
+        if (!read_byte(state.waste[i])) {
+            return false;
+        }
+    }
+
+    if (!read_byte(state.taken)) {
+        return false;
+    }
+
+    // rules
+    result.rules = DEFAULT_RULES;
+    state.passes = 0;
+
+    if (version >= 2) {
+        if (!read_byte(byte) || !read_byte(state.passes)) {
+            return false;
+        }
+
+        result.rules.draw_count = byte & 0xF;
+        result.rules.pass_limit = byte >> 4;
+
+        if (!is_supported(result.rules)) {
+            return false;
+        }
+    }
+
+    // (the cards can only be checked once the rules are known, since they
+    // limit how many can be taken and how many passes can be made)
+    if (check_state(result.rules, state) != NULL) {
+        return false;
+    }
+
+    // undo log
+    if (!read_byte(result.undo_size) || result.undo_size > UNDO_DEPTH) {
+        return false;
+    }
+
+    for (int i = 0; i < result.undo_size; ++i) {
+        uint8_t low, high;
+
+        if (!read_byte(low) || !read_byte(high)) {
+            return false;
+        }
+
+        result.undo_log[i] = engine::decode(low | high << 8);
+
+        if (!in_range(result.undo_log[i])) {
+            return false;
+        }
+    }
+
+    result.undo_next = result.undo_size % UNDO_DEPTH;
+
+    if (position != size) {
+        return false;
+    }
+
+    bool undoable = with_variant(result.rules, [&](auto variant) {
+        return check_undo_log<decltype(variant)>(result);
+    });
+
+    if (!undoable) {
+        return false;
+    }
+
+    game = result;
+
+    return true;
+}
+
+/* Saves a game to a file. The file is written under a temporary name first
+ * and then renamed, so an interrupted save never leaves a corrupt file
+ * behind.
+ * Returns whether it was successful.
+ */
+bool save::write(const std::string &path, const Game &game) {
+    uint8_t buffer[MAX_SIZE];
+    size_t size = encode(game, buffer);
+
+    std::string temp_path = path + ".tmp";
+    std::FILE *file = std::fopen(temp_path.c_str(), "wb");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    bool success = std::fwrite(buffer, 1, size, file) == size;
+    success = (std::fclose(file) == 0) && success;
+
+    if (!success) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+
+    return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+/* Loads a game from a file.
+ * Returns whether it was successful. The game is only changed if so.
+ */
+bool save::read(const std::string &path, Game &game) {
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    // read one byte more than a save can hold, so oversized files are caught
+    uint8_t buffer[MAX_SIZE + 1];
+    size_t size = std::fread(buffer, 1, sizeof(buffer), file);
+
+    std::fclose(file);
+
+    return decode(game, buffer, size);
+}
@@ -0,0 +1,38 @@
+/* klondike/save.hpp
+ * by python-b5
+ *
+ * A compact, versioned binary format for saving games in progress.
+ */
+
+
+// project includes
+#include "engine.hpp"
+
+// standard libraries
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef SAVE
+    #define SAVE
+
+    namespace save {
+        // constants
+        const uint8_t VERSION = 2;
+
+        // (header, deal number, foundations, stack sizes, every card that
+        // isn't on a foundation, stock/waste sizes, the rules and passes made,
+        // and the full undo log)
+        const size_t MAX_SIZE = 5 + 4 + 4 + 14 + 52 + 4 + 2
+                                + 2 * engine::UNDO_DEPTH;
+
+
+        // functions
+        size_t encode(const engine::Game &game, uint8_t *buffer);
+        bool decode(engine::Game &game, const uint8_t *buffer, size_t size);
+
+        bool write(const std::string &path, const engine::Game &game);
+        bool read(const std::string &path, engine::Game &game);
+    }
+#endif
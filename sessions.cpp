@@ -0,0 +1,488 @@
+/* klondike/sessions.cpp
+ * by python-b5
+ *
+ * Many games hosted at once, each driven by text commands (for serving games
+ * to a front end; see tools/server.cpp).
+ *
+ * Commands are single lines of words, and each gets a single line back,
+ * starting with "OK" or "ERR" (followed by what went wrong):
+ *   NEW [rules] [deal]  starts a game (the rules are written as for the
+ *                       tools, e.g. "1" or "3/3", defaulting to "3"; the
+ *                       deal defaults to a random one)
+ *                       -> OK <id> <deal> <position>
+ *   STATE <id>          -> OK <position>
+ *   MOVES <id>          -> OK <action>...  (every legal move)
+ *   MOVE <id> <action>  makes a move -> OK <changes>
+ *   UNDO <id>           takes the last move back -> OK <changes>
+ *   END <id>            ends a game -> OK
+ *   STATS               -> OK <active sessions> <capacity> <session size>
+ *
+ * Moves are numbered as actions, the same way as for the training
+ * environment (see env::encode_action()).
+ *
+ * Positions are written as a word per part of the board, and changes as the
+ * words for just the parts that changed:
+ *   t<stack>:<face-down count><face-up cards>  a tableau stack (bottom first)
+ *   f<foundation>:<top card, or "-">           a foundation
+ *   s:<stock size>,<waste size>,<passes>,<cards shown from the waste>
+ * followed by "won" once the game has been won. Cards are single letters:
+ * "A" to "M" are the clubs from ace to king, then "N" to "Z" the diamonds,
+ * "a" to "m" the hearts and "n" to "z" the spades. Face-down cards and the
+ * stock's contents are never sent, so a front end only learns what a player
+ * would see.
+ *
+ * Nothing here allocates once the pool is made, so commands take about as
+ * long as the move itself.
+ */
+
+
+// project includes
+#include "sessions.hpp"
+#include "engine.hpp"
+#include "env.hpp"
+
+// standard libraries
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+// using declarations
+using namespace sessions;
+using namespace engine;
+
+
+// constants
+const uint32_t SLOT_MASK = MAX_SESSIONS - 1;
+const uint32_t GENERATION_LIMIT = (static_cast<uint32_t>(1) << (32 - SLOT_BITS))
+                                  - 1;
+
+
+/* helper functions */
+
+/* Returns the letter a card is written as. */
+static char card_letter(Card card) {
+    return card < 26 ? 'A' + card : 'a' + (card - 26);
+}
+
+/* Copies the next word of a command into a buffer (cutting it short if it
+ * doesn't fit), moving past it.
+ * Returns whether there was one.
+ */
+static bool next_word(const char *&command, char *word, size_t size) {
+    while (*command == ' ') {
+        ++command;
+    }
+
+    size_t length = 0;
+
+    while (*command != '\0' && *command != ' ') {
+        if (length + 1 < size) {
+            word[length++] = *command;
+        }
+
+        ++command;
+    }
+
+    word[length] = '\0';
+
+    return length != 0;
+}
+
+/* Reads the next word of a command as a number, moving past it.
+ * Returns whether it was one.
+ */
+static bool next_number(const char *&command, uint32_t &number) {
+    char word[16];
+
+    if (!next_word(command, word, sizeof(word))) {
+        return false;
+    }
+
+    char *end;
+    unsigned long value = std::strtoul(word, &end, 10);
+
+    number = static_cast<uint32_t>(value);
+
+    return *end == '\0' && value <= UINT32_MAX;
+}
+
+/* Writes a tableau stack's word. */
+static size_t write_pile(const Pile &pile, int i, char *out) {
+    size_t length = std::sprintf(out, "t%d:%d", i, pile.face_down);
+
+    for (int j = pile.face_down; j < pile.size; ++j) {
+        out[length++] = card_letter(pile.cards[j]);
+    }
+
+    return length;
+}
+
+/* Writes a foundation's word. */
+static size_t write_foundation(const Foundation &foundation, int i, char *out) {
+    size_t length = std::sprintf(out, "f%d:", i);
+
+    out[length++] = foundation.next == 0
+                    ? '-' : card_letter(foundation_top(foundation));
+
+    return length;
+}
+
+/* Writes the word for the stock and waste. */
+static size_t write_stock(const State &state, char *out) {
+    size_t length = std::sprintf(
+        out, "s:%d,%d,%d,", state.stock_size, state.waste_size, state.passes
+    );
+
+    for (int i = state.waste_size - state.taken; i < state.waste_size; ++i) {
+        out[length++] = card_letter(state.waste[i]);
+    }
+
+    return length;
+}
+
+/* Checks if a tableau stack looks any different. */
+static bool pile_changed(const Pile &before, const Pile &after) {
+    return before.size != after.size || before.face_down != after.face_down
+           || std::memcmp(before.cards, after.cards, after.size) != 0;
+}
+
+/* Checks if the stock or waste looks any different. */
+static bool stock_changed(const State &before, const State &after) {
+    if (
+        before.stock_size != after.stock_size
+        || before.waste_size != after.waste_size
+        || before.passes != after.passes || before.taken != after.taken
+    ) {
+        return true;
+    }
+
+    int first = after.waste_size - after.taken;
+
+    return std::memcmp(
+        before.waste + first, after.waste + first, after.taken
+    ) != 0;
+}
+
+/* Writes an error reply. */
+static size_t error(char *reply, const char *message) {
+    return std::sprintf(reply, "ERR %s\n", message);
+}
+
+
+/* Pool implementation:
+ * A slab of sessions.
+ */
+
+/* Makes a pool holding up to a given number of sessions (at most
+ * MAX_SESSIONS), drawing random deals from a seed.
+ */
+Pool::Pool(size_t capacity, uint64_t seed_):
+    slab(capacity < MAX_SESSIONS ? capacity : MAX_SESSIONS),
+    seed(seed_)
+{
+    free_slots.reserve(slab.size());
+
+    // (handing out the lowest slots first keeps the sessions in use close
+    // together)
+    for (size_t i = slab.size(); i > 0; --i) {
+        slab[i - 1].generation = 0;
+        slab[i - 1].active = false;
+
+        free_slots.push_back(static_cast<uint32_t>(i - 1));
+    }
+}
+
+/* Starts a game of a given deal.
+ * Returns its session's id, or NO_SESSION if the pool is full.
+ */
+uint32_t Pool::open(const Rules &rules, uint32_t deal_number) {
+    if (free_slots.empty()) {
+        return NO_SESSION;
+    }
+
+    uint32_t slot = free_slots.back();
+    free_slots.pop_back();
+
+    Session &session = slab[slot];
+
+    // (generations start at 1, so no id is ever NO_SESSION)
+    session.generation = session.generation % GENERATION_LIMIT + 1;
+    session.active = true;
+
+    deal(session.game, deal_number, rules);
+
+    return static_cast<uint32_t>(session.generation) << SLOT_BITS | slot;
+}
+
+/* Starts a game of a random deal.
+ * Returns its session's id, or NO_SESSION if the pool is full.
+ */
+uint32_t Pool::open(const Rules &rules) {
+    return open(rules, static_cast<uint32_t>(next_random(seed)));
+}
+
+/* Ends a session, freeing its slot.
+ * Returns whether there was one with that id.
+ */
+bool Pool::close(uint32_t id) {
+    if (find(id) == NULL) {
+        return false;
+    }
+
+    slab[id & SLOT_MASK].active = false;
+    free_slots.push_back(id & SLOT_MASK);
+
+    return true;
+}
+
+/* Finds the session with a given id.
+ * Returns NULL if there isn't one (or it has ended).
+ */
+Session *Pool::find(uint32_t id) {
+    uint32_t slot = id & SLOT_MASK;
+
+    if (slot >= slab.size()) {
+        return NULL;
+    }
+
+    Session &session = slab[slot];
+
+    if (!session.active || session.generation != id >> SLOT_BITS) {
+        return NULL;
+    }
+
+    return &session;
+}
+
+/* Returns the most sessions the pool can hold. */
+size_t Pool::get_capacity() const {
+    return slab.size();
+}
+
+/* Returns the number of sessions in use. */
+size_t Pool::get_active_count() const {
+    return slab.size() - free_slots.size();
+}
+
+
+/* functions */
+
+/* Runs a command (a line without its newline) against a pool, writing the
+ * reply (with its newline) into a buffer of at least MAX_REPLY bytes.
+ * Returns the length of the reply.
+ */
+size_t sessions::execute(Pool &pool, const char *command, char *reply) {
+    char name[8];
+
+    if (!next_word(command, name, sizeof(name))) {
+        return error(reply, "empty command");
+    }
+
+    // commands that aren't about one session
+    if (std::strcmp(name, "NEW") == 0) {
+        Rules rules = DEFAULT_RULES;
+        char word[16];
+
+        if (
+            next_word(command, word, sizeof(word))
+            && !parse_rules(word, rules)
+        ) {
+            return error(reply, "unsupported rules");
+        }
+
+        uint32_t deal_number;
+        uint32_t id;
+
+        if (next_number(command, deal_number)) {
+            id = pool.open(rules, deal_number);
+        } else {
+            id = pool.open(rules);
+        }
+
+        if (id == NO_SESSION) {
+            return error(reply, "too many sessions");
+        }
+
+        const Game &game = pool.find(id)->game;
+        size_t length = std::sprintf(
+            reply, "OK %u %u ", id, game.deal_number
+        );
+
+        length += write_state(game.state, reply + length);
+        reply[length++] = '\n';
+
+        return length;
+    }
+
+    if (std::strcmp(name, "STATS") == 0) {
+        return std::sprintf(
+            reply, "OK %zu %zu %zu\n", pool.get_active_count(),
+            pool.get_capacity(), sizeof(Session)
+        );
+    }
+
+    // commands about one session
+    const char *session_commands[5] = {"STATE", "MOVES", "MOVE", "UNDO", "END"};
+    bool known = false;
+
+    for (const char *session_command : session_commands) {
+        known = known || std::strcmp(name, session_command) == 0;
+    }
+
+    if (!known) {
+        return error(reply, "unknown command");
+    }
+
+    uint32_t id;
+
+    if (!next_number(command, id)) {
+        return error(reply, "missing session");
+    }
+
+    Session *session = pool.find(id);
+
+    if (session == NULL) {
+        return error(reply, "no such session");
+    }
+
+    Game &game = session->game;
+    size_t length = std::sprintf(reply, "OK");
+
+    if (std::strcmp(name, "STATE") == 0) {
+        reply[length++] = ' ';
+        length += write_state(game.state, reply + length);
+    } else if (std::strcmp(name, "MOVES") == 0) {
+        Move moves[MAX_MOVES];
+        int count = legal_moves(game.rules, game.state, moves);
+
+        for (int i = 0; i < count; ++i) {
+            length += std::sprintf(
+                reply + length, " %d", env::encode_action(moves[i])
+            );
+        }
+    } else if (std::strcmp(name, "MOVE") == 0) {
+        uint32_t action;
+
+        if (!next_number(command, action)) {
+            return error(reply, "missing action");
+        }
+
+        // find the legal move the action stands for, if any
+        Move moves[MAX_MOVES];
+        int count = legal_moves(game.rules, game.state, moves);
+        int found = -1;
+
+        for (int i = 0; i < count && found < 0; ++i) {
+            if (env::encode_action(moves[i]) == static_cast<int>(action)) {
+                found = i;
+            }
+        }
+
+        if (found < 0) {
+            return error(reply, "illegal move");
+        }
+
+        State before = game.state;
+        play(game, moves[found]);
+
+        reply[length++] = ' ';
+        length += write_delta(before, game.state, reply + length);
+    } else if (std::strcmp(name, "UNDO") == 0) {
+        State before = game.state;
+
+        if (!undo(game)) {
+            return error(reply, "nothing to undo");
+        }
+
+        reply[length++] = ' ';
+        length += write_delta(before, game.state, reply + length);
+    } else {
+        pool.close(id);
+    }
+
+    reply[length++] = '\n';
+
+    return length;
+}
+
+/* Writes a whole position (see above).
+ * Returns the number of characters written.
+ */
+size_t sessions::write_state(const State &state, char *out) {
+    size_t length = 0;
+
+    for (int i = 0; i < 7; ++i) {
+        length += write_pile(state.tableau[i], i, out + length);
+        out[length++] = ' ';
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        length += write_foundation(state.foundations[i], i, out + length);
+        out[length++] = ' ';
+    }
+
+    length += write_stock(state, out + length);
+
+    if (won(state)) {
+        length += std::sprintf(out + length, " won");
+    }
+
+    return length;
+}
+
+/* Writes the parts of a position that differ from how it was before (see
+ * above).
+ * Returns the number of characters written.
+ */
+size_t sessions::write_delta(
+    const State &before, const State &after, char *out
+) {
+    size_t length = 0;
+
+    // (every word but the first needs a space before it)
+    auto separate = [&]() {
+        if (length != 0) {
+            out[length++] = ' ';
+        }
+    };
+
+    for (int i = 0; i < 7; ++i) {
+        if (pile_changed(before.tableau[i], after.tableau[i])) {
+            separate();
+            length += write_pile(after.tableau[i], i, out + length);
+        }
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        const Foundation &old_foundation = before.foundations[i];
+        const Foundation &new_foundation = after.foundations[i];
+
+        if (
+            old_foundation.next != new_foundation.next || (
+                new_foundation.next != 0
+                && old_foundation.suit != new_foundation.suit
+            )
+        ) {
+            separate();
+            length += write_foundation(new_foundation, i, out + length);
+        }
+    }
+
+    if (stock_changed(before, after)) {
+        separate();
+        length += write_stock(after, out + length);
+    }
+
+    if (won(after)) {
+        separate();
+        length += std::sprintf(out + length, "won");
+    }
+
+    return length;
+}
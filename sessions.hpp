@@ -0,0 +1,76 @@
+/* klondike/sessions.hpp
+ * by python-b5
+ *
+ * Many games hosted at once, each driven by text commands (for serving games
+ * to a front end; see tools/server.cpp).
+ */
+
+
+// project includes
+#include "engine.hpp"
+
+// standard libraries
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef SESSIONS
+    #define SESSIONS
+
+    namespace sessions {
+        // constants
+        // (session ids hold a slot number in their low bits, and how many
+        // times the slot has been reused above that, so an id stops working
+        // once its session ends)
+        const int SLOT_BITS = 20;
+        const size_t MAX_SESSIONS = static_cast<size_t>(1) << SLOT_BITS;
+
+        const uint32_t NO_SESSION = 0;
+
+        // (the longest command and reply, including the newline; a full
+        // position is well under this)
+        const size_t MAX_COMMAND = 64;
+        const size_t MAX_REPLY = 512;
+
+
+        /* One hosted game. Sessions are fixed-size, so they all sit in one
+         * slab, and starting or ending one never allocates.
+         */
+        struct Session {
+            engine::Game game;
+            uint16_t generation;
+            bool active;
+        };
+
+        /* A fixed number of sessions, with the free ones kept on a list. */
+        class Pool {
+            std::vector<Session> slab;
+            std::vector<uint32_t> free_slots;
+
+            uint64_t seed;
+
+            public:
+                Pool(size_t capacity, uint64_t seed_);
+
+                uint32_t open(const engine::Rules &rules, uint32_t deal_number);
+                uint32_t open(const engine::Rules &rules);
+                bool close(uint32_t id);
+
+                Session *find(uint32_t id);
+
+                size_t get_capacity() const;
+                size_t get_active_count() const;
+        };
+
+
+        // functions
+        size_t execute(Pool &pool, const char *command, char *reply);
+
+        size_t write_state(const engine::State &state, char *out);
+        size_t write_delta(
+            const engine::State &before, const engine::State &after,
+            char *out
+        );
+    }
+#endif
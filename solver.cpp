@@ -0,0 +1,489 @@
+/* klondike/solver.cpp
+ * by python-b5
+ *
+ * A depth-first solver, for finding out whether a position can be won.
+ *
+ * The search tries the most promising moves first, skips moves that can never
+ * help (like moving a king between empty stacks), and remembers every position
+ * it has seen so it never searches one twice. Flips and safe moves to the
+ * foundations are always made straight away, since they can only help (but
+ * when drawing three cards at a time, safe moves from the waste can change
+ * which cards later draws reach, so they are searched like any other), and
+ * draws are folded into the moves that play the cards they reveal.
+ *
+ * No move that could matter is ever skipped, so a position the search can't
+ * win really is unwinnable.
+ *
+ * Given an endgame tablebase, endgames it says can be won are played out from
+ * it instead of being searched. (Endgames it says can't be won are still
+ * searched, since it doesn't consider taking cards back off the foundations.)
+ *
+ * Each position's candidates live in an arena while it is searched, rather
+ * than on the stack, so a deep search only holds as many as it needs and never
+ * allocates once the arena has grown to fit it. The arena and the table of
+ * visited positions are kept between searches, so the memory a solver holds
+ * is set by the hardest position it has solved (see get_peak_memory()).
+ *
+ * The search is specialized for each variant of the rules, so drawing one or
+ * three cards (and limiting passes or not) costs nothing at each node.
+ */
+
+
+// project includes
+#include "solver.hpp"
+#include "engine.hpp"
+#include "tablebase.hpp"
+#include "arena.hpp"
+
+// standard libraries
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+
+// using declarations
+using namespace solver;
+using namespace engine;
+
+
+/* helper functions */
+
+/* Appends the moves that finish a solved-out position to a path. */
+static void finish(State state, std::vector<Move> &path) {
+    while (!won(state)) {
+        // the lowest card on top of a stack can always go to its foundation
+        int lowest = -1;
+
+        for (int i = 0; i < 7; ++i) {
+            const Pile &pile = state.tableau[i];
+
+            if (
+                pile.size != 0 && (
+                    lowest < 0 || card_rank(pile.cards[pile.size - 1])
+                    < card_rank(state.tableau[lowest].cards[
+                        state.tableau[lowest].size - 1
+                    ])
+                )
+            ) {
+                lowest = i;
+            }
+        }
+
+        const Pile &pile = state.tableau[lowest];
+        Move move(
+            TABLEAU_TO_FOUNDATION, lowest,
+            find_foundation(state, pile.cards[pile.size - 1])
+        );
+
+        apply(state, move);
+        path.push_back(move);
+    }
+}
+
+/* Scores a move for ordering the search; higher scores are tried first.
+ * Returns -1 for moves that can never help.
+ */
+static int score(const State &state, const Move &move) {
+    switch (move.type) {
+        case FLIP:
+            return 100;
+
+        // lower cards are more urgent to get onto the foundations
+        case WASTE_TO_FOUNDATION:
+            return 80 - card_rank(state.waste[state.waste_size - 1]);
+
+        case TABLEAU_TO_FOUNDATION: {
+            const Pile &pile = state.tableau[move.from];
+
+            // moving the last face-up card also reveals a face-down one
+            return 80 - card_rank(pile.cards[pile.size - 1])
+                   + 10 * (pile.size - 1 == pile.face_down
+                           && pile.face_down != 0);
+        }
+
+        case TABLEAU_TO_TABLEAU: {
+            const Pile &from = state.tableau[move.from];
+            int start = from.size - move.count;
+
+            if (start == from.face_down) {
+                // moving a whole run is best if it reveals a face-down card,
+                // and useless if it just moves a king between empty stacks
+                if (from.face_down != 0) {
+                    return 60 + from.face_down;
+                }
+
+                return state.tableau[move.to].size == 0 ? -1 : 20;
+            }
+
+            // moving part of a run is mostly useful if it frees the card
+            // beneath for its foundation
+            return find_foundation(state, from.cards[start - 1]) >= 0 ? 50 : 5;
+        }
+
+        case WASTE_TO_TABLEAU:
+            return 40;
+
+        case FOUNDATION_TO_TABLEAU:
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+/* Adds a candidate to a list, keeping it sorted by score (highest first). */
+static void add_candidate(
+    Candidate *candidates, int &count, const Move &move, int draws, int score
+) {
+    // insertion sort, since there are only a few candidates
+    int i = count++;
+
+    while (i > 0 && candidates[i - 1].score < score) {
+        candidates[i] = candidates[i - 1];
+        --i;
+    }
+
+    candidates[i].move = move;
+    candidates[i].draws = draws;
+    candidates[i].score = score;
+}
+
+/* Solver implementation:
+ * A reusable solver. Its tables are kept between searches, so solving many
+ * positions in a row doesn't keep reallocating them.
+ */
+
+Solver::Solver():
+    visited_count(0),
+    nodes(0),
+    node_limit(0),
+    cancel(NULL),
+    gave_up(false),
+    tablebase(NULL)
+{}
+
+/* Returns the most memory the solver has held onto at once, in bytes: its
+ * table of visited positions, the moves on the current path, and the arena
+ * holding each position's candidates while it is searched.
+ */
+size_t Solver::get_peak_memory() const {
+    return visited.capacity() * sizeof(uint64_t)
+           + path.capacity() * sizeof(Move) + arena.get_capacity();
+}
+
+/* Sets the endgame tablebase to use (or NULL for none). */
+void Solver::set_tablebase(const Tablebase *tablebase_) {
+    tablebase = tablebase_;
+}
+
+/* Marks a position as visited, in an open-addressing hash table of position
+ * hashes (0 marks an empty slot).
+ * Returns whether it hadn't been visited before.
+ */
+bool Solver::visit(uint64_t hash) {
+    if (hash == 0) {
+        hash = 1;
+    }
+
+    // grow the table once it is half full
+    if (2 * (visited_count + 1) > visited.size()) {
+        std::vector<uint64_t> old;
+        old.swap(visited);
+
+        visited.assign(old.empty() ? 1 << 16 : 2 * old.size(), 0);
+        visited_count = 0;
+
+        for (uint64_t old_hash : old) {
+            if (old_hash != 0) {
+                visit(old_hash);
+            }
+        }
+    }
+
+    size_t mask = visited.size() - 1;
+
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        if (visited[i] == hash) {
+            return false;
+        }
+
+        if (visited[i] == 0) {
+            visited[i] = hash;
+            ++visited_count;
+
+            return true;
+        }
+    }
+}
+
+/* Searches a position, which is modified during the search but restored
+ * before returning.
+ * Returns whether it can be won (false if the search gave up).
+ */
+template <typename V>
+bool Solver::search(State &state, int depth) {
+    if (
+        nodes >= node_limit || depth >= MAX_DEPTH
+        || (cancel != NULL && cancel->load(std::memory_order_relaxed))
+    ) {
+        gave_up = true;
+        return false;
+    }
+
+    ++nodes;
+
+    if (solved_out(state)) {
+        finish(state, path);
+        return true;
+    }
+
+    if (tablebase != NULL && tablebase->covers(state)) {
+        State copy = state;
+        size_t path_size = path.size();
+
+        if (tablebase->play_out(copy, path)) {
+            finish(copy, path);
+            return true;
+        }
+
+        path.resize(path_size);
+    }
+
+    if (!visit(hash(state))) {
+        return false;
+    }
+
+    // (candidates are found in the scratch buffer, then only as many as
+    // there are are kept for the rest of the search from here)
+    int count = find_candidates<V>(state, scratch);
+
+    Arena::Mark mark = arena.mark();
+    Candidate *candidates = arena.allocate<Candidate>(count);
+    Undo *undos = arena.allocate<Undo>(MAX_DRAWS + 1);
+
+    std::copy(scratch, scratch + count, candidates);
+
+    // try each candidate in turn
+    bool success = false;
+
+    for (int i = 0; i < count; ++i) {
+        const Candidate &candidate = candidates[i];
+        size_t path_size = path.size();
+
+        for (int draw = 0; draw < candidate.draws; ++draw) {
+            undos[draw] = apply<V>(state, Move(DRAW));
+            path.push_back(undos[draw].move);
+        }
+
+        undos[candidate.draws] = apply<V>(state, candidate.move);
+        path.push_back(candidate.move);
+
+        success = search<V>(state, depth + 1);
+
+        for (int undo = candidate.draws; undo >= 0; --undo) {
+            revert(state, undos[undo]);
+        }
+
+        if (success || gave_up) {
+            break;
+        }
+
+        path.resize(path_size);
+    }
+
+    arena.release(mark);
+
+    return success;
+}
+
+/* Finds out whether a position can be won under a set of rules, giving up
+ * after searching a given number of positions, or as soon as a provided flag
+ * is set (so a search on another thread can be cancelled).
+ */
+Result Solver::solve(
+    const State &state, size_t node_limit_, const std::atomic<bool> *cancel_,
+    const Rules &rules
+) {
+    // (the table keeps its size, so it only grows on the hardest searches)
+    std::fill(visited.begin(), visited.end(), 0);
+    visited_count = 0;
+
+    path.clear();
+    arena.reset();
+
+    nodes = 0;
+    node_limit = node_limit_;
+    cancel = cancel_;
+    gave_up = false;
+
+    State copy = state;
+
+    Result result;
+
+    bool success = with_variant(rules, [&](auto variant) {
+        return search<decltype(variant)>(copy, 0);
+    });
+
+    if (success) {
+        result.verdict = WINNABLE;
+        result.solution = path;
+    } else if (gave_up) {
+        result.verdict = UNKNOWN;
+    } else {
+        result.verdict = UNWINNABLE;
+    }
+
+    result.nodes = nodes;
+
+    return result;
+}
+
+
+/* functions */
+
+/* Checks if a position is "solved out": the stock and waste are empty and
+ * every card is face-up. Such a position can always be won by repeatedly
+ * moving the lowest card on the tableau to its foundation.
+ */
+bool solver::solved_out(const State &state) {
+    if (state.stock_size != 0 || state.waste_size != 0) {
+        return false;
+    }
+
+    for (const Pile &pile : state.tableau) {
+        if (pile.face_down != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Finds the candidate moves in a position, sorted by score. The position is
+ * modified while drawing through the stock, but restored before returning.
+ * Draws are never searched on their own. Since drawing doesn't affect the
+ * tableau, it only ever needs to happen right before playing the card it
+ * reveals, so each card that drawing can reach becomes a candidate instead.
+ * Returns the number of candidates found.
+ */
+template <typename V>
+int solver::find_candidates(State &state, Candidate *candidates) {
+    int count = 0;
+
+    // safe moves are always made straight away, like flips (except from the
+    // waste when drawing three cards at a time, since taking a card out of
+    // the waste changes how the stock is grouped on later passes, which can
+    // cut off cards; those are left to be found as ordinary candidates)
+    Move safe;
+
+    if (find_safe_move(state, safe, V::DRAW_COUNT == 1)) {
+        candidates[0].move = safe;
+        candidates[0].draws = 0;
+        candidates[0].score = 100;
+
+        return 1;
+    }
+
+    Move moves[MAX_MOVES];
+    int move_count = legal_moves<V>(state, moves);
+
+    for (int i = 0; i < move_count; ++i) {
+        // flips are always made straight away
+        if (moves[i].type == FLIP) {
+            candidates[0].move = moves[i];
+            candidates[0].draws = 0;
+            candidates[0].score = 100;
+
+            return 1;
+        }
+
+        int move_score = score(state, moves[i]);
+
+        if (move_score >= 0) {
+            add_candidate(candidates, count, moves[i], 0, move_score);
+        }
+    }
+
+    // draw through the stock, adding moves for each card it reveals
+    int stock_size = state.stock_size;
+    int waste_size = state.waste_size;
+    int taken = state.taken;
+    int passes = state.passes;
+
+    Undo undos[MAX_DRAWS];
+    int draws = 0;
+
+    while (draws < MAX_DRAWS && is_legal<V>(state, Move(DRAW))) {
+        undos[draws++] = apply<V>(state, Move(DRAW));
+
+        // stop once the stock is back where it started
+        // (with a limit on passes, it never is, but drawing stops being legal
+        // instead)
+        if (
+            state.stock_size == stock_size && state.waste_size == waste_size
+            && state.taken == taken && state.passes == passes
+        ) {
+            break;
+        }
+
+        if (state.taken == 0) {
+            continue;
+        }
+
+        Card top = state.waste[state.waste_size - 1];
+        int to = find_foundation(state, top);
+
+        if (to >= 0) {
+            Move move(WASTE_TO_FOUNDATION, 0, to);
+            add_candidate(
+                candidates, count, move, draws, score(state, move) - draws
+            );
+        }
+
+        for (to = 0; to < 7; ++to) {
+            Move move(WASTE_TO_TABLEAU, 0, to);
+
+            if (is_legal(state, move)) {
+                add_candidate(
+                    candidates, count, move, draws, score(state, move) - draws
+                );
+            }
+        }
+    }
+
+    while (draws > 0) {
+        revert(state, undos[--draws]);
+    }
+
+    return count;
+}
+
+/* Rates how hard a winnable position is from 0 (easy) to 3 (very hard), going
+ * by how much searching it took to find a solution.
+ * Returns -1 for positions that couldn't be solved.
+ */
+int solver::difficulty(const Result &result) {
+    if (result.verdict != WINNABLE) {
+        return -1;
+    }
+
+    if (result.nodes < 1000) {
+        return 0;
+    } else if (result.nodes < 10000) {
+        return 1;
+    } else if (result.nodes < 100000) {
+        return 2;
+    } else {
+        return 3;
+    }
+}
+
+
+/* explicit instantiations */
+
+template int solver::find_candidates<DrawThree>(State &, Candidate *);
+template int solver::find_candidates<DrawOne>(State &, Candidate *);
+template int solver::find_candidates<DrawThreeVegas>(State &, Candidate *);
+template int solver::find_candidates<DrawOneVegas>(State &, Candidate *);
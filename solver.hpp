@@ -0,0 +1,116 @@
+/* klondike/solver.hpp
+ * by python-b5
+ *
+ * A depth-first solver, for finding out whether a position can be won.
+ */
+
+
+// project includes
+#include "engine.hpp"
+#include "arena.hpp"
+
+// standard libraries
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef SOLVER
+    #define SOLVER
+
+    class Tablebase;
+
+    namespace solver {
+        // constants
+        const size_t DEFAULT_NODE_LIMIT = 1000000;
+        const int MAX_DEPTH = 1024;
+
+        // (drawing three cards at a time, going through the whole stock and
+        // resetting it takes at most 9 draws, so this covers every card in
+        // the stock twice over; drawing one at a time, the stock is back
+        // where it started after at most 25 draws)
+        const int MAX_DRAWS = engine::STOCK_CAPACITY + 2;
+
+        // (every move but draws, plus a move to a foundation and each tableau
+        // stack for each draw)
+        const int MAX_CANDIDATES = engine::MAX_MOVES + 8 * MAX_DRAWS;
+
+
+        /* Whether a position can be won. UNKNOWN means the search gave up
+         * before finding out.
+         */
+        enum Verdict {
+            UNKNOWN,
+            WINNABLE,
+            UNWINNABLE
+        };
+
+        /* A move the search can make, possibly after drawing from the stock
+         * a number of times first.
+         */
+        struct Candidate {
+            engine::Move move;
+            uint8_t draws;
+            int score;
+        };
+
+        /* The result of a search. solution holds the moves that win the
+         * position (the shortest the search happened to find, which isn't
+         * necessarily the shortest possible), if it can be won.
+         */
+        struct Result {
+            Verdict verdict;
+            size_t nodes;
+
+            std::vector<engine::Move> solution;
+        };
+
+
+        class Solver {
+            std::vector<uint64_t> visited;
+            size_t visited_count;
+
+            std::vector<engine::Move> path;
+
+            // each position's candidates are found here, then copied into
+            // the arena for as long as it is being searched
+            Candidate scratch[MAX_CANDIDATES];
+            Arena arena;
+
+            size_t nodes;
+            size_t node_limit;
+            const std::atomic<bool> *cancel;
+            bool gave_up;
+
+            const Tablebase *tablebase;
+
+            bool visit(uint64_t hash);
+
+            template <typename V>
+            bool search(engine::State &state, int depth);
+
+            public:
+                Solver();
+
+                void set_tablebase(const Tablebase *tablebase);
+                size_t get_peak_memory() const;
+
+                Result solve(
+                    const engine::State &state,
+                    size_t node_limit = DEFAULT_NODE_LIMIT,
+                    const std::atomic<bool> *cancel = NULL,
+                    const engine::Rules &rules = engine::DEFAULT_RULES
+                );
+        };
+
+
+        // functions
+        bool solved_out(const engine::State &state);
+
+        template <typename V>
+        int find_candidates(engine::State &state, Candidate *candidates);
+
+        int difficulty(const Result &result);
+    }
+#endif
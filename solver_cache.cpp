@@ -0,0 +1,407 @@
+/* klondike/solver_cache.cpp
+ * by python-b5
+ *
+ * A persistent cache of solver results, so positions solved before (by
+ * earlier runs, or other programs) don't have to be searched again.
+ *
+ * Layout (all values are little-endian):
+ *   - a 16-byte header: "KLSC", a version byte, padded with zeroes
+ *   - records of 16 bytes each, in the order they were added: a position's
+ *     key (8 bytes), the number of positions searched or the node limit
+ *     (4 bytes; see CacheEntry), the verdict
+ *     (1 byte), the number of moves in the solution (1 byte), then a
+ *     checksum of the rest of the record (2 bytes)
+ *
+ * The file is only ever appended to, one whole record at a time, so a crash
+ * can at worst leave a partly-written record at the end. Opening the cache
+ * checks every record and cuts the file off before the first one that is
+ * incomplete or doesn't match its checksum, so everything before it is kept.
+ *
+ * A position can have several records, such as when a search that gave up
+ * is repeated with a higher node limit. Lookups use the latest verdict found,
+ * or failing that, the record of the biggest search that gave up.
+ */
+
+
+// project includes
+#include "solver_cache.hpp"
+#include "engine.hpp"
+#include "solver.hpp"
+#include "mapped_file.hpp"
+
+// standard libraries
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstring>
+
+// POSIX libraries
+#include <fcntl.h>
+#include <unistd.h>
+
+
+// using declarations
+using namespace engine;
+
+
+// constants
+const uint8_t MAGIC[4] = {'K', 'L', 'S', 'C'};
+const uint8_t VERSION = 1;
+const size_t HEADER_SIZE = 16;
+const size_t RECORD_SIZE = 16;
+
+
+/* helper functions */
+
+/* Reads a little-endian value of a given number of bytes from a buffer. */
+static uint64_t read_bytes(const uint8_t *buffer, int bytes) {
+    uint64_t value = 0;
+
+    for (int i = bytes - 1; i >= 0; --i) {
+        value = value << 8 | buffer[i];
+    }
+
+    return value;
+}
+
+/* Writes a little-endian value of a given number of bytes to a buffer. */
+static void write_bytes(uint8_t *buffer, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        buffer[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+/* Returns the checksum of a record (of all but its last 2 bytes). */
+static uint16_t checksum(const uint8_t *record) {
+    // 64-bit FNV-1a, folded down to 16 bits
+    uint64_t result = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < RECORD_SIZE - 2; ++i) {
+        result = (result ^ record[i]) * 1099511628211ULL;
+    }
+
+    return (result ^ result >> 16 ^ result >> 32 ^ result >> 48) & 0xFFFF;
+}
+
+/* Checks if a record should be used instead of an older one for the same
+ * position.
+ */
+static bool better(const CacheEntry &entry, const CacheEntry &old) {
+    if (entry.verdict != solver::UNKNOWN) {
+        return true;
+    }
+
+    return old.verdict == solver::UNKNOWN && entry.nodes > old.nodes;
+}
+
+
+/* SolverCache implementation:
+ * An append-only file of solver results, with a table in memory to find
+ * them by.
+ */
+
+SolverCache::SolverCache():
+    mapped_count(0),
+    record_count(0),
+    output(-1)
+{}
+
+SolverCache::~SolverCache() {
+    close();
+}
+
+/* Opens a cache, creating it if it doesn't exist, and cutting off anything
+ * left partly written by a crash.
+ * Returns whether it was successful.
+ */
+bool SolverCache::open(const std::string &path) {
+    close();
+
+    std::lock(output_mutex, mutex);
+    std::lock_guard<std::mutex> output_lock(output_mutex, std::adopt_lock);
+    std::lock_guard<std::mutex> lock(mutex, std::adopt_lock);
+
+    // (O_APPEND makes every write go to the end of the file, even if another
+    // process has appended to it in the meantime)
+    output = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+    if (output < 0) {
+        return false;
+    }
+
+    bool failed = !file.open(path);
+
+    // a file too short to hold a header never got any records written to it,
+    // so it can just be started over
+    if (!failed && file.get_size() < HEADER_SIZE) {
+        uint8_t header[HEADER_SIZE] = {};
+
+        std::memcpy(header, MAGIC, 4);
+        header[4] = VERSION;
+
+        failed = ftruncate(output, 0) != 0
+                 || write(output, header, HEADER_SIZE)
+                    != static_cast<ssize_t>(HEADER_SIZE)
+                 || !file.open(path);
+    }
+
+    if (
+        failed || file.get_size() < HEADER_SIZE
+        || std::memcmp(file.get_data(), MAGIC, 4) != 0
+        || file.get_data()[4] != VERSION
+    ) {
+        ::close(output);
+        output = -1;
+        file.close();
+
+        return false;
+    }
+
+    // find where the intact records end
+    const uint8_t *data = file.get_data();
+    size_t end = HEADER_SIZE;
+
+    while (
+        end + RECORD_SIZE <= file.get_size()
+        && read_bytes(data + end + RECORD_SIZE - 2, 2) == checksum(data + end)
+    ) {
+        end += RECORD_SIZE;
+    }
+
+    if (end != file.get_size()) {
+        // (the mapping is dropped first, since touching a page cut off from
+        // the file would crash)
+        file.close();
+
+        if (ftruncate(output, end) != 0 || !file.open(path)) {
+            ::close(output);
+            output = -1;
+
+            return false;
+        }
+    }
+
+    mapped_count = (end - HEADER_SIZE) / RECORD_SIZE;
+
+    for (size_t record = 0; record < mapped_count; ++record) {
+        index(record);
+    }
+
+    return true;
+}
+
+/* Closes the cache, if one is open. */
+void SolverCache::close() {
+    std::lock(output_mutex, mutex);
+    std::lock_guard<std::mutex> output_lock(output_mutex, std::adopt_lock);
+    std::lock_guard<std::mutex> lock(mutex, std::adopt_lock);
+
+    if (output >= 0) {
+        ::close(output);
+        output = -1;
+    }
+
+    file.close();
+    mapped_count = 0;
+
+    added_keys.clear();
+    added_entries.clear();
+
+    slots.clear();
+    record_count = 0;
+}
+
+/* Checks if a cache is open. */
+bool SolverCache::is_open() const {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    return output >= 0;
+}
+
+/* Returns the number of positions in the cache. */
+size_t SolverCache::get_entry_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return record_count;
+}
+
+/* Returns the key of a record. */
+uint64_t SolverCache::record_key(size_t record) const {
+    if (record >= mapped_count) {
+        return added_keys[record - mapped_count];
+    }
+
+    return read_bytes(file.get_data() + HEADER_SIZE + record * RECORD_SIZE, 8);
+}
+
+/* Returns what a record says about its position. */
+CacheEntry SolverCache::record_entry(size_t record) const {
+    if (record >= mapped_count) {
+        return added_entries[record - mapped_count];
+    }
+
+    const uint8_t *data = file.get_data() + HEADER_SIZE + record * RECORD_SIZE;
+    CacheEntry entry;
+
+    entry.nodes = read_bytes(data + 8, 4);
+    entry.verdict = static_cast<solver::Verdict>(data[12]);
+    entry.moves = data[13];
+
+    return entry;
+}
+
+/* Adds a record to the table, unless its position already has a better
+ * one.
+ */
+void SolverCache::index(size_t record) {
+    // grow the table once it is half full
+    if (2 * (record_count + 1) > slots.size()) {
+        std::vector<uint32_t> old;
+        old.swap(slots);
+
+        slots.assign(old.empty() ? 1 << 12 : 2 * old.size(), 0);
+        record_count = 0;
+
+        for (uint32_t slot : old) {
+            if (slot != 0) {
+                index(slot - 1);
+            }
+        }
+    }
+
+    uint64_t key_ = record_key(record);
+    size_t mask = slots.size() - 1;
+
+    for (size_t i = key_ & mask; ; i = (i + 1) & mask) {
+        if (slots[i] == 0) {
+            slots[i] = record + 1;
+            ++record_count;
+
+            return;
+        }
+
+        if (record_key(slots[i] - 1) == key_) {
+            if (better(record_entry(record), record_entry(slots[i] - 1))) {
+                slots[i] = record + 1;
+            }
+
+            return;
+        }
+    }
+}
+
+/* Looks up a position under a set of rules. A search that gave up only
+ * counts if it searched at least as many positions as the node limit the
+ * caller would search.
+ * Returns whether a usable result was found.
+ */
+bool SolverCache::lookup(
+    const State &state, const Rules &rules, size_t node_limit,
+    CacheEntry &entry
+) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (slots.empty()) {
+        return false;
+    }
+
+    uint64_t key_ = key(state, rules);
+    size_t mask = slots.size() - 1;
+
+    for (size_t i = key_ & mask; slots[i] != 0; i = (i + 1) & mask) {
+        if (record_key(slots[i] - 1) == key_) {
+            CacheEntry found = record_entry(slots[i] - 1);
+
+            if (found.verdict == solver::UNKNOWN && found.nodes < node_limit) {
+                return false;
+            }
+
+            entry = found;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Records the result of solving a position under a set of rules with a
+ * given node limit, appending it to the file. (Searches that were cancelled
+ * shouldn't be added, since they say nothing about the position.) It can be
+ * looked up straight away, before it has been written.
+ * Returns whether it was successful (if it couldn't be written, it is still
+ * kept in memory).
+ */
+bool SolverCache::add(
+    const State &state, const Rules &rules, size_t node_limit,
+    const solver::Result &result
+) {
+    uint64_t key_ = key(state, rules);
+
+    CacheEntry entry;
+    entry.verdict = result.verdict;
+    // (a search can give up before reaching its node limit, such as by
+    // going too deep, but would just do the same again with that limit)
+    entry.nodes = std::min<size_t>(
+        result.verdict == solver::UNKNOWN ? node_limit : result.nodes,
+        UINT32_MAX
+    );
+    entry.moves = std::min<size_t>(result.solution.size(), 255);
+
+    uint8_t record[RECORD_SIZE];
+
+    write_bytes(record, key_, 8);
+    write_bytes(record + 8, entry.nodes, 4);
+    record[12] = entry.verdict;
+    record[13] = entry.moves;
+    write_bytes(record + 14, checksum(record), 2);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // (an open cache always has its file mapped, since that holds at
+        // least a header)
+        if (file.get_size() == 0) {
+            return false;
+        }
+
+        added_keys.push_back(key_);
+        added_entries.push_back(entry);
+        index(mapped_count + added_keys.size() - 1);
+    }
+
+    // (the lookup table is unlocked by now, so other threads can keep
+    // looking positions up while the record is written)
+    std::lock_guard<std::mutex> lock(output_mutex);
+
+    if (output < 0) {
+        return false;
+    }
+
+    // a record that doesn't get written in full would make every one after
+    // it unreadable, so nothing more is appended after a failure
+    if (
+        write(output, record, RECORD_SIZE)
+        != static_cast<ssize_t>(RECORD_SIZE)
+    ) {
+        ::close(output);
+        output = -1;
+
+        return false;
+    }
+
+    return true;
+}
+
+/* Returns the key a position is cached under for a set of rules. */
+uint64_t SolverCache::key(const State &state, const Rules &rules) {
+    uint64_t result = hash(state);
+
+    result ^= (static_cast<uint64_t>(rules.draw_count) << 8 | rules.pass_limit)
+              * 0x9E3779B97F4A7C15ULL;
+
+    return result;
+}
@@ -0,0 +1,92 @@
+/* klondike/solver_cache.hpp
+ * by python-b5
+ *
+ * A persistent cache of solver results, so positions solved before (by
+ * earlier runs, or other programs) don't have to be searched again.
+ */
+
+
+// project includes
+#include "engine.hpp"
+#include "solver.hpp"
+#include "mapped_file.hpp"
+
+// standard libraries
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef SOLVER_CACHE
+    #define SOLVER_CACHE
+
+    /* What a search found out about a position. nodes is how many positions
+     * it searched, or if it gave up, its node limit (capped at the most 4
+     * bytes can hold), and moves is the length of the solution it found
+     * (capped at 255, and only set if it can be won).
+     */
+    struct CacheEntry {
+        solver::Verdict verdict;
+        uint32_t nodes;
+        uint8_t moves;
+    };
+
+    class SolverCache {
+        // records already in the file when it was opened are read from the
+        // mapping; ones added since are kept in memory as well as appended
+        MappedFile file;
+        size_t mapped_count;
+
+        std::vector<uint64_t> added_keys;
+        std::vector<CacheEntry> added_entries;
+
+        // open-addressing table of record numbers plus one (0 marks an empty
+        // slot), holding the best record for each key
+        std::vector<uint32_t> slots;
+        size_t record_count;
+
+        // (appends go straight to the end of the file, so other processes
+        // can append to it at the same time)
+        int output;
+
+        // (shared between threads, such as the monitor's worker and the
+        // hinter, so every access is locked; the file is appended to under a
+        // lock of its own, so a slow disk never holds up lookups)
+        mutable std::mutex mutex;
+        mutable std::mutex output_mutex;
+
+        uint64_t record_key(size_t record) const;
+        CacheEntry record_entry(size_t record) const;
+
+        void index(size_t record);
+
+        public:
+            SolverCache();
+            ~SolverCache();
+
+            // the file can only be appended to by one cache at a time
+            SolverCache(const SolverCache &) = delete;
+            SolverCache &operator=(const SolverCache &) = delete;
+
+            bool open(const std::string &path);
+            void close();
+
+            bool is_open() const;
+            size_t get_entry_count() const;
+
+            bool lookup(
+                const engine::State &state, const engine::Rules &rules,
+                size_t node_limit, CacheEntry &entry
+            ) const;
+            bool add(
+                const engine::State &state, const engine::Rules &rules,
+                size_t node_limit, const solver::Result &result
+            );
+
+            static uint64_t key(
+                const engine::State &state, const engine::Rules &rules
+            );
+    };
+#endif
@@ -0,0 +1,278 @@
+/* klondike/stats.cpp
+ * by python-b5
+ *
+ * A log of every game played, for working out statistics like win rates and
+ * streaks (see tools/stats.cpp).
+ *
+ * A statistics log starts with "KLST", a version byte and 3 reserved bytes,
+ * and is followed by 16-byte records, one per game, in the order the games
+ * ended (all values are little-endian):
+ *   - when the game ended, in seconds since the epoch (4 bytes)
+ *   - the deal number (4 bytes)
+ *   - how long it was played for, in milliseconds (4 bytes)
+ *   - the number of moves made (2 bytes)
+ *   - the rules: the draw count in the low 4 bits, and the pass limit in the
+ *     high 4 bits
+ *   - flags: bit 0 is set if the game was won
+ *
+ * Records are fixed-size and only ever appended, so a log can be scanned
+ * straight from a mapping, and one cut short by a crash only loses its last,
+ * incomplete record (which is cut off the next time it is opened).
+ */
+
+
+// project includes
+#include "stats.hpp"
+#include "engine.hpp"
+
+// standard libraries
+#include <mutex>
+#include <string>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstring>
+
+// POSIX libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+// using declarations
+using namespace stats;
+
+
+// constants
+const uint8_t MAGIC[4] = {'K', 'L', 'S', 'T'};
+
+const uint8_t WON_FLAG = 1;
+
+
+/* helper functions */
+
+/* Reads a little-endian value of a given number of bytes. */
+static uint32_t read_bytes(const uint8_t *bytes, int count) {
+    uint32_t value = 0;
+
+    for (int i = count - 1; i >= 0; --i) {
+        value = value << 8 | bytes[i];
+    }
+
+    return value;
+}
+
+/* Writes a little-endian value of a given number of bytes. */
+static void write_bytes(uint8_t *bytes, uint32_t value, int count) {
+    for (int i = 0; i < count; ++i) {
+        bytes[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+
+/* Log implementation:
+ * An append-only file of game results, written on a background thread.
+ */
+
+Log::Log():
+    output(-1),
+    queue_start(0),
+    queue_size(0),
+    stopping(false)
+{}
+
+Log::~Log() {
+    close();
+}
+
+/* Opens a statistics log for appending, creating it if it doesn't exist,
+ * and cutting off anything left partly written by a crash.
+ * Returns whether it was successful; if not, nothing is logged.
+ */
+bool Log::open(const std::string &path) {
+    close();
+
+    output = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+
+    if (output < 0) {
+        return false;
+    }
+
+    struct stat info;
+    uint8_t header[HEADER_SIZE] = {};
+
+    bool failed = fstat(output, &info) != 0;
+
+    if (!failed && static_cast<size_t>(info.st_size) < HEADER_SIZE) {
+        // (a file too short to hold a header never got any records written
+        // to it, so it can just be started over)
+        std::memcpy(header, MAGIC, 4);
+        header[4] = VERSION;
+
+        failed = ftruncate(output, 0) != 0
+                 || write(output, header, HEADER_SIZE)
+                    != static_cast<ssize_t>(HEADER_SIZE);
+    } else if (!failed) {
+        // check the header, and cut off any incomplete record
+        size_t end = HEADER_SIZE + (info.st_size - HEADER_SIZE)
+                                   / RECORD_SIZE * RECORD_SIZE;
+
+        failed = pread(output, header, HEADER_SIZE, 0)
+                 != static_cast<ssize_t>(HEADER_SIZE)
+                 || std::memcmp(header, MAGIC, 4) != 0
+                 || header[4] != VERSION
+                 || (
+                     end != static_cast<size_t>(info.st_size)
+                     && ftruncate(output, end) != 0
+                 );
+    }
+
+    if (failed) {
+        ::close(output);
+        output = -1;
+
+        return false;
+    }
+
+    queue_start = 0;
+    queue_size = 0;
+    stopping = false;
+
+    writer = std::thread(&Log::run, this);
+
+    return true;
+}
+
+/* Closes the log, if one is open, after writing every result added. */
+void Log::close() {
+    if (writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        wake.notify_one();
+        writer.join();
+    }
+
+    if (output >= 0) {
+        ::close(output);
+        output = -1;
+    }
+}
+
+/* Checks if a log is open. */
+bool Log::is_open() const {
+    return output >= 0;
+}
+
+/* Queues a game's result to be written.
+ * Returns whether it was queued (it isn't if no log is open, or the writer
+ * has fallen too far behind).
+ */
+bool Log::add(const GameResult &result) {
+    if (!writer.joinable()) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (queue_size == QUEUE_SIZE) {
+            return false;
+        }
+
+        queue[(queue_start + queue_size) % QUEUE_SIZE] = result;
+        ++queue_size;
+    }
+
+    wake.notify_one();
+
+    return true;
+}
+
+/* The writer thread's loop: writes queued results in order until stopped
+ * with nothing left to write.
+ */
+void Log::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    bool failed = false;
+
+    while (true) {
+        wake.wait(lock, [this] { return stopping || queue_size != 0; });
+
+        if (queue_size == 0) {
+            break;
+        }
+
+        uint8_t record[RECORD_SIZE];
+        encode(queue[queue_start], record);
+
+        queue_start = (queue_start + 1) % QUEUE_SIZE;
+        --queue_size;
+
+        lock.unlock();
+
+        // a record that doesn't get written in full would make every one
+        // after it unreadable, so nothing more is written after a failure
+        // (each record goes in one write, which O_APPEND keeps in one piece)
+        failed = failed
+                 || write(output, record, RECORD_SIZE)
+                    != static_cast<ssize_t>(RECORD_SIZE);
+
+        lock.lock();
+    }
+}
+
+
+/* functions */
+
+/* Packs a result into a record. */
+void stats::encode(const GameResult &result, uint8_t *record) {
+    write_bytes(record, result.finished_at, 4);
+    write_bytes(record + 4, result.deal_number, 4);
+    write_bytes(record + 8, result.duration, 4);
+    write_bytes(record + 12, result.moves, 2);
+
+    record[14] = (result.rules.draw_count & 0xF)
+                 | (result.rules.pass_limit & 0xF) << 4;
+    record[15] = result.won ? WON_FLAG : 0;
+}
+
+/* Unpacks a record. */
+GameResult stats::decode(const uint8_t *record) {
+    GameResult result;
+
+    result.finished_at = read_bytes(record, 4);
+    result.deal_number = read_bytes(record + 4, 4);
+    result.duration = read_bytes(record + 8, 4);
+    result.moves = read_bytes(record + 12, 2);
+
+    result.rules.draw_count = record[14] & 0xF;
+    result.rules.pass_limit = record[14] >> 4;
+    result.won = (record[15] & WON_FLAG) != 0;
+
+    return result;
+}
+
+/* Checks a log's header, and counts its complete records (which start at
+ * HEADER_SIZE).
+ * Returns whether it is a statistics log.
+ */
+bool stats::count_records(
+    const uint8_t *data, size_t size, size_t &record_count
+) {
+    if (
+        size < HEADER_SIZE || std::memcmp(data, MAGIC, 4) != 0
+        || data[4] != VERSION
+    ) {
+        return false;
+    }
+
+    record_count = (size - HEADER_SIZE) / RECORD_SIZE;
+
+    return true;
+}
@@ -0,0 +1,93 @@
+/* klondike/stats.hpp
+ * by python-b5
+ *
+ * A log of every game played, for working out statistics like win rates and
+ * streaks (see tools/stats.cpp).
+ */
+
+
+// project includes
+#include "engine.hpp"
+
+// standard libraries
+#include <mutex>
+#include <string>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef STATS
+    #define STATS
+
+    namespace stats {
+        // constants
+        const uint8_t VERSION = 1;
+        const size_t HEADER_SIZE = 8;
+        const size_t RECORD_SIZE = 16;
+
+
+        /* How a game went: when it ended (in seconds since the epoch), how
+         * long it was played for (in milliseconds), how many moves were made
+         * (capped at 65535), and whether it was won. Games that weren't won
+         * were abandoned for a new deal.
+         */
+        struct GameResult {
+            uint32_t finished_at;
+            uint32_t deal_number;
+            engine::Rules rules;
+
+            uint32_t duration;
+            uint16_t moves;
+            bool won;
+        };
+
+        /* Appends results to a statistics log. Results are handed to a
+         * writer thread, so adding one never waits for the disk.
+         */
+        class Log {
+            int output;
+
+            // results waiting to be written, only touched while the mutex is
+            // locked (if the writer falls this far behind, results are
+            // dropped rather than waited for)
+            static const size_t QUEUE_SIZE = 64;
+
+            std::mutex mutex;
+            std::condition_variable wake;
+
+            GameResult queue[QUEUE_SIZE];
+            size_t queue_start;
+            size_t queue_size;
+
+            bool stopping;
+            std::thread writer;
+
+            void run();
+
+            public:
+                Log();
+                ~Log();
+
+                Log(const Log &) = delete;
+                Log &operator=(const Log &) = delete;
+
+                bool open(const std::string &path);
+                void close();
+
+                bool is_open() const;
+
+                bool add(const GameResult &result);
+        };
+
+
+        // functions
+        void encode(const GameResult &result, uint8_t *record);
+        GameResult decode(const uint8_t *record);
+
+        bool count_records(
+            const uint8_t *data, size_t size, size_t &record_count
+        );
+    }
+#endif
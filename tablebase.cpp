@@ -0,0 +1,452 @@
+/* klondike/tablebase.cpp
+ * by python-b5
+ *
+ * A precomputed table of endgames, giving whether each can be won and how
+ * quickly.
+ *
+ * An endgame is a position with nothing left in the stock or waste and only a
+ * few face-down cards. The rules no longer make a difference by then, and
+ * every position reachable from one is an endgame too, so each one can be
+ * worked out completely (see tools/build_tablebase.cpp).
+ *
+ * Endgames are only played out without taking cards back off the
+ * foundations (which would make far too many positions reachable), so
+ * entries that say an endgame can't be won only mean it can't be won that
+ * way. Winning entries can always be trusted, though, and are the quickest
+ * wins that don't take cards back.
+ *
+ * Layout (all values are little-endian):
+ *   - a 64-byte header: "KLTB", a version byte, the most face-down cards an
+ *     endgame can have, two reserved bytes, then the number of entries (4
+ *     bytes), padded with zeroes
+ *   - a directory of 65537 4-byte indexes: the first entry whose key starts
+ *     with each possible 16 bits, then the number of entries
+ *   - padding up to a multiple of 8 bytes
+ *   - the entries (8 bytes each), sorted: a position's key with its low byte
+ *     replaced by the number of moves until it is solved out, or 255 if it
+ *     can't be won
+ *
+ * Looking a position up only reads its bucket in the directory and a binary
+ * search's worth of entries, so the table is used straight from the mapping.
+ * (As with the deal index, this assumes a little-endian machine.)
+ */
+
+
+// project includes
+#include "tablebase.hpp"
+#include "engine.hpp"
+#include "solver.hpp"
+#include "mapped_file.hpp"
+
+// standard libraries
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstring>
+
+
+// using declarations
+using namespace engine;
+
+
+// constants
+const uint8_t MAGIC[4] = {'K', 'L', 'T', 'B'};
+const uint8_t VERSION = 1;
+const size_t HEADER_SIZE = 64;
+
+const int BUCKET_BITS = 16;
+const size_t DIRECTORY_SIZE = (static_cast<size_t>(1) << BUCKET_BITS) + 1;
+const size_t ENTRIES_START = (HEADER_SIZE + 4 * DIRECTORY_SIZE + 7)
+                             & ~static_cast<size_t>(7);
+
+const uint8_t LOSS_VALUE = 255;
+
+
+/* helper functions */
+
+/* Reads a 4-byte value from a buffer. */
+static uint32_t read_u32(const uint8_t *buffer) {
+    return buffer[0] | buffer[1] << 8 | buffer[2] << 16
+           | static_cast<uint32_t>(buffer[3]) << 24;
+}
+
+/* Appends a 4-byte value to a buffer. */
+static void write_u32(std::vector<uint8_t> &buffer, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        buffer.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+/* Appends an 8-byte value to a buffer. */
+static void write_u64(std::vector<uint8_t> &buffer, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        buffer.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+
+/* Tablebase implementation:
+ * A memory-mapped endgame table.
+ */
+
+Tablebase::Tablebase():
+    max_face_down(-1),
+    directory(NULL),
+    entries(NULL),
+    entry_count(0)
+{}
+
+/* Opens a tablebase, checking that it is well-formed.
+ * Returns whether it was successful.
+ */
+bool Tablebase::open(const std::string &path) {
+    close();
+
+    if (!file.open(path) || file.get_size() < ENTRIES_START) {
+        close();
+        return false;
+    }
+
+    const uint8_t *data = file.get_data();
+
+    if (std::memcmp(data, MAGIC, 4) != 0 || data[4] != VERSION) {
+        close();
+        return false;
+    }
+
+    uint32_t count = read_u32(data + 8);
+
+    if (file.get_size() != ENTRIES_START + 8 * static_cast<size_t>(count)) {
+        close();
+        return false;
+    }
+
+    // every bucket has to lie within the entries, so lookups never read
+    // past them (the directory is checked once here, rather than on every
+    // lookup)
+    const uint8_t *table = data + HEADER_SIZE;
+    uint32_t last = 0;
+
+    for (size_t bucket = 0; bucket < DIRECTORY_SIZE; ++bucket) {
+        uint32_t first = read_u32(table + 4 * bucket);
+
+        if (first < last || first > count) {
+            close();
+            return false;
+        }
+
+        last = first;
+    }
+
+    if (last != count) {
+        close();
+        return false;
+    }
+
+    max_face_down = data[5];
+    directory = table;
+
+    // (the entries start on a boundary of their size, and mappings start on
+    // a page boundary, so they can be read directly)
+    entries = reinterpret_cast<const uint64_t *>(data + ENTRIES_START);
+    entry_count = count;
+
+    return true;
+}
+
+/* Closes the tablebase, if one is open. */
+void Tablebase::close() {
+    file.close();
+
+    max_face_down = -1;
+    directory = NULL;
+    entries = NULL;
+    entry_count = 0;
+}
+
+/* Checks if a tablebase is open. */
+bool Tablebase::is_open() const {
+    return entries != NULL;
+}
+
+/* Returns the most face-down cards an endgame in the table can have (or -1
+ * if no tablebase is open).
+ */
+int Tablebase::get_max_face_down() const {
+    return max_face_down;
+}
+
+/* Returns the number of positions in the table. */
+uint32_t Tablebase::get_entry_count() const {
+    return entry_count;
+}
+
+/* Checks if a position is the kind the table holds. (It still might not be
+ * in the table, if it was never reached while building it.)
+ */
+bool Tablebase::covers(const State &state) const {
+    return is_endgame(state, max_face_down);
+}
+
+/* Looks up a position, getting the number of moves until it is solved out, or
+ * LOSS if it can't be won (without taking cards back off the foundations).
+ * Returns whether it was in the table.
+ */
+bool Tablebase::lookup(const State &state, int &distance) const {
+    if (!covers(state)) {
+        return false;
+    }
+
+    uint64_t wanted = key(state) >> 8;
+    size_t bucket = wanted >> (56 - BUCKET_BITS);
+
+    // binary search the key's bucket
+    uint32_t low = read_u32(directory + 4 * bucket);
+    uint32_t high = read_u32(directory + 4 * (bucket + 1));
+
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        uint64_t found = entries[middle] >> 8;
+
+        if (found < wanted) {
+            low = middle + 1;
+        } else if (found > wanted) {
+            high = middle;
+        } else {
+            uint8_t value = entries[middle] & 0xFF;
+            distance = value == LOSS_VALUE ? LOSS : value;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Finds the line of moves (see expand()) that gets a position solved out the
+ * quickest, if it is a winnable endgame in the table.
+ * Returns the number of moves in it (0 if there isn't one).
+ */
+int Tablebase::best_line(const State &state, Move *line) const {
+    int distance;
+
+    if (!lookup(state, distance) || distance == LOSS) {
+        return 0;
+    }
+
+    int best = 0;
+
+    expand(state, [&](const State &next, const Move *moves, int length) {
+        int next_distance = 0;
+
+        if (
+            best == 0 && (
+                solver::solved_out(next) || lookup(next, next_distance)
+            )
+            && next_distance == distance - length
+        ) {
+            std::copy(moves, moves + length, line);
+            best = length;
+        }
+    });
+
+    return best;
+}
+
+/* Plays a winnable endgame in the table until it is solved out, the quickest
+ * way possible, adding the moves to a path.
+ * Returns whether it was successful (if not, the position and path are left
+ * partway through).
+ */
+bool Tablebase::play_out(State &state, std::vector<Move> &path) const {
+    Move line[MAX_LINE];
+
+    while (!solver::solved_out(state)) {
+        int length = best_line(state, line);
+
+        if (length == 0) {
+            return false;
+        }
+
+        for (int i = 0; i < length; ++i) {
+            apply(state, line[i]);
+            path.push_back(line[i]);
+        }
+    }
+
+    return true;
+}
+
+/* Checks if a position is an endgame with at most a given number of face-down
+ * cards.
+ */
+bool Tablebase::is_endgame(const State &state, int max_face_down) {
+    if (state.stock_size != 0 || state.waste_size != 0) {
+        return false;
+    }
+
+    int face_down = 0;
+
+    for (const Pile &pile : state.tableau) {
+        face_down += pile.face_down;
+    }
+
+    return face_down <= max_face_down;
+}
+
+/* Finds the stack a move from the tableau leaves a face-up card, or nothing
+ * at all, uncovered on, which expand() then makes sure gets used.
+ * Returns -1 if there isn't one.
+ */
+int Tablebase::pending_pile(const State &state, const Move &move) {
+    if (move.type != TABLEAU_TO_TABLEAU) {
+        return -1;
+    }
+
+    const Pile &from = state.tableau[move.from];
+    int start = from.size - move.count;
+
+    // (uncovering a face-down card gets it flipped straight away)
+    return start != from.face_down || start == 0 ? move.from : -1;
+}
+
+/* Checks if a move uses what was left uncovered on a stack: the card on top
+ * of it, or the space if it is empty.
+ */
+bool Tablebase::uses_pile(const Move &move, int pile) {
+    switch (move.type) {
+        case TABLEAU_TO_FOUNDATION:
+            return move.from == pile;
+
+        case TABLEAU_TO_TABLEAU:
+            return move.from == pile || move.to == pile;
+
+        default:
+            return false;
+    }
+}
+
+/* Returns the key a position is stored under. This is the hash of the
+ * position with its stacks and foundations sorted, since which is which
+ * doesn't matter, and ignoring how many cards were taken from the stock and
+ * how many passes were made, since they no longer matter either.
+ */
+uint64_t Tablebase::key(const State &state) {
+    State copy = state;
+
+    std::sort(
+        copy.tableau, copy.tableau + 7,
+        [](const Pile &a, const Pile &b) {
+            if (a.size != b.size) {
+                return a.size < b.size;
+            }
+
+            if (a.face_down != b.face_down) {
+                return a.face_down < b.face_down;
+            }
+
+            return std::lexicographical_compare(
+                a.cards, a.cards + a.size, b.cards, b.cards + b.size
+            );
+        }
+    );
+
+    // (empty foundations go last, since their suits don't mean anything)
+    std::sort(
+        copy.foundations, copy.foundations + 4,
+        [](const Foundation &a, const Foundation &b) {
+            if ((a.next == 0) != (b.next == 0)) {
+                return b.next == 0;
+            }
+
+            return a.next != 0 && a.suit < b.suit;
+        }
+    );
+
+    copy.taken = 0;
+    copy.passes = 0;
+
+    return hash(copy);
+}
+
+/* Packs a key and a distance (or LOSS) into an entry. */
+uint64_t Tablebase::make_entry(uint64_t key, int distance) {
+    uint8_t value = distance == LOSS ? LOSS_VALUE : distance;
+
+    return (key & ~static_cast<uint64_t>(0xFF)) | value;
+}
+
+/* Writes a tablebase holding the given entries, which are sorted (and have
+ * duplicate keys removed) in place.
+ * Returns whether it was successful.
+ */
+bool Tablebase::write(
+    const std::string &path, int max_face_down, std::vector<uint64_t> &entries
+) {
+    std::sort(entries.begin(), entries.end());
+    entries.erase(
+        std::unique(
+            entries.begin(), entries.end(),
+            [](uint64_t a, uint64_t b) { return a >> 8 == b >> 8; }
+        ),
+        entries.end()
+    );
+
+    uint32_t count = entries.size();
+
+    // header
+    std::vector<uint8_t> buffer(MAGIC, MAGIC + 4);
+
+    buffer.push_back(VERSION);
+    buffer.push_back(max_face_down);
+    buffer.resize(8, 0);
+
+    write_u32(buffer, count);
+
+    buffer.resize(HEADER_SIZE, 0);
+
+    // directory
+    uint32_t next = 0;
+
+    for (size_t bucket = 0; bucket < DIRECTORY_SIZE; ++bucket) {
+        while (next < count && (entries[next] >> (64 - BUCKET_BITS)) < bucket) {
+            ++next;
+        }
+
+        write_u32(buffer, next);
+    }
+
+    buffer.resize(ENTRIES_START, 0);
+
+    // entries
+    buffer.reserve(ENTRIES_START + 8 * static_cast<size_t>(count));
+
+    for (uint64_t entry : entries) {
+        write_u64(buffer, entry);
+    }
+
+    // write to a temporary file first, so a half-written table is never left
+    // behind
+    std::string temp_path = path + ".tmp";
+    std::FILE *output = std::fopen(temp_path.c_str(), "wb");
+
+    if (output == NULL) {
+        return false;
+    }
+
+    bool success = std::fwrite(buffer.data(), 1, buffer.size(), output)
+                   == buffer.size();
+    success = (std::fclose(output) == 0) && success;
+
+    if (!success) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+
+    return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,150 @@
+/* klondike/tablebase.hpp
+ * by python-b5
+ *
+ * A precomputed table of endgames, giving whether each can be won and how
+ * quickly.
+ */
+
+
+// project includes
+#include "engine.hpp"
+#include "solver.hpp"
+#include "mapped_file.hpp"
+
+// standard libraries
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+#ifndef TABLEBASE
+    #define TABLEBASE
+
+    class Tablebase {
+        MappedFile file;
+        int max_face_down;
+
+        // the first entry in each bucket (with one more at the end, as 4-byte
+        // little-endian values), and the entries themselves, sorted by key
+        const uint8_t *directory;
+        const uint64_t *entries;
+        uint32_t entry_count;
+
+        static bool uses_pile(const engine::Move &move, int pile);
+
+        template <typename Function>
+        static void extend(
+            engine::State &state, engine::Move *line, int length,
+            Function &function
+        );
+
+        public:
+            // (an endgame that can't be won without taking cards back off
+            // the foundations; otherwise, entries hold the number of moves
+            // until the game is solved out)
+            static const int LOSS = -1;
+            static const int MAX_DISTANCE = 254;
+
+            // (the most moves that are made together as one line; see
+            // expand())
+            static const int MAX_LINE = 2;
+
+            Tablebase();
+
+            bool open(const std::string &path);
+            void close();
+
+            bool is_open() const;
+            int get_max_face_down() const;
+            uint32_t get_entry_count() const;
+
+            bool covers(const engine::State &state) const;
+            bool lookup(const engine::State &state, int &distance) const;
+
+            int best_line(const engine::State &state, engine::Move *line)
+                const;
+            bool play_out(
+                engine::State &state, std::vector<engine::Move> &path
+            ) const;
+
+            static bool is_endgame(
+                const engine::State &state, int max_face_down
+            );
+            static int pending_pile(
+                const engine::State &state, const engine::Move &move
+            );
+
+            template <typename Function>
+            static void expand(const engine::State &state, Function function);
+
+            static uint64_t key(const engine::State &state);
+            static uint64_t make_entry(uint64_t key, int distance);
+
+            static bool write(
+                const std::string &path, int max_face_down,
+                std::vector<uint64_t> &entries
+            );
+    };
+
+
+    /* Calls a function with each line of moves worth making in an endgame,
+     * as (the position it leads to, the moves, the number of moves).
+     *
+     * The moves are the ones the solver considers, except that cards are
+     * never taken back off the foundations, and moving cards off a face-up
+     * card (or off a whole stack) is only worth it if that card (or the
+     * empty stack) is then used. Since that move can always wait until
+     * right before then, it is only made together with the move that uses
+     * it, which keeps the number of positions reachable from an endgame
+     * down a lot.
+     */
+    template <typename Function>
+    void Tablebase::expand(const engine::State &state, Function function) {
+        engine::State copy = state;
+
+        // (no draws are legal in an endgame, so the rules don't matter)
+        solver::Candidate candidates[solver::MAX_CANDIDATES];
+        int count = solver::find_candidates<engine::DrawThree>(
+            copy, candidates
+        );
+
+        engine::Move line[MAX_LINE];
+
+        for (int i = 0; i < count; ++i) {
+            if (candidates[i].move.type != engine::FOUNDATION_TO_TABLEAU) {
+                line[0] = candidates[i].move;
+                extend(copy, line, 1, function);
+            }
+        }
+    }
+
+    /* Makes the last move of a line for expand(), then either finishes the
+     * line or extends it with each move that uses what the move left
+     * waiting. The position is restored before returning.
+     */
+    template <typename Function>
+    void Tablebase::extend(
+        engine::State &state, engine::Move *line, int length,
+        Function &function
+    ) {
+        int pile = pending_pile(state, line[length - 1]);
+        engine::Undo undo = engine::apply(state, line[length - 1]);
+
+        if (pile < 0 || length == MAX_LINE) {
+            function(static_cast<const engine::State &>(state), line, length);
+        } else {
+            engine::Move moves[engine::MAX_MOVES];
+            int count = engine::legal_moves(state, moves);
+
+            for (int i = 0; i < count; ++i) {
+                if (uses_pile(moves[i], pile)) {
+                    line[length] = moves[i];
+                    extend(state, line, length + 1, function);
+                }
+            }
+        }
+
+        engine::revert(state, undo);
+    }
+#endif
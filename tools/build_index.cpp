@@ -0,0 +1,238 @@
+/* klondike/tools/build_index.cpp
+ * by python-b5
+ *
+ * Solves a contiguous range of deals and writes the results to a deal index,
+ * which the game can use to only deal winnable games (or games of a given
+ * difficulty). Deals are spread across all cores.
+ *
+ * Usage: build_index [-j threads] [-n node limit] [-r rules] [-t tablebase]
+ *                    [-c cache] first count output
+ *   -r  the rules to solve with: the draw count, optionally followed by a
+ *       slash and the pass limit (e.g. "1" or "3/3"; defaults to "3")
+ *   -t  an endgame tablebase to look endgames up in (see build_tablebase)
+ *   -c  a solver cache to reuse results from (and add new ones to), so
+ *       rebuilding an index doesn't search deals solved before
+ *
+ * Each thread's solver keeps its memory between deals, so the most any of
+ * them held is reported along with the process's peak resident size.
+ */
+
+
+// project includes
+#include "../engine.hpp"
+#include "../solver.hpp"
+#include "../deal_index.hpp"
+#include "../tablebase.hpp"
+#include "../solver_cache.hpp"
+
+// standard libraries
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// POSIX libraries
+#include <sys/resource.h>
+
+
+// constants
+const uint32_t BATCH_SIZE = 64;
+
+
+int main(int argc, char *argv[]) {
+    // parse arguments
+    unsigned int thread_count = std::thread::hardware_concurrency();
+    size_t node_limit = solver::DEFAULT_NODE_LIMIT;
+    engine::Rules rules = engine::DEFAULT_RULES;
+    const char *tablebase_path = NULL;
+    const char *cache_path = NULL;
+
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            node_limit = std::strtoull(argv[++i], NULL, 10);
+        } else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (!engine::parse_rules(argv[++i], rules)) {
+                std::fprintf(stderr, "unsupported rules\n");
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            tablebase_path = argv[++i];
+        } else if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cache_path = argv[++i];
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() != 3) {
+        std::fprintf(
+            stderr, "usage: %s [-j threads] [-n node limit] [-r rules] "
+                    "[-t tablebase] [-c cache] first count output\n",
+            argv[0]
+        );
+        return 1;
+    }
+
+    // (the table is only read, so every thread can share it)
+    Tablebase tablebase;
+
+    if (tablebase_path != NULL && !tablebase.open(tablebase_path)) {
+        std::fprintf(stderr, "couldn't open %s\n", tablebase_path);
+        return 1;
+    }
+
+    // (the cache locks itself, so every thread can share it too)
+    SolverCache cache;
+
+    if (cache_path != NULL && !cache.open(cache_path)) {
+        std::fprintf(stderr, "couldn't open %s\n", cache_path);
+        return 1;
+    }
+
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    uint32_t first_deal = std::strtoul(positional[0], NULL, 10);
+    uint32_t deal_count = std::strtoul(positional[1], NULL, 10);
+
+    // solve deals in batches, with each thread taking the next batch when it
+    // is done with its last one
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<DealInfo> deals(deal_count);
+
+    std::atomic<uint32_t> next_batch(0);
+    std::atomic<uint32_t> solved(0);
+    std::vector<size_t> peak_memory(thread_count);
+    std::vector<std::thread> threads;
+
+    for (unsigned int t = 0; t < thread_count; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            solver::Solver solver;
+            engine::State state;
+
+            if (tablebase.is_open()) {
+                solver.set_tablebase(&tablebase);
+            }
+
+            for (;;) {
+                uint64_t first = static_cast<uint64_t>(next_batch.fetch_add(1))
+                                 * BATCH_SIZE;
+
+                if (first >= deal_count) {
+                    break;
+                }
+
+                uint32_t last = std::min<uint64_t>(
+                    first + BATCH_SIZE, deal_count
+                );
+
+                for (uint32_t i = first; i < last; ++i) {
+                    engine::deal(state, first_deal + i);
+
+                    DealInfo &info = deals[i];
+                    CacheEntry entry;
+
+                    if (
+                        !cache.is_open()
+                        || !cache.lookup(state, rules, node_limit, entry)
+                    ) {
+                        solver::Result result = solver.solve(
+                            state, node_limit, NULL, rules
+                        );
+
+                        if (cache.is_open()) {
+                            cache.add(state, rules, node_limit, result);
+                        }
+
+                        entry.verdict = result.verdict;
+                        entry.nodes = std::min<size_t>(
+                            result.nodes, UINT32_MAX
+                        );
+                        entry.moves = std::min<size_t>(
+                            result.solution.size(), 255
+                        );
+                    }
+
+                    // (difficulty only goes by how many positions were
+                    // searched, so it comes out the same from the cache)
+                    solver::Result searched;
+                    searched.verdict = entry.verdict;
+                    searched.nodes = entry.nodes;
+
+                    info.verdict = entry.verdict;
+                    info.moves = entry.moves;
+                    info.difficulty = std::max(solver::difficulty(searched), 0);
+                }
+
+                uint32_t done = solved.fetch_add(last - first) + last - first;
+                std::fprintf(stderr, "\r%u/%u deals solved", done, deal_count);
+            }
+
+            peak_memory[t] = solver.get_peak_memory();
+        }));
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    std::fprintf(stderr, "\n");
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+
+    // count verdicts
+    size_t verdicts[3] = {0, 0, 0};
+
+    for (const DealInfo &info : deals) {
+        ++verdicts[info.verdict];
+    }
+
+    std::printf(
+        "%zu winnable, %zu unwinnable, %zu unknown in %.1f s\n",
+        verdicts[solver::WINNABLE], verdicts[solver::UNWINNABLE],
+        verdicts[solver::UNKNOWN], seconds
+    );
+
+    // report memory use
+    size_t total_memory = 0;
+
+    for (size_t memory : peak_memory) {
+        total_memory += memory;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    // (ru_maxrss is in kilobytes on Linux)
+    std::printf(
+        "solver memory: %.1f MiB peak per thread, %.1f MiB in total; "
+        "peak resident size %.1f MiB\n",
+        *std::max_element(peak_memory.begin(), peak_memory.end()) / 1048576.0,
+        total_memory / 1048576.0, usage.ru_maxrss / 1024.0
+    );
+
+    // write index
+    if (!DealIndex::write(positional[2], first_deal, deals, rules)) {
+        std::fprintf(stderr, "couldn't write %s\n", positional[2]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,488 @@
+/* klondike/tools/build_tablebase.cpp
+ * by python-b5
+ *
+ * Builds an endgame tablebase from the endgames reached while searching a
+ * range of deals. Deals are spread across all cores.
+ *
+ * Usage: build_tablebase [-j threads] [-f face-down] [-n node limit]
+ *                        [-g graph limit] first count output
+ *   -f  most face-down cards an endgame can have (defaults to 4)
+ *   -n  positions to search in each deal looking for endgames (defaults to
+ *       100000)
+ *   -g  most positions reachable from one endgame; endgames leading to more
+ *       are left out (defaults to 262144)
+ *
+ * Each endgame found is solved by retrograde analysis: every position
+ * reachable from it is listed (nothing new can come out of the stock, so
+ * there are only so many), then distances are worked backwards from the
+ * solved-out positions. Anything never reached that way can't be won.
+ */
+
+
+// project includes
+#include "../engine.hpp"
+#include "../solver.hpp"
+#include "../tablebase.hpp"
+
+// standard libraries
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+// using declarations
+using namespace engine;
+
+
+// constants
+const uint32_t BATCH_SIZE = 16;
+
+// (marks positions whose distance hasn't been worked out yet)
+const int UNSOLVED = -2;
+
+
+/* Finds and solves the endgames reachable from deals, for one thread. */
+class Builder {
+    int max_face_down;
+    size_t node_limit;
+    size_t graph_limit;
+
+    // positions searched in the current deal, and endgames already found
+    // to lead to too many positions
+    std::unordered_set<uint64_t> seen;
+    std::unordered_set<uint64_t> too_large;
+
+    // reused while solving an endgame: every position reachable from it,
+    // their keys and distances, and the lines of moves between them (as the
+    // positions each one leads to, and leads from, and how many moves each
+    // line takes)
+    std::vector<State> positions;
+    std::unordered_map<uint64_t, uint32_t> numbers;
+    std::vector<uint64_t> keys;
+    std::vector<int> distances;
+
+    std::vector<uint32_t> move_starts;
+    std::vector<uint32_t> moves;
+    std::vector<uint8_t> lengths;
+    std::vector<uint32_t> reverse_starts;
+    std::vector<uint32_t> reverse_moves;
+    std::vector<uint8_t> reverse_lengths;
+    std::vector<uint32_t> reverse_ends;
+
+    std::vector<std::vector<uint32_t>> frontiers;
+
+    bool add_position(const State &state, uint32_t &number);
+    void search(State &state, int depth);
+
+    public:
+        // every endgame position solved so far, and the distances found
+        std::unordered_map<uint64_t, int> solved;
+
+        size_t endgames;
+        size_t too_large_count;
+
+        Builder(int max_face_down_, size_t node_limit_, size_t graph_limit_);
+
+        void search_deal(uint32_t deal_number);
+        bool solve(const State &endgame);
+};
+
+Builder::Builder(int max_face_down_, size_t node_limit_, size_t graph_limit_):
+    max_face_down(max_face_down_),
+    node_limit(node_limit_),
+    graph_limit(graph_limit_),
+    endgames(0),
+    too_large_count(0)
+{}
+
+/* Searches a deal for endgames (with the default rules, though they stop
+ * mattering once an endgame is reached), solving each one found.
+ */
+void Builder::search_deal(uint32_t deal_number) {
+    State state;
+    deal(state, deal_number);
+
+    seen.clear();
+    search(state, 0);
+}
+
+/* Searches a position for endgames, the same way the solver would. The
+ * position is modified during the search but restored before returning.
+ */
+void Builder::search(State &state, int depth) {
+    if (solver::solved_out(state)) {
+        return;
+    }
+
+    // (endgames leading to too many positions are searched like any other
+    // position instead, in the hope of finding smaller ones further on)
+    if (Tablebase::is_endgame(state, max_face_down) && solve(state)) {
+        return;
+    }
+
+    if (
+        seen.size() >= node_limit || depth >= solver::MAX_DEPTH
+        || !seen.insert(hash(state)).second
+    ) {
+        return;
+    }
+
+    solver::Candidate candidates[solver::MAX_CANDIDATES];
+    int count = solver::find_candidates<DrawThree>(state, candidates);
+
+    for (int i = 0; i < count; ++i) {
+        Undo undos[solver::MAX_DRAWS + 1];
+        int draws = candidates[i].draws;
+
+        for (int draw = 0; draw < draws; ++draw) {
+            undos[draw] = apply(state, Move(DRAW));
+        }
+
+        undos[draws] = apply(state, candidates[i].move);
+
+        search(state, depth + 1);
+
+        for (int undo = draws; undo >= 0; --undo) {
+            revert(state, undos[undo]);
+        }
+    }
+}
+
+/* Numbers a position reachable from the endgame being solved, if it doesn't
+ * have a number yet. Positions that are solved out, or were already solved as
+ * part of another endgame, are given their distances straight away.
+ * Returns whether there was room for it.
+ */
+bool Builder::add_position(const State &state, uint32_t &number) {
+    uint64_t key = Tablebase::key(state);
+    auto found = numbers.find(key);
+
+    if (found != numbers.end()) {
+        number = found->second;
+        return true;
+    }
+
+    if (positions.size() >= graph_limit) {
+        return false;
+    }
+
+    number = positions.size();
+
+    positions.push_back(state);
+    numbers[key] = number;
+    keys.push_back(key);
+
+    auto known = solved.find(key);
+
+    if (solver::solved_out(state)) {
+        distances.push_back(0);
+    } else if (known != solved.end()) {
+        distances.push_back(known->second);
+    } else {
+        distances.push_back(UNSOLVED);
+    }
+
+    return true;
+}
+
+/* Solves an endgame and every position reachable from it, unless it was
+ * already solved.
+ * Returns false if too many positions are reachable from it.
+ */
+bool Builder::solve(const State &endgame) {
+    uint64_t key = Tablebase::key(endgame);
+
+    if (solved.count(key) != 0) {
+        return true;
+    }
+
+    if (too_large.count(key) != 0) {
+        return false;
+    }
+
+    positions.clear();
+    numbers.clear();
+    keys.clear();
+    distances.clear();
+    move_starts.clear();
+    moves.clear();
+    lengths.clear();
+
+    uint32_t number;
+    add_position(endgame, number);
+
+    // list every reachable position, and the lines of moves between them
+    // (positions with a distance already are never gone past)
+    for (size_t i = 0; i < positions.size(); ++i) {
+        move_starts.push_back(moves.size());
+
+        if (distances[i] != UNSOLVED) {
+            continue;
+        }
+
+        bool room = true;
+
+        Tablebase::expand(
+            positions[i],
+            [&](const State &next, const Move *, int length) {
+                if (room && !add_position(next, number)) {
+                    room = false;
+                }
+
+                if (room) {
+                    moves.push_back(number);
+                    lengths.push_back(length);
+                }
+            }
+        );
+
+        // (none of the positions listed so far are tried again, since they
+        // would likely lead to too many positions as well)
+        if (!room) {
+            too_large.insert(keys.begin(), keys.end());
+            ++too_large_count;
+            return false;
+        }
+    }
+
+    size_t position_count = positions.size();
+    move_starts.push_back(moves.size());
+
+    // list the moves the other way around, so distances can be worked
+    // backwards
+    reverse_starts.assign(position_count + 1, 0);
+    reverse_moves.resize(moves.size());
+    reverse_lengths.resize(moves.size());
+
+    for (uint32_t to : moves) {
+        ++reverse_starts[to + 1];
+    }
+
+    for (size_t i = 0; i < position_count; ++i) {
+        reverse_starts[i + 1] += reverse_starts[i];
+    }
+
+    reverse_ends.assign(reverse_starts.begin(), reverse_starts.end() - 1);
+
+    for (uint32_t from = 0; from < position_count; ++from) {
+        for (uint32_t j = move_starts[from]; j < move_starts[from + 1]; ++j) {
+            uint32_t k = reverse_ends[moves[j]]++;
+
+            reverse_moves[k] = from;
+            reverse_lengths[k] = lengths[j];
+        }
+    }
+
+    // work distances backwards from positions that already have them, in
+    // order of distance, so each position is reached the quickest way first
+    for (std::vector<uint32_t> &frontier : frontiers) {
+        frontier.clear();
+    }
+
+    for (uint32_t i = 0; i < position_count; ++i) {
+        if (distances[i] >= 0) {
+            if (frontiers.size() <= static_cast<size_t>(distances[i])) {
+                frontiers.resize(distances[i] + 1);
+            }
+
+            frontiers[distances[i]].push_back(i);
+        }
+    }
+
+    for (size_t distance = 0; distance < frontiers.size(); ++distance) {
+        for (size_t j = 0; j < frontiers[distance].size(); ++j) {
+            uint32_t to = frontiers[distance][j];
+
+            // (skipping positions since found to be closer)
+            if (distances[to] != static_cast<int>(distance)) {
+                continue;
+            }
+
+            for (
+                uint32_t k = reverse_starts[to]; k < reverse_starts[to + 1];
+                ++k
+            ) {
+                uint32_t from = reverse_moves[k];
+                size_t from_distance = distance + reverse_lengths[k];
+
+                // (lines can be longer than one move, so a position might
+                // already be waiting further away)
+                if (
+                    distances[from] == UNSOLVED
+                    || distances[from] > static_cast<int>(from_distance)
+                ) {
+                    distances[from] = from_distance;
+
+                    if (frontiers.size() <= from_distance) {
+                        frontiers.resize(from_distance + 1);
+                    }
+
+                    frontiers[from_distance].push_back(from);
+                }
+            }
+        }
+    }
+
+    // anything left can't reach a solved-out position at all
+    for (uint32_t i = 0; i < position_count; ++i) {
+        if (distances[i] == UNSOLVED) {
+            distances[i] = Tablebase::LOSS;
+        }
+
+        if (!solver::solved_out(positions[i])) {
+            solved[keys[i]] = distances[i];
+        }
+    }
+
+    ++endgames;
+
+    return true;
+}
+
+
+int main(int argc, char *argv[]) {
+    // parse arguments
+    unsigned int thread_count = std::thread::hardware_concurrency();
+    int max_face_down = 4;
+    size_t node_limit = 100000;
+    size_t graph_limit = 262144;
+
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            max_face_down = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            node_limit = std::strtoull(argv[++i], NULL, 10);
+        } else if (std::strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            graph_limit = std::strtoull(argv[++i], NULL, 10);
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() != 3) {
+        std::fprintf(
+            stderr, "usage: %s [-j threads] [-f face-down] [-n node limit] "
+                    "[-g graph limit] first count output\n",
+            argv[0]
+        );
+        return 1;
+    }
+
+    if (max_face_down < 0 || max_face_down > 21) {
+        std::fprintf(stderr, "face-down limit must be from 0 to 21\n");
+        return 1;
+    }
+
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    uint32_t first_deal = std::strtoul(positional[0], NULL, 10);
+    uint32_t deal_count = std::strtoul(positional[1], NULL, 10);
+
+    // search deals in batches, with each thread taking the next batch when it
+    // is done with its last one
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Builder> builders(
+        thread_count, Builder(max_face_down, node_limit, graph_limit)
+    );
+
+    std::atomic<uint32_t> next_batch(0);
+    std::atomic<uint32_t> searched(0);
+    std::vector<std::thread> threads;
+
+    for (unsigned int t = 0; t < thread_count; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            Builder &builder = builders[t];
+
+            for (;;) {
+                uint64_t first = static_cast<uint64_t>(next_batch.fetch_add(1))
+                                 * BATCH_SIZE;
+
+                if (first >= deal_count) {
+                    break;
+                }
+
+                uint32_t last = std::min<uint64_t>(
+                    first + BATCH_SIZE, deal_count
+                );
+
+                for (uint32_t i = first; i < last; ++i) {
+                    builder.search_deal(first_deal + i);
+                }
+
+                uint32_t done = searched.fetch_add(last - first) + last - first;
+                std::fprintf(stderr, "\r%u/%u deals searched", done, deal_count);
+            }
+        }));
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    std::fprintf(stderr, "\n");
+
+    // collect every thread's results (positions solved by more than one
+    // thread are only kept once)
+    std::vector<uint64_t> entries;
+    size_t endgames = 0;
+    size_t too_large = 0;
+    size_t too_far = 0;
+
+    for (const Builder &builder : builders) {
+        endgames += builder.endgames;
+        too_large += builder.too_large_count;
+
+        for (const auto &position : builder.solved) {
+            if (position.second > Tablebase::MAX_DISTANCE) {
+                ++too_far;
+                continue;
+            }
+
+            entries.push_back(
+                Tablebase::make_entry(position.first, position.second)
+            );
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+
+    if (!Tablebase::write(positional[2], max_face_down, entries)) {
+        std::fprintf(stderr, "couldn't write %s\n", positional[2]);
+        return 1;
+    }
+
+    size_t losses = 0;
+
+    for (uint64_t entry : entries) {
+        losses += (entry & 0xFF) == 0xFF;
+    }
+
+    std::printf(
+        "%zu endgames solved (%zu too large); %zu positions, %zu unwinnable "
+        "(%zu too far from winning to store) in %.1f s\n",
+        endgames, too_large, entries.size(), losses, too_far, seconds
+    );
+
+    return 0;
+}
@@ -0,0 +1,1027 @@
+/* klondike/tools/farm.cpp
+ * by python-b5
+ *
+ * Solves a range of deals too big for one run (or one machine) by splitting
+ * it into smaller ranges and handing them out to any number of worker
+ * processes, then optionally gathers the results into a deal index.
+ *
+ * Usage: farm coordinate [-r rules] [-n node limit] [-s range size]
+ *                        [-l lease] [-o output] directory first count
+ *        farm work [-j threads] [-t tablebase] [-c cache] [-w wait] directory
+ *   -r  the rules to solve with: the draw count, optionally followed by a
+ *       slash and the pass limit (e.g. "1" or "3/3"; defaults to "3")
+ *   -n  node limit for each deal (defaults to the solver's)
+ *   -s  deals in each range handed out (defaults to 4096)
+ *   -l  seconds a worker can go without sending anything before its range
+ *       is handed to another (defaults to 300)
+ *   -o  deal index to write once every range is solved
+ *   -j  number of threads each worker uses (defaults to one per core)
+ *   -t  an endgame tablebase to look endgames up in (see build_tablebase)
+ *   -c  a solver cache to reuse results from (which workers can share)
+ *   -w  seconds a worker keeps trying to reach the coordinator before giving
+ *       up (defaults to 60)
+ *
+ * The coordinator and its workers talk over a Unix socket in the directory,
+ * one line of text per message:
+ *   coordinator: JOB <draw count> <pass limit> <node limit>  (on connecting)
+ *   worker:      GET
+ *   coordinator: RANGE <range> <first deal> <count> | WAIT | DONE
+ *   worker:      RESULT <deal> <verdict> <moves> <difficulty>  (per deal)
+ *   worker:      FINISHED <range>
+ *
+ * Each finished range is saved to its own file in the directory (written to
+ * a temporary file first, then renamed), so the coordinator can be stopped
+ * and restarted at any time without losing more than the ranges in
+ * progress. A range is handed out again if its worker disconnects or goes
+ * quiet for too long, and workers reconnect if the coordinator goes away, so
+ * either side can be killed and restarted freely.
+ */
+
+
+// project includes
+#include "../engine.hpp"
+#include "../solver.hpp"
+#include "../deal_index.hpp"
+#include "../tablebase.hpp"
+#include "../solver_cache.hpp"
+
+// standard libraries
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// POSIX libraries
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+// constants
+const uint32_t DEFAULT_RANGE_SIZE = 4096;
+const int DEFAULT_LEASE = 300;
+const int DEFAULT_WAIT = 60;
+
+// (workers ask again every second while waiting for a range)
+const int DRAIN_TIME = 5;
+
+const uint32_t BATCH_SIZE = 16;
+
+// (each deal's result is saved as its verdict, moves and difficulty)
+const size_t RESULT_SIZE = 3;
+
+
+/* helper functions */
+
+/* Returns the path of a file in the work directory. */
+static std::string path_in(const std::string &directory, const char *name) {
+    return directory + "/" + name;
+}
+
+/* Returns the path of the file a finished range is saved to. */
+static std::string range_path(const std::string &directory, uint32_t range) {
+    return directory + "/range-" + std::to_string(range);
+}
+
+/* Fills in the address of the socket in the work directory.
+ * Returns whether the path fits.
+ */
+static bool socket_address(
+    const std::string &directory, struct sockaddr_un &address
+) {
+    std::string path = path_in(directory, "socket");
+
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path.c_str());
+
+    return true;
+}
+
+/* Sends a line of text over a socket.
+ * Returns whether it was successful.
+ */
+static bool send_line(int socket_, const std::string &line) {
+    std::string message = line + "\n";
+    size_t sent = 0;
+
+    while (sent < message.size()) {
+        // (MSG_NOSIGNAL keeps a closed connection from killing the process)
+        ssize_t result = send(
+            socket_, message.data() + sent, message.size() - sent,
+            MSG_NOSIGNAL
+        );
+
+        if (result <= 0) {
+            return false;
+        }
+
+        sent += result;
+    }
+
+    return true;
+}
+
+/* Reads whatever has arrived on a socket into a buffer.
+ * Returns whether the connection is still open.
+ */
+static bool receive(int socket_, std::string &buffer) {
+    char data[4096];
+    ssize_t result = recv(socket_, data, sizeof(data), 0);
+
+    if (result <= 0) {
+        return false;
+    }
+
+    buffer.append(data, result);
+
+    return true;
+}
+
+/* Takes the first complete line out of a buffer.
+ * Returns whether there was one.
+ */
+static bool take_line(std::string &buffer, std::string &line) {
+    size_t end = buffer.find('\n');
+
+    if (end == std::string::npos) {
+        return false;
+    }
+
+    line = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+
+    return true;
+}
+
+/* Writes a finished range's results to its file.
+ * Returns whether it was successful.
+ */
+static bool save_range(
+    const std::string &path, const std::vector<DealInfo> &results
+) {
+    std::vector<uint8_t> buffer;
+
+    for (const DealInfo &info : results) {
+        buffer.push_back(info.verdict);
+        buffer.push_back(info.moves);
+        buffer.push_back(info.difficulty);
+    }
+
+    // write to a temporary file first, so a half-written range is never left
+    // behind
+    std::string temp_path = path + ".tmp";
+    std::FILE *output = std::fopen(temp_path.c_str(), "wb");
+
+    if (output == NULL) {
+        return false;
+    }
+
+    bool success = std::fwrite(buffer.data(), 1, buffer.size(), output)
+                   == buffer.size();
+    success = (std::fclose(output) == 0) && success;
+
+    if (!success) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+
+    return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+/* Reads a finished range's results from its file, if it has been saved.
+ * Returns whether it was successful.
+ */
+static bool load_range(const std::string &path, std::vector<DealInfo> &results) {
+    std::FILE *input = std::fopen(path.c_str(), "rb");
+
+    if (input == NULL) {
+        return false;
+    }
+
+    std::vector<uint8_t> buffer(RESULT_SIZE * results.size() + 1);
+    size_t read = std::fread(buffer.data(), 1, buffer.size(), input);
+    std::fclose(input);
+
+    // (a file of the wrong size must belong to some other job)
+    if (read != RESULT_SIZE * results.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (buffer[RESULT_SIZE * i] > solver::UNWINNABLE) {
+            return false;
+        }
+
+        results[i].verdict = static_cast<solver::Verdict>(
+            buffer[RESULT_SIZE * i]
+        );
+        results[i].moves = buffer[RESULT_SIZE * i + 1];
+        results[i].difficulty = buffer[RESULT_SIZE * i + 2];
+    }
+
+    return true;
+}
+
+
+/* Coordinator:
+ * Hands out ranges and collects their results.
+ */
+
+/* Where a range is up to. */
+enum RangeStatus {
+    PENDING,
+    ISSUED,
+    FINISHED
+};
+
+/* A connected worker, and the range it is working on (if any). */
+struct Client {
+    int socket;
+    std::string buffer;
+
+    int64_t range;
+    std::vector<DealInfo> results;
+    std::vector<bool> received;
+    uint32_t received_count;
+
+    std::chrono::steady_clock::time_point last_heard;
+};
+
+class Coordinator {
+    std::string directory;
+    uint32_t first_deal;
+    uint32_t deal_count;
+    uint32_t range_size;
+    std::string job;
+    int lease;
+
+    std::vector<RangeStatus> ranges;
+    std::deque<uint32_t> pending;
+    uint32_t finished_count;
+
+    int listener;
+    std::vector<Client> clients;
+
+    uint32_t range_first(uint32_t range) const;
+    uint32_t range_count(uint32_t range) const;
+
+    void release(Client &client);
+    bool handle(Client &client, const std::string &line);
+
+    public:
+        Coordinator(
+            const std::string &directory, uint32_t first_deal,
+            uint32_t deal_count, uint32_t range_size,
+            const engine::Rules &rules, size_t node_limit, int lease
+        );
+
+        bool run();
+};
+
+Coordinator::Coordinator(
+    const std::string &directory_, uint32_t first_deal_, uint32_t deal_count_,
+    uint32_t range_size_, const engine::Rules &rules, size_t node_limit,
+    int lease_
+):
+    directory(directory_),
+    first_deal(first_deal_),
+    deal_count(deal_count_),
+    range_size(range_size_),
+    lease(lease_),
+    finished_count(0),
+    listener(-1)
+{
+    job = "JOB " + std::to_string(rules.draw_count) + " "
+          + std::to_string(rules.pass_limit) + " "
+          + std::to_string(node_limit);
+}
+
+/* Returns the first deal in a range. */
+uint32_t Coordinator::range_first(uint32_t range) const {
+    return first_deal + range * range_size;
+}
+
+/* Returns the number of deals in a range. */
+uint32_t Coordinator::range_count(uint32_t range) const {
+    return std::min<uint64_t>(
+        range_size, deal_count - static_cast<uint64_t>(range) * range_size
+    );
+}
+
+/* Takes a worker's range back (if it has one), so it is handed out again
+ * before any others.
+ */
+void Coordinator::release(Client &client) {
+    if (client.range >= 0) {
+        ranges[client.range] = PENDING;
+        pending.push_front(client.range);
+
+        std::fprintf(
+            stderr, "\nrange %u lost; handing it out again\n",
+            static_cast<uint32_t>(client.range)
+        );
+    }
+
+    client.range = -1;
+}
+
+/* Handles a message from a worker.
+ * Returns whether it made sense (if not, the worker is disconnected).
+ */
+bool Coordinator::handle(Client &client, const std::string &line) {
+    if (line == "GET") {
+        // (asking for another range means giving up the one held)
+        release(client);
+
+        if (!pending.empty()) {
+            uint32_t range = pending.front();
+            pending.pop_front();
+
+            ranges[range] = ISSUED;
+
+            client.range = range;
+            client.results.assign(range_count(range), DealInfo());
+            client.received.assign(range_count(range), false);
+            client.received_count = 0;
+
+            return send_line(
+                client.socket,
+                "RANGE " + std::to_string(range) + " "
+                + std::to_string(range_first(range)) + " "
+                + std::to_string(range_count(range))
+            );
+        }
+
+        // (once everything is finished, the worker is let go)
+        if (finished_count == ranges.size()) {
+            send_line(client.socket, "DONE");
+            return false;
+        }
+
+        return send_line(client.socket, "WAIT");
+    }
+
+    unsigned long deal, verdict, moves, difficulty, range;
+
+    if (
+        std::sscanf(
+            line.c_str(), "RESULT %lu %lu %lu %lu",
+            &deal, &verdict, &moves, &difficulty
+        ) == 4
+    ) {
+        if (client.range < 0 || verdict > solver::UNWINNABLE) {
+            return false;
+        }
+
+        uint32_t first = range_first(client.range);
+
+        if (deal < first || deal - first >= client.results.size()) {
+            return false;
+        }
+
+        DealInfo &info = client.results[deal - first];
+
+        info.verdict = static_cast<solver::Verdict>(verdict);
+        info.moves = std::min(moves, 255UL);
+        info.difficulty = std::min(difficulty, 3UL);
+
+        if (!client.received[deal - first]) {
+            client.received[deal - first] = true;
+            ++client.received_count;
+        }
+
+        return true;
+    }
+
+    if (std::sscanf(line.c_str(), "FINISHED %lu", &range) == 1) {
+        if (
+            client.range < 0 || range != static_cast<uint64_t>(client.range)
+            || client.received_count != client.results.size()
+        ) {
+            return false;
+        }
+
+        if (!save_range(range_path(directory, range), client.results)) {
+            std::fprintf(stderr, "couldn't save range %lu\n", range);
+            return false;
+        }
+
+        ranges[range] = FINISHED;
+        ++finished_count;
+        client.range = -1;
+
+        std::fprintf(
+            stderr, "\r%u/%zu ranges finished", finished_count, ranges.size()
+        );
+
+        return true;
+    }
+
+    return false;
+}
+
+/* Hands out ranges until all of them are finished.
+ * Returns whether it was successful.
+ */
+bool Coordinator::run() {
+    // (a job file makes sure a restarted coordinator is picking up the same
+    // job, since range files don't say which job they came from)
+    std::string job_line = job + " " + std::to_string(first_deal) + " "
+                           + std::to_string(deal_count) + " "
+                           + std::to_string(range_size);
+    std::string job_path = path_in(directory, "job");
+
+    std::FILE *job_file = std::fopen(job_path.c_str(), "r");
+
+    if (job_file != NULL) {
+        char existing[256] = {};
+        bool same = std::fgets(existing, sizeof(existing), job_file) != NULL
+                    && job_line + "\n" == existing;
+
+        std::fclose(job_file);
+
+        if (!same) {
+            std::fprintf(
+                stderr, "%s holds a different job\n", directory.c_str()
+            );
+            return false;
+        }
+    } else {
+        job_file = std::fopen(job_path.c_str(), "w");
+
+        if (
+            job_file == NULL
+            || std::fprintf(job_file, "%s\n", job_line.c_str()) < 0
+            || std::fclose(job_file) != 0
+        ) {
+            std::fprintf(stderr, "couldn't write %s\n", job_path.c_str());
+            return false;
+        }
+    }
+
+    // pick up where the last run left off
+    uint32_t range_total = (static_cast<uint64_t>(deal_count) + range_size - 1)
+                           / range_size;
+    ranges.assign(range_total, PENDING);
+
+    for (uint32_t range = 0; range < range_total; ++range) {
+        std::vector<DealInfo> results(range_count(range));
+
+        if (load_range(range_path(directory, range), results)) {
+            ranges[range] = FINISHED;
+            ++finished_count;
+        } else {
+            pending.push_back(range);
+        }
+    }
+
+    std::fprintf(
+        stderr, "%u/%u ranges already finished\n", finished_count, range_total
+    );
+
+    if (finished_count == range_total) {
+        return true;
+    }
+
+    // listen for workers
+    struct sockaddr_un address;
+
+    if (!socket_address(directory, address)) {
+        std::fprintf(stderr, "directory path is too long\n");
+        return false;
+    }
+
+    // (a socket left behind by a coordinator that was killed would stop a
+    // new one from binding)
+    unlink(address.sun_path);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (
+        listener < 0
+        || bind(
+            listener, reinterpret_cast<struct sockaddr *>(&address),
+            sizeof(address)
+        ) != 0
+        || listen(listener, 64) != 0
+    ) {
+        std::fprintf(stderr, "couldn't listen on %s\n", address.sun_path);
+        return false;
+    }
+
+    // (once every range is finished, workers still connected are given a
+    // little while to ask for another, so they hear that there are none)
+    auto drain_deadline = std::chrono::steady_clock::time_point::max();
+
+    while (
+        finished_count < range_total || (
+            !clients.empty()
+            && std::chrono::steady_clock::now() < drain_deadline
+        )
+    ) {
+        if (
+            finished_count == range_total
+            && drain_deadline == std::chrono::steady_clock::time_point::max()
+        ) {
+            drain_deadline = std::chrono::steady_clock::now()
+                             + std::chrono::seconds(DRAIN_TIME);
+        }
+
+        std::vector<struct pollfd> polls(clients.size() + 1);
+
+        polls[0].fd = listener;
+        polls[0].events = POLLIN;
+
+        for (size_t i = 0; i < clients.size(); ++i) {
+            polls[i + 1].fd = clients[i].socket;
+            polls[i + 1].events = POLLIN;
+        }
+
+        // (waking up every second catches workers that have gone quiet)
+        poll(polls.data(), polls.size(), 1000);
+
+        auto now = std::chrono::steady_clock::now();
+
+        // hear from workers
+        for (size_t i = 0; i < clients.size(); ++i) {
+            Client &client = clients[i];
+            bool open = true;
+
+            if (polls[i + 1].revents != 0) {
+                open = receive(client.socket, client.buffer);
+                client.last_heard = now;
+
+                std::string line;
+
+                while (open && take_line(client.buffer, line)) {
+                    open = handle(client, line);
+                }
+            } else if (
+                client.range >= 0
+                && now - client.last_heard > std::chrono::seconds(lease)
+            ) {
+                open = false;
+            }
+
+            if (!open) {
+                release(client);
+                close(client.socket);
+
+                client.socket = -1;
+            }
+        }
+
+        clients.erase(
+            std::remove_if(
+                clients.begin(), clients.end(),
+                [](const Client &client) { return client.socket < 0; }
+            ),
+            clients.end()
+        );
+
+        // welcome new workers
+        if (polls[0].revents & POLLIN) {
+            int connection = accept(listener, NULL, NULL);
+
+            if (connection >= 0 && send_line(connection, job)) {
+                Client client;
+
+                client.socket = connection;
+                client.range = -1;
+                client.received_count = 0;
+                client.last_heard = now;
+
+                clients.push_back(client);
+            } else if (connection >= 0) {
+                close(connection);
+            }
+        }
+    }
+
+    std::fprintf(stderr, "\n");
+
+    for (Client &client : clients) {
+        close(client.socket);
+    }
+
+    clients.clear();
+
+    close(listener);
+    unlink(address.sun_path);
+
+    return true;
+}
+
+/* Counts the verdicts in every finished range, reading one range at a time.
+ * Returns whether every range could be read.
+ */
+static bool gather(
+    const std::string &directory, uint32_t deal_count, uint32_t range_size,
+    size_t verdicts[3]
+) {
+    uint32_t range_total = (static_cast<uint64_t>(deal_count) + range_size - 1)
+                           / range_size;
+
+    for (uint32_t range = 0; range < range_total; ++range) {
+        std::vector<DealInfo> results(
+            std::min<uint64_t>(
+                range_size,
+                deal_count - static_cast<uint64_t>(range) * range_size
+            )
+        );
+
+        if (!load_range(range_path(directory, range), results)) {
+            return false;
+        }
+
+        for (const DealInfo &info : results) {
+            ++verdicts[info.verdict];
+        }
+    }
+
+    return true;
+}
+
+
+/* Worker:
+ * Solves ranges it is handed, sending back each deal's result as it goes.
+ */
+
+/* Connects to the coordinator, retrying for up to a given number of seconds.
+ * Returns the connection, or -1 if it couldn't be made.
+ */
+static int connect_to(const std::string &directory, int wait) {
+    struct sockaddr_un address;
+
+    if (!socket_address(directory, address)) {
+        return -1;
+    }
+
+    auto deadline = std::chrono::steady_clock::now()
+                    + std::chrono::seconds(wait);
+
+    for (;;) {
+        int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (
+            connection >= 0
+            && connect(
+                connection, reinterpret_cast<struct sockaddr *>(&address),
+                sizeof(address)
+            ) == 0
+        ) {
+            return connection;
+        }
+
+        if (connection >= 0) {
+            close(connection);
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return -1;
+        }
+
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
+
+/* Reads the next line from the coordinator, waiting for it to arrive.
+ * Returns whether the connection is still open.
+ */
+static bool read_line(int connection, std::string &buffer, std::string &line) {
+    while (!take_line(buffer, line)) {
+        if (!receive(connection, buffer)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Solves a range on every thread, sending each result as it is found.
+ * Returns whether every result was sent.
+ */
+static bool solve_range(
+    int connection, uint32_t first, uint32_t count,
+    const engine::Rules &rules, size_t node_limit, unsigned int thread_count,
+    const Tablebase &tablebase, SolverCache &cache
+) {
+    std::atomic<uint32_t> next_batch(0);
+    std::atomic<bool> lost(false);
+    std::mutex send_mutex;
+    std::vector<std::thread> threads;
+
+    for (unsigned int t = 0; t < thread_count; ++t) {
+        threads.push_back(std::thread([&]() {
+            solver::Solver solver;
+            engine::State state;
+
+            if (tablebase.is_open()) {
+                solver.set_tablebase(&tablebase);
+            }
+
+            while (!lost.load()) {
+                uint64_t batch_first =
+                    static_cast<uint64_t>(next_batch.fetch_add(1)) * BATCH_SIZE;
+
+                if (batch_first >= count) {
+                    break;
+                }
+
+                uint32_t last = std::min<uint64_t>(
+                    batch_first + BATCH_SIZE, count
+                );
+
+                for (uint32_t i = batch_first; i < last && !lost.load(); ++i) {
+                    uint32_t deal = first + i;
+                    engine::deal(state, deal);
+
+                    CacheEntry entry;
+
+                    if (
+                        !cache.is_open()
+                        || !cache.lookup(state, rules, node_limit, entry)
+                    ) {
+                        solver::Result result = solver.solve(
+                            state, node_limit, NULL, rules
+                        );
+
+                        if (cache.is_open()) {
+                            cache.add(state, rules, node_limit, result);
+                        }
+
+                        entry.verdict = result.verdict;
+                        entry.nodes = std::min<size_t>(
+                            result.nodes, UINT32_MAX
+                        );
+                        entry.moves = std::min<size_t>(
+                            result.solution.size(), 255
+                        );
+                    }
+
+                    solver::Result searched;
+                    searched.verdict = entry.verdict;
+                    searched.nodes = entry.nodes;
+
+                    std::string line =
+                        "RESULT " + std::to_string(deal) + " "
+                        + std::to_string(entry.verdict) + " "
+                        + std::to_string(entry.moves) + " "
+                        + std::to_string(
+                            std::max(solver::difficulty(searched), 0)
+                        );
+
+                    std::lock_guard<std::mutex> lock(send_mutex);
+
+                    if (!send_line(connection, line)) {
+                        lost.store(true);
+                    }
+                }
+            }
+        }));
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    return !lost.load();
+}
+
+/* Asks for ranges and solves them until there are none left, reconnecting
+ * whenever the coordinator goes away.
+ * Returns whether it was successful.
+ */
+static bool work(
+    const std::string &directory, unsigned int thread_count,
+    const Tablebase &tablebase, SolverCache &cache, int wait
+) {
+    for (;;) {
+        int connection = connect_to(directory, wait);
+
+        if (connection < 0) {
+            std::fprintf(stderr, "couldn't reach the coordinator\n");
+            return false;
+        }
+
+        std::string buffer;
+        std::string line;
+
+        engine::Rules rules;
+        unsigned int draw_count, pass_limit;
+        unsigned long long node_limit;
+
+        bool open = read_line(connection, buffer, line)
+                    && std::sscanf(
+                        line.c_str(), "JOB %u %u %llu",
+                        &draw_count, &pass_limit, &node_limit
+                    ) == 3;
+
+        rules.draw_count = draw_count;
+        rules.pass_limit = pass_limit;
+
+        // (checked before narrowing, so that e.g. 259 isn't taken as 3)
+        bool supported = draw_count <= UINT8_MAX && pass_limit <= UINT8_MAX
+                         && engine::is_supported(rules);
+
+        if (open && !supported) {
+            std::fprintf(stderr, "unsupported rules\n");
+            close(connection);
+
+            return false;
+        }
+
+        while (open) {
+            unsigned long range, first, count;
+
+            open = send_line(connection, "GET")
+                   && read_line(connection, buffer, line);
+
+            if (!open) {
+                break;
+            }
+
+            if (line == "DONE") {
+                close(connection);
+                return true;
+            }
+
+            if (line == "WAIT") {
+                // (ranges still being solved elsewhere might come back)
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            } else if (
+                std::sscanf(
+                    line.c_str(), "RANGE %lu %lu %lu", &range, &first, &count
+                ) == 3
+            ) {
+                open = solve_range(
+                    connection, first, count, rules, node_limit, thread_count,
+                    tablebase, cache
+                ) && send_line(connection, "FINISHED " + std::to_string(range));
+            } else {
+                open = false;
+            }
+        }
+
+        // the coordinator went away (or stopped making sense), so start over
+        // with it; any range in progress will be handed out again
+        close(connection);
+        std::fprintf(stderr, "lost the coordinator; reconnecting\n");
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    // parse arguments
+    engine::Rules rules = engine::DEFAULT_RULES;
+    size_t node_limit = solver::DEFAULT_NODE_LIMIT;
+    uint32_t range_size = DEFAULT_RANGE_SIZE;
+    int lease = DEFAULT_LEASE;
+    const char *output_path = NULL;
+
+    unsigned int thread_count = std::thread::hardware_concurrency();
+    const char *tablebase_path = NULL;
+    const char *cache_path = NULL;
+    int wait = DEFAULT_WAIT;
+
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (!engine::parse_rules(argv[++i], rules)) {
+                std::fprintf(stderr, "unsupported rules\n");
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            node_limit = std::strtoull(argv[++i], NULL, 10);
+        } else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            range_size = std::strtoul(argv[++i], NULL, 10);
+        } else if (std::strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            lease = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            tablebase_path = argv[++i];
+        } else if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cache_path = argv[++i];
+        } else if (std::strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            wait = std::atoi(argv[++i]);
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    bool coordinate = positional.size() == 4
+                      && std::strcmp(positional[0], "coordinate") == 0;
+    bool working = positional.size() == 2
+                   && std::strcmp(positional[0], "work") == 0;
+
+    if (!coordinate && !working) {
+        std::fprintf(
+            stderr,
+            "usage: %s coordinate [-r rules] [-n node limit] [-s range size] "
+            "[-l lease] [-o output] directory first count\n"
+            "       %s work [-j threads] [-t tablebase] [-c cache] [-w wait] "
+            "directory\n",
+            argv[0], argv[0]
+        );
+        return 1;
+    }
+
+    std::string directory = positional[1];
+
+    if (working) {
+        if (thread_count == 0) {
+            thread_count = 1;
+        }
+
+        Tablebase tablebase;
+        SolverCache cache;
+
+        if (tablebase_path != NULL && !tablebase.open(tablebase_path)) {
+            std::fprintf(stderr, "couldn't open %s\n", tablebase_path);
+            return 1;
+        }
+
+        if (cache_path != NULL && !cache.open(cache_path)) {
+            std::fprintf(stderr, "couldn't open %s\n", cache_path);
+            return 1;
+        }
+
+        return work(directory, thread_count, tablebase, cache, wait) ? 0 : 1;
+    }
+
+    if (range_size == 0) {
+        range_size = 1;
+    }
+
+    uint32_t first_deal = std::strtoul(positional[2], NULL, 10);
+    uint32_t deal_count = std::strtoul(positional[3], NULL, 10);
+
+    auto start = std::chrono::steady_clock::now();
+
+    Coordinator coordinator(
+        directory, first_deal, deal_count, range_size, rules, node_limit, lease
+    );
+
+    if (!coordinator.run()) {
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+
+    // count verdicts
+    size_t verdicts[3] = {0, 0, 0};
+
+    if (!gather(directory, deal_count, range_size, verdicts)) {
+        std::fprintf(stderr, "couldn't read the finished ranges\n");
+        return 1;
+    }
+
+    std::printf(
+        "%zu winnable, %zu unwinnable, %zu unknown in %.1f s\n",
+        verdicts[solver::WINNABLE], verdicts[solver::UNWINNABLE],
+        verdicts[solver::UNKNOWN], seconds
+    );
+
+    // (the index is written straight from the range files, one range at a
+    // time, so the whole set of deals is never held in memory)
+    auto read_range = [&directory](
+        uint32_t range, std::vector<DealInfo> &results
+    ) {
+        return load_range(range_path(directory, range), results);
+    };
+
+    if (
+        output_path != NULL
+        && !DealIndex::write(
+            output_path, first_deal, deal_count, range_size, read_range, rules
+        )
+    ) {
+        std::fprintf(stderr, "couldn't write %s\n", output_path);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,431 @@
+/* klondike/tools/loadgen.cpp
+ * by python-b5
+ *
+ * Puts load on a game server (see server.cpp) for benchmarking: keeps many
+ * games going at once, each asking for its legal moves and making a random
+ * one, over and over, and reports how quickly commands were answered.
+ *
+ * Usage: loadgen [-g games] [-c commands] [-d depth] [-m moves] [-r rules]
+ *                [-s seed] socket
+ *   -g  games to keep going at once (defaults to 10000)
+ *   -c  commands to send in total, not counting starting and ending the
+ *       games (defaults to 1000000)
+ *   -d  most commands waiting for a reply at once (defaults to 64)
+ *   -m  moves after which a game is ended and a new one started (defaults
+ *       to 200)
+ *   -r  the rules to play with: the draw count, optionally followed by a
+ *       slash and the pass limit (e.g. "1" or "3/3"; defaults to "3")
+ *   -s  seed for picking moves (defaults to 1)
+ *
+ * Latencies are measured from sending a command to reading its reply, so
+ * they include time spent queued behind the other commands in flight.
+ */
+
+
+// project includes
+#include "../engine.hpp"
+
+// standard libraries
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// POSIX libraries
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+// type aliases
+typedef std::chrono::steady_clock Clock;
+
+
+/* What a game asks the server next. */
+enum Step {
+    START,
+    LIST_MOVES,
+    MAKE_MOVE,
+    FINISH
+};
+
+/* One of the games being played. */
+struct Game {
+    uint32_t id;
+    Step step;
+
+    int moves;
+    int action;
+};
+
+/* A command waiting for its reply. */
+struct Pending {
+    size_t game;
+    Clock::time_point sent;
+};
+
+
+/* helper functions */
+
+/* Sends a buffer of commands over a socket, emptying it.
+ * Returns whether it was successful.
+ */
+static bool send_all(int socket_, std::string &buffer) {
+    size_t sent = 0;
+
+    while (sent < buffer.size()) {
+        ssize_t result = send(
+            socket_, buffer.data() + sent, buffer.size() - sent, MSG_NOSIGNAL
+        );
+
+        if (result <= 0) {
+            return false;
+        }
+
+        sent += result;
+    }
+
+    buffer.clear();
+
+    return true;
+}
+
+/* Writes a game's next command. */
+static void write_command(
+    const Game &game, const char *rules, std::string &buffer
+) {
+    char command[64];
+
+    switch (game.step) {
+        case START:
+            std::snprintf(command, sizeof(command), "NEW %s\n", rules);
+            break;
+
+        case LIST_MOVES:
+            std::snprintf(command, sizeof(command), "MOVES %u\n", game.id);
+            break;
+
+        case MAKE_MOVE:
+            std::snprintf(
+                command, sizeof(command), "MOVE %u %d\n", game.id, game.action
+            );
+            break;
+
+        default:
+            std::snprintf(command, sizeof(command), "END %u\n", game.id);
+            break;
+    }
+
+    buffer += command;
+}
+
+/* Moves a game on to its next command, given the reply to its last one.
+ * Returns whether the reply was an error it didn't expect.
+ */
+static bool advance(
+    Game &game, const char *reply, int move_limit, uint64_t &seed
+) {
+    bool ok = std::strncmp(reply, "OK", 2) == 0;
+
+    switch (game.step) {
+        case START:
+            if (!ok) {
+                return true;
+            }
+
+            game.id = std::strtoul(reply + 3, NULL, 10);
+            game.moves = 0;
+            game.step = LIST_MOVES;
+
+            return false;
+
+        case LIST_MOVES: {
+            if (!ok) {
+                return true;
+            }
+
+            // pick one of the moves at random
+            std::vector<int> actions;
+            const char *next = reply + 2;
+            char *end;
+
+            while (true) {
+                long action = std::strtol(next, &end, 10);
+
+                if (end == next) {
+                    break;
+                }
+
+                actions.push_back(action);
+                next = end;
+            }
+
+            if (actions.empty() || game.moves >= move_limit) {
+                game.step = FINISH;
+            } else {
+                game.action = actions[engine::next_random(seed) % actions.size()];
+                game.step = MAKE_MOVE;
+            }
+
+            return false;
+        }
+
+        case MAKE_MOVE:
+            ++game.moves;
+            game.step = ok && std::strstr(reply, "won") == NULL ? LIST_MOVES
+                                                                : FINISH;
+
+            return !ok;
+
+        default:
+            game.step = START;
+
+            return !ok;
+    }
+}
+
+/* Returns a percentile of some sorted latencies, in microseconds. */
+static double percentile(const std::vector<float> &latencies, double fraction) {
+    if (latencies.empty()) {
+        return 0;
+    }
+
+    size_t i = static_cast<size_t>(fraction * (latencies.size() - 1));
+
+    return latencies[i];
+}
+
+
+int main(int argc, char *argv[]) {
+    // parse arguments
+    size_t game_count = 10000;
+    unsigned long command_limit = 1000000;
+    size_t depth = 64;
+    int move_limit = 200;
+    const char *rules = "3";
+    uint64_t seed = 1;
+
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            game_count = std::strtoull(argv[++i], NULL, 10);
+        } else if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            command_limit = std::strtoul(argv[++i], NULL, 10);
+        } else if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            depth = std::strtoull(argv[++i], NULL, 10);
+        } else if (std::strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            move_limit = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rules = argv[++i];
+        } else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], NULL, 10);
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() != 1 || game_count == 0 || depth == 0) {
+        std::fprintf(
+            stderr, "usage: %s [-g games] [-c commands] [-d depth] "
+                    "[-m moves] [-r rules] [-s seed] socket\n",
+            argv[0]
+        );
+        return 1;
+    }
+
+    // connect to the server
+    struct sockaddr_un address;
+
+    if (std::strlen(positional[0]) >= sizeof(address.sun_path)) {
+        std::fprintf(stderr, "socket path is too long\n");
+        return 1;
+    }
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, positional[0]);
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (
+        connection < 0
+        || connect(
+            connection, reinterpret_cast<struct sockaddr *>(&address),
+            sizeof(address)
+        ) != 0
+    ) {
+        std::fprintf(stderr, "couldn't connect to %s\n", positional[0]);
+        return 1;
+    }
+
+    // play games until enough commands have been sent, then end them all
+    std::vector<Game> games(game_count);
+    std::deque<size_t> ready;
+
+    for (size_t i = 0; i < game_count; ++i) {
+        games[i].id = 0;
+        games[i].step = START;
+
+        ready.push_back(i);
+    }
+
+    std::deque<Pending> pending;
+    std::vector<float> latencies;
+    latencies.reserve(command_limit);
+
+    std::string output;
+    std::string input;
+
+    unsigned long sent = 0;
+    unsigned long errors = 0;
+    size_t open_games = 0;
+    bool finishing = false;
+
+    Clock::time_point start = Clock::now();
+
+    while (true) {
+        // keep the pipeline full
+        while (pending.size() < depth && !ready.empty()) {
+            size_t i = ready.front();
+            ready.pop_front();
+
+            Game &game = games[i];
+
+            // (once enough commands have been sent, games are only ended)
+            if (finishing && game.step != FINISH) {
+                if (game.step == START) {
+                    continue;
+                }
+
+                game.step = FINISH;
+            }
+
+            write_command(game, rules, output);
+            pending.push_back({i, Clock::now()});
+
+            if (game.step == LIST_MOVES || game.step == MAKE_MOVE) {
+                ++sent;
+            }
+        }
+
+        if (pending.empty()) {
+            break;
+        }
+
+        if (!send_all(connection, output)) {
+            std::fprintf(stderr, "lost the connection to the server\n");
+            return 1;
+        }
+
+        // read replies, which come back in the order commands were sent
+        char data[65536];
+        ssize_t result = recv(connection, data, sizeof(data), 0);
+
+        if (result <= 0) {
+            std::fprintf(stderr, "lost the connection to the server\n");
+            return 1;
+        }
+
+        input.append(data, result);
+
+        size_t line_start = 0;
+        size_t end;
+
+        while ((end = input.find('\n', line_start)) != std::string::npos) {
+            input[end] = '\0';
+
+            Pending command = pending.front();
+            pending.pop_front();
+
+            Game &game = games[command.game];
+            Step step = game.step;
+
+            if (step == LIST_MOVES || step == MAKE_MOVE) {
+                latencies.push_back(
+                    std::chrono::duration<float, std::micro>(
+                        Clock::now() - command.sent
+                    ).count()
+                );
+            }
+
+            errors += advance(
+                game, input.c_str() + line_start, move_limit, seed
+            );
+
+            if (step == START && game.step == LIST_MOVES) {
+                ++open_games;
+            } else if (step == FINISH) {
+                --open_games;
+            }
+
+            // (games that are done with aren't queued again)
+            if (!(finishing && game.step == START)) {
+                ready.push_back(command.game);
+            }
+
+            line_start = end + 1;
+        }
+
+        input.erase(0, line_start);
+
+        finishing = sent >= command_limit;
+    }
+
+    double seconds = std::chrono::duration<double>(
+        Clock::now() - start
+    ).count();
+
+    // ask the server how much memory the games took
+    output = "STATS\n";
+    send_all(connection, output);
+
+    input.clear();
+
+    while (input.find('\n') == std::string::npos) {
+        char data[256];
+        ssize_t result = recv(connection, data, sizeof(data), 0);
+
+        if (result <= 0) {
+            break;
+        }
+
+        input.append(data, result);
+    }
+
+    unsigned long session_size = 0;
+    std::sscanf(input.c_str(), "OK %*u %*u %lu", &session_size);
+
+    close(connection);
+
+    std::sort(latencies.begin(), latencies.end());
+
+    std::printf(
+        "%zu games, %lu commands in %.2f s (%.0f commands/s)\n",
+        game_count, sent, seconds, sent / seconds
+    );
+    std::printf(
+        "latency: median %.1f us, 99th percentile %.1f us, "
+        "99.9th percentile %.1f us, worst %.1f us\n",
+        percentile(latencies, 0.5), percentile(latencies, 0.99),
+        percentile(latencies, 0.999), percentile(latencies, 1)
+    );
+    std::printf(
+        "%lu bytes per game on the server (%.1f MB for %zu games)\n",
+        session_size, session_size * game_count / 1e6, game_count
+    );
+
+    if (errors != 0) {
+        std::printf("%lu unexpected error(s)\n", errors);
+    }
+
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+/* klondike/tools/render.cpp
+ * by python-b5
+ *
+ * Renders positions from a range of deals without a display, saving them as
+ * bitmaps (for thumbnails, or as golden images) or checking them pixel for
+ * pixel against golden images saved before.
+ *
+ * Usage: render [-r rules] [-m moves] [-o directory] [-g directory]
+ *               first count
+ *   -r  the rules to play with: the draw count, optionally followed by a
+ *       slash and the pass limit (e.g. "1" or "3/3"; defaults to "3")
+ *   -m  random moves to play into each deal, rendering the position after
+ *       each one as well as the deal itself (defaults to 0)
+ *   -o  directory to save each frame to, as <deal>-<move>.bmp
+ *   -g  directory of golden images to compare each frame with (named the
+ *       same way); any that differ are reported, and the exit status is 1
+ *
+ * The moves played are picked from the deal number alone, so the same frames
+ * are rendered every time. Must be run from the game's directory, since the
+ * card images are loaded from assets/.
+ */
+
+
+// project includes
+#include "../wrapper.hpp"
+#include "../board.hpp"
+#include "../engine.hpp"
+
+// standard libraries
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// external libraries
+#include <SDL2/SDL.h>
+
+
+/* helper functions */
+
+/* Loads a bitmap's pixels as 32-bit ARGB.
+ * Returns whether it was successful (and the bitmap is the given size).
+ */
+static bool load_pixels(
+    const std::string &path, int width, int height,
+    std::vector<uint32_t> &pixels
+) {
+    SDL_Surface *loaded = SDL_LoadBMP(path.c_str());
+
+    if (loaded == NULL) {
+        return false;
+    }
+
+    SDL_Surface *converted = SDL_ConvertSurfaceFormat(
+        loaded, SDL_PIXELFORMAT_ARGB8888, 0
+    );
+    SDL_FreeSurface(loaded);
+
+    if (converted == NULL) {
+        return false;
+    }
+
+    bool success = converted->w == width && converted->h == height;
+
+    if (success) {
+        pixels.resize(static_cast<size_t>(width) * height);
+
+        for (int y = 0; y < height; ++y) {
+            std::memcpy(
+                pixels.data() + static_cast<size_t>(y) * width,
+                static_cast<const uint8_t *>(converted->pixels)
+                + static_cast<size_t>(y) * converted->pitch,
+                width * 4
+            );
+        }
+    }
+
+    SDL_FreeSurface(converted);
+
+    return success;
+}
+
+
+int main(int argc, char *argv[]) {
+    // parse arguments
+    engine::Rules rules = engine::DEFAULT_RULES;
+    int move_count = 0;
+    const char *output_directory = NULL;
+    const char *golden_directory = NULL;
+
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (!engine::parse_rules(argv[++i], rules)) {
+                std::fprintf(stderr, "unsupported rules\n");
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            move_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_directory = argv[++i];
+        } else if (std::strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            golden_directory = argv[++i];
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() != 2) {
+        std::fprintf(
+            stderr, "usage: %s [-r rules] [-m moves] [-o directory] "
+                    "[-g directory] first count\n",
+            argv[0]
+        );
+        return 1;
+    }
+
+    uint32_t first_deal = std::strtoul(positional[0], NULL, 10);
+    uint32_t deal_count = std::strtoul(positional[1], NULL, 10);
+
+    if (!wrapper::initialize_headless(board::WIDTH, board::HEIGHT)) {
+        std::fprintf(stderr, "couldn't initialize: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    board::load_sprites();
+
+    // render every frame
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<uint32_t> pixels;
+    std::vector<uint32_t> golden;
+
+    size_t frames = 0;
+    size_t mismatches = 0;
+
+    for (uint32_t i = 0; i < deal_count; ++i) {
+        uint32_t deal = first_deal + i;
+
+        engine::State state;
+        engine::deal(state, deal);
+
+        std::mt19937 random(deal);
+
+        for (int move = 0; move <= move_count; ++move) {
+            wrapper::clear(board::BACKGROUND);
+            board::draw(state);
+
+            std::string name = std::to_string(deal) + "-"
+                               + std::to_string(move) + ".bmp";
+            ++frames;
+
+            if (
+                output_directory != NULL
+                && !wrapper::save_screenshot(
+                    std::string(output_directory) + "/" + name
+                )
+            ) {
+                std::fprintf(stderr, "couldn't save %s\n", name.c_str());
+                wrapper::quit();
+
+                return 1;
+            }
+
+            if (golden_directory != NULL) {
+                wrapper::read_pixels(pixels);
+
+                if (
+                    !load_pixels(
+                        std::string(golden_directory) + "/" + name,
+                        board::WIDTH, board::HEIGHT, golden
+                    )
+                ) {
+                    std::printf("%s: no golden image\n", name.c_str());
+                    ++mismatches;
+                } else if (pixels != golden) {
+                    size_t differing = 0;
+
+                    for (size_t p = 0; p < pixels.size(); ++p) {
+                        differing += pixels[p] != golden[p];
+                    }
+
+                    std::printf(
+                        "%s: %zu pixel(s) differ\n", name.c_str(), differing
+                    );
+                    ++mismatches;
+                }
+            }
+
+            // play a random move to get to the next position
+            engine::Move moves[engine::MAX_MOVES];
+            int count = engine::legal_moves(rules, state, moves);
+
+            if (count == 0 || engine::won(state)) {
+                break;
+            }
+
+            engine::apply(rules, state, moves[random() % count]);
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+
+    std::printf(
+        "%zu frames in %.2f s (%.0f frames/s)", frames, seconds,
+        frames / seconds
+    );
+
+    if (golden_directory != NULL) {
+        std::printf("; %zu differ from the golden images", mismatches);
+    }
+
+    std::printf("\n");
+
+    wrapper::quit();
+
+    return mismatches == 0 ? 0 : 1;
+}
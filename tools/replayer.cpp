@@ -0,0 +1,255 @@
+/* klondike/tools/replayer.cpp
+ * by python-b5
+ *
+ * Replays recorded games without the game itself, checking that every move was
+ * legal. Games are spread across all cores.
+ *
+ * Usage: replayer [-j threads] [-v] log...
+ *   -j  number of threads to use (defaults to one per core)
+ *   -v  list every invalid game instead of only the first few
+ *
+ * Besides the totals, a digest of every valid game's final position is
+ * printed, so replaying the same logs before and after a rule change shows
+ * whether any outcome changed.
+ */
+
+
+// project includes
+#include "../engine.hpp"
+#include "../replay.hpp"
+#include "../mapped_file.hpp"
+
+// standard libraries
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+// constants
+const size_t BATCH_SIZE = 256;
+const size_t MAX_REPORTED = 10;
+
+
+/* An invalid chain of records. */
+struct Failure {
+    size_t chain;
+    replay::Outcome outcome;
+};
+
+/* Totals collected by one thread. */
+struct Totals {
+    size_t games = 0;
+    size_t valid = 0;
+    size_t won = 0;
+
+    size_t moves = 0;
+    size_t undos = 0;
+
+    uint64_t digest = 0;
+
+    std::vector<Failure> failures;
+};
+
+
+int main(int argc, char *argv[]) {
+    // parse arguments
+    unsigned int thread_count = std::thread::hardware_concurrency();
+    bool verbose = false;
+
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if (paths.empty()) {
+        std::fprintf(stderr, "usage: %s [-j threads] [-v] log...\n", argv[0]);
+        return 1;
+    }
+
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    // map logs and split them into games, keeping where each log's records
+    // start
+    std::vector<MappedFile> logs(paths.size());
+    std::vector<replay::GameRecord> records;
+    std::vector<size_t> log_starts;
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        log_starts.push_back(records.size());
+
+        if (
+            !logs[i].open(paths[i])
+            || !replay::split(logs[i].get_data(), logs[i].get_size(), records)
+        ) {
+            std::fprintf(stderr, "%s: not a replay log\n", paths[i].c_str());
+            return 1;
+        }
+    }
+
+    // find where each chain of records starts
+    std::vector<size_t> chains;
+
+    for (
+        size_t i = 0;
+        i < records.size();
+        i += replay::chain_length(records, i)
+    ) {
+        chains.push_back(i);
+    }
+
+    // replay chains in batches, with each thread taking the next batch when
+    // it is done with its last one
+    auto start = std::chrono::steady_clock::now();
+
+    std::atomic<size_t> next_batch(0);
+    std::vector<Totals> totals(thread_count);
+    std::vector<std::thread> threads;
+
+    for (unsigned int t = 0; t < thread_count; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            Totals &local = totals[t];
+            engine::Game game;
+
+            for (;;) {
+                size_t first = next_batch.fetch_add(1) * BATCH_SIZE;
+
+                if (first >= chains.size()) {
+                    break;
+                }
+
+                size_t last = std::min(first + BATCH_SIZE, chains.size());
+
+                for (size_t c = first; c < last; ++c) {
+                    size_t length = replay::chain_length(records, chains[c]);
+
+                    replay::Outcome outcome = replay::run(
+                        &records[chains[c]], length, game
+                    );
+
+                    ++local.games;
+                    local.moves += outcome.moves;
+                    local.undos += outcome.undos;
+
+                    if (outcome.valid) {
+                        ++local.valid;
+                        local.won += outcome.won;
+                        local.digest += engine::hash(game.state);
+                    } else {
+                        Failure failure;
+
+                        failure.chain = c;
+                        failure.outcome = outcome;
+
+                        local.failures.push_back(failure);
+                    }
+                }
+            }
+        }));
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+
+    // combine and print totals
+    Totals total;
+
+    for (const Totals &local : totals) {
+        total.games += local.games;
+        total.valid += local.valid;
+        total.won += local.won;
+        total.moves += local.moves;
+        total.undos += local.undos;
+        total.digest += local.digest;
+
+        total.failures.insert(
+            total.failures.end(), local.failures.begin(), local.failures.end()
+        );
+    }
+
+    std::printf(
+        "games:   %zu (%zu valid, %zu invalid, %zu won)\n",
+        total.games, total.valid, total.games - total.valid, total.won
+    );
+    std::printf("moves:   %zu (%zu undos)\n", total.moves, total.undos);
+    std::printf("digest:  %016llx\n", (unsigned long long) total.digest);
+    std::printf(
+        "time:    %.3f s on %u thread(s) (%.0f games/minute)\n",
+        seconds, thread_count,
+        seconds > 0 ? 60 * total.games / seconds : 0.0
+    );
+
+    // list invalid games, in the order they appear in the logs (which is the
+    // order of their chains, since records are kept in log order), so the
+    // same logs always give the same report however the threads ran
+    std::sort(
+        total.failures.begin(), total.failures.end(),
+        [](const Failure &a, const Failure &b) { return a.chain < b.chain; }
+    );
+
+    for (size_t i = 0; i < total.failures.size(); ++i) {
+        if (!verbose && i == MAX_REPORTED) {
+            std::printf(
+                "... and %zu more (use -v to list them all)\n",
+                total.failures.size() - MAX_REPORTED
+            );
+            break;
+        }
+
+        const Failure &failure = total.failures[i];
+        size_t chain_start = chains[failure.chain];
+        const replay::GameRecord &first = records[chain_start];
+
+        // (records are numbered from the start of the log they're in)
+        size_t log = std::upper_bound(
+            log_starts.begin(), log_starts.end(), chain_start
+        ) - log_starts.begin() - 1;
+        const char *path = paths[log].c_str();
+
+        if (first.resumed) {
+            std::printf(
+                "invalid: %s: deal %u resumes a game that isn't in the log\n",
+                path, first.deal_number
+            );
+        } else if (!engine::is_supported(first.rules)) {
+            std::printf(
+                "invalid: %s: deal %u is played with unsupported rules "
+                "(draw %d, pass limit %d)\n",
+                path, first.deal_number, first.rules.draw_count,
+                first.rules.pass_limit
+            );
+        } else {
+            std::printf(
+                "invalid: %s: deal %u, record %zu, word %zu\n",
+                path, first.deal_number,
+                chain_start - log_starts[log] + failure.outcome.failed_record,
+                failure.outcome.failed_at
+            );
+        }
+    }
+
+    return total.failures.empty() ? 0 : 2;
+}
@@ -0,0 +1,373 @@
+/* klondike/tools/server.cpp
+ * by python-b5
+ *
+ * Hosts many games at once for a front end, taking commands (see
+ * sessions.cpp) over a Unix socket, or from standard input.
+ *
+ * Usage: server [-n sessions] [-s seed] [socket]
+ *   -n  most games to host at once (defaults to 16384)
+ *   -s  seed for random deals (defaults to the time)
+ *   socket  path of a Unix socket to listen on; without one, commands are
+ *           read from standard input and replies written to standard output
+ *
+ * Every connection shares the same games, so a session started on one can be
+ * played on another. Everything runs on one thread: commands are quick
+ * enough that handling them one at a time keeps up with plenty of games.
+ * Stops on SIGINT or SIGTERM, reporting how many commands were handled and
+ * how long they took.
+ */
+
+
+// project includes
+#include "../sessions.hpp"
+
+// standard libraries
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+// POSIX libraries
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+// constants
+const size_t DEFAULT_CAPACITY = 16384;
+
+
+/* A client connected over the socket, with what it has sent that hasn't been
+ * handled yet, and the replies that haven't been sent yet.
+ */
+struct Connection {
+    int socket;
+
+    std::string input;
+    std::string output;
+};
+
+/* How many commands were handled, and how long they took. */
+struct Totals {
+    unsigned long commands = 0;
+    double seconds = 0;
+    double worst = 0;
+};
+
+
+// global variables
+volatile std::sig_atomic_t stopping = 0;
+
+
+/* helper functions */
+
+/* Asks the server to stop (from a signal). */
+static void request_stop(int) {
+    stopping = 1;
+}
+
+/* Runs a command (without its newline), timing it, and appends the reply to
+ * a buffer.
+ */
+static void run_command(
+    sessions::Pool &pool, const char *command, std::string &output,
+    Totals &totals
+) {
+    char reply[sessions::MAX_REPLY];
+
+    auto start = std::chrono::steady_clock::now();
+    size_t length = sessions::execute(pool, command, reply);
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+
+    ++totals.commands;
+    totals.seconds += seconds;
+    totals.worst = std::max(totals.worst, seconds);
+
+    output.append(reply, length);
+}
+
+/* Handles every complete line a client has sent.
+ * Returns whether what is left could still become a command (if not, the
+ * client is told so, and should be disconnected).
+ */
+static bool handle_input(
+    sessions::Pool &pool, Connection &connection, Totals &totals
+) {
+    char command[sessions::MAX_COMMAND + 1];
+    size_t start = 0;
+    size_t end;
+
+    while ((end = connection.input.find('\n', start)) != std::string::npos) {
+        size_t length = end - start;
+
+        // (a carriage return is allowed before the newline)
+        if (length != 0 && connection.input[end - 1] == '\r') {
+            --length;
+        }
+
+        if (length > sessions::MAX_COMMAND) {
+            connection.output += "ERR command too long\n";
+        } else {
+            connection.input.copy(command, length, start);
+            command[length] = '\0';
+
+            run_command(pool, command, connection.output, totals);
+        }
+
+        start = end + 1;
+    }
+
+    connection.input.erase(0, start);
+
+    // (a line already too long to be a command is never buffered further,
+    // and a carriage return may still follow the longest command)
+    if (connection.input.size() > sessions::MAX_COMMAND + 1) {
+        connection.output += "ERR command too long\n";
+        return false;
+    }
+
+    return true;
+}
+
+/* Sends as much of a client's pending replies as it will take without
+ * waiting.
+ * Returns whether the connection is still open.
+ */
+static bool flush_output(Connection &connection) {
+    while (!connection.output.empty()) {
+        // (MSG_NOSIGNAL keeps a closed connection from killing the process)
+        ssize_t result = send(
+            connection.socket, connection.output.data(),
+            connection.output.size(), MSG_NOSIGNAL | MSG_DONTWAIT
+        );
+
+        if (result < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        connection.output.erase(0, result);
+    }
+
+    return true;
+}
+
+/* Serves commands from standard input until it ends. */
+static void serve_stdin(sessions::Pool &pool, Totals &totals) {
+    char line[sessions::MAX_COMMAND + 2];
+    std::string output;
+
+    while (!stopping && std::fgets(line, sizeof(line), stdin) != NULL) {
+        size_t length = std::strlen(line);
+
+        if (line[length - 1] != '\n' && !std::feof(stdin)) {
+            // skip the rest of a line that's too long
+            int c;
+
+            while ((c = std::getchar()) != '\n' && c != EOF) {}
+
+            output = "ERR command too long\n";
+        } else {
+            line[std::strcspn(line, "\r\n")] = '\0';
+
+            output.clear();
+            run_command(pool, line, output, totals);
+        }
+
+        std::fwrite(output.data(), 1, output.size(), stdout);
+        std::fflush(stdout);
+    }
+}
+
+/* Serves commands over a Unix socket until stopped.
+ * Returns whether it could listen.
+ */
+static bool serve_socket(
+    sessions::Pool &pool, const char *path, Totals &totals
+) {
+    struct sockaddr_un address;
+
+    if (std::strlen(path) >= sizeof(address.sun_path)) {
+        std::fprintf(stderr, "socket path is too long\n");
+        return false;
+    }
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path);
+
+    // (a socket left behind by a server that was killed would stop a new
+    // one from binding)
+    unlink(path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (
+        listener < 0
+        || bind(
+            listener, reinterpret_cast<struct sockaddr *>(&address),
+            sizeof(address)
+        ) != 0
+        || listen(listener, 64) != 0
+    ) {
+        std::fprintf(stderr, "couldn't listen on %s\n", path);
+        return false;
+    }
+
+    std::vector<Connection> connections;
+    std::vector<struct pollfd> polls;
+
+    while (!stopping) {
+        polls.resize(connections.size() + 1);
+
+        polls[0].fd = listener;
+        polls[0].events = POLLIN;
+
+        for (size_t i = 0; i < connections.size(); ++i) {
+            polls[i + 1].fd = connections[i].socket;
+            polls[i + 1].events = POLLIN;
+
+            // (replies a client isn't reading yet are sent once it can take
+            // them)
+            if (!connections[i].output.empty()) {
+                polls[i + 1].events |= POLLOUT;
+            }
+        }
+
+        if (poll(polls.data(), polls.size(), -1) < 0) {
+            continue;
+        }
+
+        // handle what clients have sent
+        for (size_t i = 0; i < connections.size(); ++i) {
+            Connection &connection = connections[i];
+            bool open = true;
+
+            if (polls[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                char data[65536];
+                ssize_t result = recv(connection.socket, data, sizeof(data), 0);
+
+                if (result > 0) {
+                    connection.input.append(data, result);
+
+                    // (a client sending something too long to be a command
+                    // is disconnected, after being told why if it can take
+                    // it)
+                    if (!handle_input(pool, connection, totals)) {
+                        flush_output(connection);
+                        open = false;
+                    }
+                } else {
+                    open = false;
+                }
+            }
+
+            if (open) {
+                open = flush_output(connection);
+            }
+
+            if (!open) {
+                close(connection.socket);
+                connection.socket = -1;
+            }
+        }
+
+        connections.erase(
+            std::remove_if(
+                connections.begin(), connections.end(),
+                [](const Connection &connection) {
+                    return connection.socket < 0;
+                }
+            ),
+            connections.end()
+        );
+
+        // welcome new clients
+        if (polls[0].revents & POLLIN) {
+            int socket_ = accept(listener, NULL, NULL);
+
+            if (socket_ >= 0) {
+                Connection connection;
+                connection.socket = socket_;
+
+                connections.push_back(connection);
+            }
+        }
+    }
+
+    for (Connection &connection : connections) {
+        close(connection.socket);
+    }
+
+    close(listener);
+    unlink(path);
+
+    return true;
+}
+
+
+int main(int argc, char *argv[]) {
+    // parse arguments
+    size_t capacity = DEFAULT_CAPACITY;
+    uint64_t seed = std::time(NULL);
+
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            capacity = std::strtoull(argv[++i], NULL, 10);
+        } else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], NULL, 10);
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() > 1 || capacity == 0) {
+        std::fprintf(
+            stderr, "usage: %s [-n sessions] [-s seed] [socket]\n", argv[0]
+        );
+        return 1;
+    }
+
+    sessions::Pool pool(capacity, seed);
+    Totals totals;
+
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+
+    if (positional.empty()) {
+        serve_stdin(pool, totals);
+    } else {
+        std::fprintf(
+            stderr, "serving up to %zu games (%zu bytes each) on %s\n",
+            pool.get_capacity(), sizeof(sessions::Session), positional[0]
+        );
+
+        if (!serve_socket(pool, positional[0], totals)) {
+            return 1;
+        }
+    }
+
+    std::fprintf(
+        stderr, "%lu commands, %.2f us each on average (%.2f us at worst); "
+                "%zu games still open\n",
+        totals.commands,
+        totals.commands != 0 ? totals.seconds / totals.commands * 1e6 : 0.0,
+        totals.worst * 1e6, pool.get_active_count()
+    );
+
+    return 0;
+}
@@ -0,0 +1,439 @@
+/* klondike/tools/simulate.cpp
+ * by python-b5
+ *
+ * Plays a range of deals with automated players of varying skill, and reports
+ * how well each one does. Deals are spread across all cores.
+ *
+ * Usage: simulate [-j threads] [-p policies] [-m move limit] [-d depth]
+ *                 [-r rules] [-i index] first count
+ *   -j  number of threads to use (defaults to one per core)
+ *   -p  comma-separated policies to simulate (defaults to all of them):
+ *         random     plays any legal move
+ *         greedy     plays the most obviously useful move, foundations first
+ *         lookahead  plays the hint engine's move, looking a few moves ahead
+ *   -m  most moves to play in one game (defaults to 2000)
+ *   -d  how many moves ahead the lookahead policy looks (defaults to 3)
+ *   -r  the rules to play with: the draw count, optionally followed by a
+ *       slash and the pass limit (e.g. "1" or "3/3"; defaults to "3")
+ *   -i  deal index to compare the results with, so win rates can be given
+ *       out of the deals the solver could win (it must have been built for
+ *       the same rules)
+ *
+ * Every policy plays each deal the same way no matter how the deals are split
+ * between threads, so runs are reproducible.
+ */
+
+
+// project includes
+#include "../engine.hpp"
+#include "../hint.hpp"
+#include "../deal_index.hpp"
+
+// standard libraries
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+// using declarations
+using namespace engine;
+
+
+// constants
+const uint32_t BATCH_SIZE = 256;
+
+// (a game ends once it goes this long without getting any closer to being
+// won, since the player must be going around in circles)
+const int STALL_LIMIT = 200;
+
+// (scores are the number of cards on the foundations, grouped in fours, with
+// a group of its own for won games)
+const int HISTOGRAM_SIZE = 14;
+
+// (the lookahead policy is limited by depth, not time, so it stays
+// reproducible)
+const double LOOKAHEAD_BUDGET = 10.0;
+
+
+/* The ways moves can be picked. */
+enum Policy {
+    RANDOM,
+    GREEDY,
+    LOOKAHEAD,
+    POLICY_COUNT
+};
+
+const char *POLICY_NAMES[POLICY_COUNT] = {"random", "greedy", "lookahead"};
+
+
+/* Totals for one policy, collected by one thread. */
+struct Totals {
+    size_t games = 0;
+    size_t wins = 0;
+
+    uint64_t moves = 0;
+    uint64_t won_moves = 0;
+
+    // only counted when there is a deal index to compare with
+    size_t winnable = 0;
+    size_t winnable_wins = 0;
+
+    size_t histogram[HISTOGRAM_SIZE] = {};
+
+    void add(const Totals &other) {
+        games += other.games;
+        wins += other.wins;
+        moves += other.moves;
+        won_moves += other.won_moves;
+        winnable += other.winnable;
+        winnable_wins += other.winnable_wins;
+
+        for (int i = 0; i < HISTOGRAM_SIZE; ++i) {
+            histogram[i] += other.histogram[i];
+        }
+    }
+};
+
+
+/* helper functions */
+
+/* Counts the cards on the foundations. */
+static int foundation_cards(const State &state) {
+    int count = 0;
+
+    for (const Foundation &foundation : state.foundations) {
+        count += foundation.next;
+    }
+
+    return count;
+}
+
+/* Picks the next move for a policy.
+ * Returns whether there was one.
+ */
+template <typename V>
+static bool pick_move(
+    Policy policy, const State &state, hint::Hinter &hinter,
+    int lookahead_depth, uint64_t &seed, Move &move
+) {
+    Move moves[MAX_MOVES];
+
+    switch (policy) {
+        case RANDOM: {
+            int count = legal_moves<V>(state, moves);
+
+            if (count == 0) {
+                return false;
+            }
+
+            move = moves[next_random(seed) % count];
+            return true;
+        }
+
+        case GREEDY: {
+            Rules rules = {V::DRAW_COUNT, V::PASS_LIMIT};
+            return hint::greedy_move(state, rules, move);
+        }
+
+        default: {
+            if (find_safe_move(state, move)) {
+                return true;
+            }
+
+            Rules rules = {V::DRAW_COUNT, V::PASS_LIMIT};
+            hint::Hint hint = hinter.find(
+                state, rules, LOOKAHEAD_BUDGET, lookahead_depth
+            );
+
+            move = hint.move;
+            return hint.found;
+        }
+    }
+}
+
+/* Plays a dealt game with a policy until it is won, stuck or stalled.
+ * Returns the number of moves made.
+ */
+template <typename V>
+static int play_deal(
+    Policy policy, State &state, hint::Hinter &hinter, int lookahead_depth,
+    uint64_t seed, int move_limit
+) {
+    int moves = 0;
+    int best_progress = hint::progress(state);
+    int since_progress = 0;
+
+    Move move;
+
+    while (
+        moves < move_limit && since_progress < STALL_LIMIT && !won(state)
+        && pick_move<V>(policy, state, hinter, lookahead_depth, seed, move)
+    ) {
+        apply<V>(state, move);
+        ++moves;
+
+        int current = hint::progress(state);
+
+        if (current > best_progress) {
+            best_progress = current;
+            since_progress = 0;
+        } else {
+            ++since_progress;
+        }
+    }
+
+    return moves;
+}
+
+
+int main(int argc, char *argv[]) {
+    // parse arguments
+    unsigned int thread_count = std::thread::hardware_concurrency();
+    bool enabled[POLICY_COUNT] = {true, true, true};
+    int move_limit = 2000;
+    int lookahead_depth = 3;
+    Rules rules = DEFAULT_RULES;
+    const char *index_path = NULL;
+
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            std::string list = argv[++i];
+
+            for (int p = 0; p < POLICY_COUNT; ++p) {
+                enabled[p] = (
+                    "," + list + ","
+                ).find(std::string(",") + POLICY_NAMES[p] + ",")
+                != std::string::npos;
+            }
+        } else if (std::strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            move_limit = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            lookahead_depth = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (!parse_rules(argv[++i], rules)) {
+                std::fprintf(stderr, "unsupported rules\n");
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            index_path = argv[++i];
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() != 2) {
+        std::fprintf(
+            stderr, "usage: %s [-j threads] [-p policies] [-m move limit] "
+                    "[-d depth] [-r rules] [-i index] first count\n",
+            argv[0]
+        );
+        return 1;
+    }
+
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    uint32_t first_deal = std::strtoul(positional[0], NULL, 10);
+    uint32_t deal_count = std::strtoul(positional[1], NULL, 10);
+
+    DealIndex index;
+
+    if (index_path != NULL && !index.open(index_path)) {
+        std::fprintf(stderr, "couldn't open %s\n", index_path);
+        return 1;
+    }
+
+    // (an index built for other rules says nothing about which deals can be
+    // won with these)
+    if (index_path != NULL) {
+        Rules index_rules = index.get_rules();
+
+        if (
+            index_rules.draw_count != rules.draw_count
+            || index_rules.pass_limit != rules.pass_limit
+        ) {
+            std::fprintf(
+                stderr, "%s was built for different rules\n", index_path
+            );
+            return 1;
+        }
+    }
+
+    // simulate each policy in turn
+    std::printf(
+        "%-10s %10s %10s %9s %10s %10s %12s\n",
+        "policy", "games", "wins", "win rate", "avg moves", "won avg",
+        "moves/s"
+    );
+
+    Totals results[POLICY_COUNT];
+
+    for (int p = 0; p < POLICY_COUNT; ++p) {
+        if (!enabled[p]) {
+            continue;
+        }
+
+        Policy policy = static_cast<Policy>(p);
+
+        // play deals in batches, with each thread taking the next batch when
+        // it is done with its last one
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<Totals> totals(thread_count);
+        std::atomic<uint32_t> next_batch(0);
+        std::vector<std::thread> threads;
+
+        for (unsigned int t = 0; t < thread_count; ++t) {
+            threads.push_back(std::thread([&, t]() {
+                Totals &thread_totals = totals[t];
+                hint::Hinter hinter;
+                State state;
+
+                for (;;) {
+                    uint64_t first = static_cast<uint64_t>(
+                        next_batch.fetch_add(1)
+                    ) * BATCH_SIZE;
+
+                    if (first >= deal_count) {
+                        break;
+                    }
+
+                    uint32_t last = std::min<uint64_t>(
+                        first + BATCH_SIZE, deal_count
+                    );
+
+                    for (uint32_t i = first; i < last; ++i) {
+                        uint32_t deal_number = first_deal + i;
+                        deal(state, deal_number);
+
+                        // (each policy gets its own random moves, but the
+                        // same ones on every run)
+                        uint64_t seed = (
+                            static_cast<uint64_t>(deal_number) << 8
+                        ) | p;
+
+                        int moves = with_variant(rules, [&](auto variant) {
+                            return play_deal<decltype(variant)>(
+                                policy, state, hinter, lookahead_depth, seed,
+                                move_limit
+                            );
+                        });
+
+                        // add to totals
+                        bool game_won = won(state);
+                        int cards = foundation_cards(state);
+
+                        ++thread_totals.games;
+                        thread_totals.moves += moves;
+                        ++thread_totals.histogram[
+                            game_won ? HISTOGRAM_SIZE - 1 : cards / 4
+                        ];
+
+                        if (game_won) {
+                            ++thread_totals.wins;
+                            thread_totals.won_moves += moves;
+                        }
+
+                        if (
+                            index_path != NULL && index.contains(deal_number)
+                            && index.is_winnable(deal_number)
+                        ) {
+                            ++thread_totals.winnable;
+                            thread_totals.winnable_wins += game_won;
+                        }
+                    }
+                }
+            }));
+        }
+
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start
+        ).count();
+
+        Totals &result = results[p];
+
+        for (const Totals &thread_totals : totals) {
+            result.add(thread_totals);
+        }
+
+        std::printf(
+            "%-10s %10zu %10zu %8.2f%% %10.1f %10.1f %12.0f\n",
+            POLICY_NAMES[p], result.games, result.wins,
+            100.0 * result.wins / std::max<size_t>(result.games, 1),
+            static_cast<double>(result.moves)
+            / std::max<size_t>(result.games, 1),
+            static_cast<double>(result.won_moves)
+            / std::max<size_t>(result.wins, 1),
+            result.moves / std::max(seconds, 1e-9)
+        );
+    }
+
+    // print score distributions
+    std::printf("\ncards on the foundations at the end (%% of games):\n");
+    std::printf("%-10s", "policy");
+
+    for (int i = 0; i + 1 < HISTOGRAM_SIZE; ++i) {
+        char label[8];
+        std::snprintf(label, sizeof(label), "%d-%d", 4 * i, 4 * i + 3);
+        std::printf(" %6s", label);
+    }
+
+    std::printf(" %6s\n", "52");
+
+    for (int p = 0; p < POLICY_COUNT; ++p) {
+        if (!enabled[p]) {
+            continue;
+        }
+
+        std::printf("%-10s", POLICY_NAMES[p]);
+
+        for (int i = 0; i < HISTOGRAM_SIZE; ++i) {
+            std::printf(
+                " %6.2f",
+                100.0 * results[p].histogram[i]
+                / std::max<size_t>(results[p].games, 1)
+            );
+        }
+
+        std::printf("\n");
+    }
+
+    // compare with the solver
+    if (index_path != NULL) {
+        std::printf("\nwins out of the deals the solver could win:\n");
+
+        for (int p = 0; p < POLICY_COUNT; ++p) {
+            if (!enabled[p]) {
+                continue;
+            }
+
+            std::printf(
+                "%-10s %zu/%zu (%.2f%%)\n",
+                POLICY_NAMES[p], results[p].winnable_wins, results[p].winnable,
+                100.0 * results[p].winnable_wins
+                / std::max<size_t>(results[p].winnable, 1)
+            );
+        }
+    }
+
+    return 0;
+}
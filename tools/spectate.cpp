@@ -0,0 +1,436 @@
+/* klondike/tools/spectate.cpp
+ * by python-b5
+ *
+ * Shows many games being played at once, tiled in one window at a reduced
+ * size: each deal is solved in the background, then played out along the
+ * solver's solution (or, if it couldn't find one, by a greedy bot), with the
+ * next move highlighted. Finished games are replaced by the next deal.
+ *
+ * Usage: spectate [-g games] [-r rules] [-n node limit] [-j threads]
+ *                 [-s speed] [-d deal] [fps]
+ *   -g  number of games to show at once (defaults to 16; at most 64)
+ *   -r  the rules to play with: the draw count, optionally followed by a
+ *       slash and the pass limit (e.g. "1" or "3/3"; defaults to "3")
+ *   -n  most positions the solver searches per deal (defaults to the
+ *       solver's usual limit)
+ *   -j  number of threads solving deals (defaults to one per core, less the
+ *       one drawing)
+ *   -s  moves each game makes per second (defaults to 10)
+ *   -d  the first deal to play (defaults to a random one); the rest follow
+ *       in order
+ *   fps  refresh rate (defaults to 60)
+ *
+ * Every card on screen is drawn from one atlas in a single batch, so even
+ * thousands of cards take one draw call a frame. Must be run from the game's
+ * directory, since the card images are loaded from assets/.
+ */
+
+
+// project includes
+#include "../wrapper.hpp"
+#include "../board.hpp"
+#include "../engine.hpp"
+#include "../solver.hpp"
+#include "../hint.hpp"
+
+// standard libraries
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+// external libraries
+#include <SDL2/SDL.h>
+
+
+// using declarations
+using namespace engine;
+
+
+// constants
+const int MAX_GAMES = 64;
+
+// (the most space the tables can take up together, so the window fits on a
+// typical screen)
+const int MAX_WIDTH = 1600;
+const int MAX_HEIGHT = 900;
+
+// (a finished game stays up this long before the next deal replaces it)
+const double HOLD_SECONDS = 2.0;
+
+// (the greedy bot gives up once it goes this long without getting any closer
+// to winning, since it must be going around in circles)
+const int STALL_LIMIT = 200;
+
+
+/* One of the games being shown. */
+struct Table {
+    uint32_t deal;
+    State state;
+
+    // set by a solver thread once result holds the deal's solution (until
+    // then, the position is only read)
+    std::atomic<bool> solved;
+    solver::Result result;
+    size_t next_solution_move;
+
+    // the move about to be made, shown as a hint
+    bool has_next;
+    Move next;
+
+    int best_progress;
+    int since_progress;
+
+    // frames left until the next deal, once the game is finished
+    bool finished;
+    int hold;
+};
+
+/* The deals waiting to be solved, shared with the solver threads. */
+struct Jobs {
+    std::mutex mutex;
+    std::condition_variable wake;
+
+    std::deque<Table *> queue;
+    bool stopping = false;
+};
+
+
+/* helper functions */
+
+/* Picks the next move for a table: the next one in the solution, if the
+ * solver found one, or otherwise the greedy bot's.
+ * Returns whether there was one.
+ */
+static bool pick_move(const Rules &rules, Table &table, Move &move) {
+    const std::vector<Move> &solution = table.result.solution;
+
+    if (table.next_solution_move < solution.size()) {
+        move = solution[table.next_solution_move++];
+        return true;
+    }
+
+    if (table.since_progress >= STALL_LIMIT) {
+        return false;
+    }
+
+    return hint::greedy_move(table.state, rules, move);
+}
+
+/* Deals a new game onto a table and queues it to be solved. */
+static void start_deal(Table &table, uint32_t deal_number, Jobs &jobs) {
+    table.deal = deal_number;
+    deal(table.state, deal_number);
+
+    table.solved.store(false);
+    table.next_solution_move = 0;
+    table.has_next = false;
+
+    table.best_progress = hint::progress(table.state);
+    table.since_progress = 0;
+
+    table.finished = false;
+    table.hold = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(jobs.mutex);
+        jobs.queue.push_back(&table);
+    }
+
+    jobs.wake.notify_one();
+}
+
+/* Solves queued deals until told to stop. */
+static void solve_deals(
+    Jobs &jobs, const Rules &rules, size_t node_limit,
+    const std::atomic<bool> &cancel
+) {
+    solver::Solver solver;
+
+    while (true) {
+        Table *table;
+
+        {
+            std::unique_lock<std::mutex> lock(jobs.mutex);
+            jobs.wake.wait(lock, [&] {
+                return jobs.stopping || !jobs.queue.empty();
+            });
+
+            if (jobs.stopping) {
+                return;
+            }
+
+            table = jobs.queue.front();
+            jobs.queue.pop_front();
+        }
+
+        table->result = solver.solve(table->state, node_limit, &cancel, rules);
+        table->solved.store(true, std::memory_order_release);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    // parse arguments
+    int game_count = 16;
+    Rules rules = DEFAULT_RULES;
+    size_t node_limit = solver::DEFAULT_NODE_LIMIT;
+    unsigned int thread_count = std::max(
+        std::thread::hardware_concurrency(), 2u
+    ) - 1;
+    double speed = 10;
+    int fps = 60;
+
+    std::srand(std::time(NULL));
+    uint32_t next_deal = std::rand();
+
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            game_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (!parse_rules(argv[++i], rules)) {
+                std::fprintf(stderr, "unsupported rules\n");
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            node_limit = std::strtoull(argv[++i], NULL, 10);
+        } else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            speed = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            next_deal = std::strtoul(argv[++i], NULL, 10);
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() > 1 || game_count < 1 || game_count > MAX_GAMES) {
+        std::fprintf(
+            stderr, "usage: %s [-g games (1-%d)] [-r rules] [-n node limit] "
+                    "[-j threads] [-s speed] [-d deal] [fps]\n",
+            argv[0], MAX_GAMES
+        );
+        return 1;
+    }
+
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    if (positional.size() == 1) {
+        fps = std::atoi(positional[0]);
+    }
+
+    // tile the games in a grid, as large as fits
+    int columns = 1;
+
+    while (columns * columns < game_count) {
+        ++columns;
+    }
+
+    int rows = (game_count + columns - 1) / columns;
+
+    float scale = std::min(
+        1.0f, std::min(
+            static_cast<float>(MAX_WIDTH) / (columns * board::WIDTH),
+            static_cast<float>(MAX_HEIGHT) / (rows * board::HEIGHT)
+        )
+    );
+
+    float table_width = board::WIDTH * scale;
+    float table_height = board::HEIGHT * scale;
+
+    if (
+        !wrapper::initialize(
+            static_cast<int>(columns * table_width),
+            static_cast<int>(rows * table_height), fps, "spectate", "icon.bmp"
+        )
+    ) {
+        std::fprintf(stderr, "couldn't initialize: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    if (!board::load_atlas()) {
+        std::fprintf(stderr, "couldn't load the card images\n");
+        wrapper::quit();
+
+        return 1;
+    }
+
+    wrapper::Batch batch(board::atlas);
+
+    // start solving
+    Jobs jobs;
+    std::atomic<bool> cancel(false);
+    std::vector<std::thread> threads;
+
+    for (unsigned int t = 0; t < thread_count; ++t) {
+        threads.emplace_back(
+            solve_deals, std::ref(jobs), std::cref(rules), node_limit,
+            std::cref(cancel)
+        );
+    }
+
+    std::vector<Table> tables(game_count);
+
+    for (Table &table : tables) {
+        start_deal(table, next_deal++, jobs);
+    }
+
+    // each game makes a move every so many frames, with the games taking
+    // turns so they don't all move on the same frame
+    int move_interval = std::max(1, static_cast<int>(fps / speed + 0.5));
+    int hold_frames = static_cast<int>(HOLD_SECONDS * fps);
+
+    unsigned long frame = 0;
+    size_t finished = 0;
+    size_t won_games = 0;
+
+    size_t total_images = 0;
+    double total_draw = 0;
+    double worst_draw = 0;
+
+    auto last_title = std::chrono::steady_clock::now();
+    unsigned long last_title_frame = 0;
+
+    do {
+        auto frame_start = std::chrono::steady_clock::now();
+
+        // play the games
+        for (int i = 0; i < game_count; ++i) {
+            Table &table = tables[i];
+
+            if (table.finished) {
+                if (--table.hold <= 0) {
+                    start_deal(table, next_deal++, jobs);
+                }
+
+                continue;
+            }
+
+            if (!table.solved.load(std::memory_order_acquire)) {
+                continue;
+            }
+
+            if (!table.has_next) {
+                table.has_next = pick_move(rules, table, table.next);
+            } else if ((frame + i) % move_interval == 0) {
+                apply(rules, table.state, table.next);
+
+                int current = hint::progress(table.state);
+
+                if (current > table.best_progress) {
+                    table.best_progress = current;
+                    table.since_progress = 0;
+                } else {
+                    ++table.since_progress;
+                }
+
+                table.has_next = !won(table.state)
+                                 && pick_move(rules, table, table.next);
+            } else {
+                continue;
+            }
+
+            if (!table.has_next) {
+                table.finished = true;
+                table.hold = hold_frames;
+
+                ++finished;
+                won_games += won(table.state);
+            }
+        }
+
+        // draw them, all in one batch
+        wrapper::clear(board::BACKGROUND);
+
+        for (int i = 0; i < game_count; ++i) {
+            board::Overlay overlay;
+            overlay.hinting = tables[i].has_next;
+            overlay.hint = tables[i].next;
+
+            board::draw(
+                tables[i].state, overlay,
+                board::Target(
+                    batch, i % columns * table_width,
+                    i / columns * table_height, scale
+                )
+            );
+        }
+
+        total_images += batch.get_size();
+        batch.flush();
+
+        double draw_time = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - frame_start
+        ).count();
+
+        total_draw += draw_time;
+        worst_draw = std::max(worst_draw, draw_time);
+
+        ++frame;
+
+        // show how it's going in the title about once a second
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(
+            now - last_title
+        ).count();
+
+        if (elapsed >= 1) {
+            char title[128];
+            std::snprintf(
+                title, sizeof(title),
+                "spectate - %d games, %zu of %zu won - %.0f fps", game_count,
+                won_games, finished, (frame - last_title_frame) / elapsed
+            );
+            wrapper::set_title(title);
+
+            last_title = now;
+            last_title_frame = frame;
+        }
+    } while (
+        !wrapper::update() && !wrapper::key_pressed(SDL_SCANCODE_ESCAPE)
+    );
+
+    // stop solving
+    cancel.store(true);
+
+    {
+        std::lock_guard<std::mutex> lock(jobs.mutex);
+        jobs.stopping = true;
+    }
+
+    jobs.wake.notify_all();
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    std::printf(
+        "%zu of %zu games won; %lu frames, %.0f cards each, drawn in %.2f ms "
+        "on average (%.2f ms at worst)\n",
+        won_games, finished, frame,
+        static_cast<double>(total_images) / frame, total_draw / frame,
+        worst_draw
+    );
+
+    wrapper::quit();
+
+    return 0;
+}
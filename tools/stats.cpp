@@ -0,0 +1,298 @@
+/* klondike/tools/stats.cpp
+ * by python-b5
+ *
+ * Works out statistics from a log of games played (see stats.cpp): how many
+ * were won, winning and losing streaks, and how long winning took, for each
+ * variant of the rules and overall.
+ *
+ * Usage: stats [-r rules] [-d days] log
+ *   -r  only count games played with some rules: the draw count, optionally
+ *       followed by a slash and the pass limit (e.g. "1" or "3/3")
+ *   -d  only count games finished in the last given number of days
+ *
+ * The log is read straight from a mapping in a single pass, keeping only
+ * running totals (times are counted into a histogram rather than kept, so
+ * percentiles don't need a sort), so even millions of games take moments.
+ */
+
+
+// project includes
+#include "../engine.hpp"
+#include "../stats.hpp"
+#include "../mapped_file.hpp"
+
+// standard libraries
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+
+// using declarations
+using namespace engine;
+
+
+// constants
+// (winning times are counted to the second, with anything over an hour
+// counted as an hour)
+const uint32_t MAX_SECONDS = 3600;
+
+
+/* Running totals for some set of games. */
+struct Summary {
+    uint64_t games = 0;
+    uint64_t won = 0;
+
+    uint64_t moves = 0;
+    uint64_t winning_moves = 0;
+
+    // the current streak is of wins if positive, and of losses if negative
+    int64_t streak = 0;
+    int64_t longest_wins = 0;
+    int64_t longest_losses = 0;
+
+    uint32_t fastest = UINT32_MAX;
+    std::vector<uint64_t> winning_times;
+
+    Summary(): winning_times(MAX_SECONDS + 1, 0) {}
+};
+
+
+/* helper functions */
+
+/* Counts a game into a summary. */
+static void count(Summary &summary, const stats::GameResult &result) {
+    ++summary.games;
+    summary.moves += result.moves;
+
+    if (result.won) {
+        ++summary.won;
+        summary.winning_moves += result.moves;
+
+        summary.streak = summary.streak > 0 ? summary.streak + 1 : 1;
+        summary.longest_wins = std::max(summary.longest_wins, summary.streak);
+
+        summary.fastest = std::min(summary.fastest, result.duration);
+        ++summary.winning_times[
+            std::min(result.duration / 1000, MAX_SECONDS)
+        ];
+    } else {
+        summary.streak = summary.streak < 0 ? summary.streak - 1 : -1;
+        summary.longest_losses = std::max(
+            summary.longest_losses, -summary.streak
+        );
+    }
+}
+
+/* Returns a percentile of the winning times in a summary, in seconds. */
+static uint32_t percentile(const Summary &summary, double fraction) {
+    uint64_t target = static_cast<uint64_t>(fraction * (summary.won - 1));
+    uint64_t seen = 0;
+
+    for (uint32_t seconds = 0; seconds < MAX_SECONDS; ++seconds) {
+        seen += summary.winning_times[seconds];
+
+        if (seen > target) {
+            return seconds;
+        }
+    }
+
+    return MAX_SECONDS;
+}
+
+/* Formats a time given in seconds as minutes and seconds. */
+static std::string format_time(uint32_t seconds) {
+    char text[32];
+
+    std::snprintf(
+        text, sizeof(text), "%s%u:%02u", seconds >= MAX_SECONDS ? ">" : "",
+        seconds / 60, seconds % 60
+    );
+
+    return text;
+}
+
+/* Prints a summary, under a heading. */
+static void print_summary(const char *heading, const Summary &summary) {
+    std::printf(
+        "%s: %llu game(s), %llu won (%.1f%%)\n", heading,
+        static_cast<unsigned long long>(summary.games),
+        static_cast<unsigned long long>(summary.won),
+        100.0 * summary.won / summary.games
+    );
+
+    std::printf(
+        "  streaks: current %lld %s, longest %lld win(s), "
+        "longest %lld loss(es)\n",
+        static_cast<long long>(std::llabs(summary.streak)),
+        summary.streak >= 0 ? "win(s)" : "loss(es)",
+        static_cast<long long>(summary.longest_wins),
+        static_cast<long long>(summary.longest_losses)
+    );
+
+    std::printf(
+        "  average moves: %.1f", static_cast<double>(summary.moves)
+                                 / summary.games
+    );
+
+    if (summary.won == 0) {
+        std::printf("\n");
+        return;
+    }
+
+    std::printf(
+        " (%.1f in won games)\n",
+        static_cast<double>(summary.winning_moves) / summary.won
+    );
+
+    std::printf(
+        "  winning times: fastest %s, median %s, 90th percentile %s, "
+        "slowest %s\n",
+        format_time(summary.fastest / 1000).c_str(),
+        format_time(percentile(summary, 0.5)).c_str(),
+        format_time(percentile(summary, 0.9)).c_str(),
+        format_time(percentile(summary, 1)).c_str()
+    );
+}
+
+
+int main(int argc, char *argv[]) {
+    // parse arguments
+    bool filter_rules = false;
+    Rules rules = DEFAULT_RULES;
+    long days = -1;
+
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (!parse_rules(argv[++i], rules)) {
+                std::fprintf(stderr, "unsupported rules\n");
+                return 1;
+            }
+
+            filter_rules = true;
+        } else if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            days = std::atol(argv[++i]);
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() != 1) {
+        std::fprintf(
+            stderr, "usage: %s [-r rules] [-d days] log\n", argv[0]
+        );
+        return 1;
+    }
+
+    MappedFile file;
+
+    if (!file.open(positional[0])) {
+        std::fprintf(stderr, "couldn't open %s\n", positional[0]);
+        return 1;
+    }
+
+    size_t record_count;
+
+    if (!stats::count_records(file.get_data(), file.get_size(), record_count)) {
+        std::fprintf(stderr, "%s isn't a statistics log\n", positional[0]);
+        return 1;
+    }
+
+    // games older than this are skipped
+    uint32_t cutoff = 0;
+
+    if (days >= 0) {
+        int64_t now = std::time(NULL);
+        cutoff = static_cast<uint32_t>(std::max<int64_t>(
+            now - days * 86400, 0
+        ));
+    }
+
+    // scan the log, summarizing each variant separately (indexed by the byte
+    // the rules are packed into) as well as all of them together
+    auto start = std::chrono::steady_clock::now();
+
+    Summary total;
+    std::unique_ptr<Summary> variants[256];
+
+    const uint8_t *record = file.get_data() + stats::HEADER_SIZE;
+
+    for (size_t i = 0; i < record_count; ++i) {
+        stats::GameResult result = stats::decode(record);
+        record += stats::RECORD_SIZE;
+
+        if (
+            result.finished_at < cutoff
+            || (filter_rules && (
+                result.rules.draw_count != rules.draw_count
+                || result.rules.pass_limit != rules.pass_limit
+            ))
+        ) {
+            continue;
+        }
+
+        std::unique_ptr<Summary> &variant = variants[
+            result.rules.draw_count | result.rules.pass_limit << 4
+        ];
+
+        if (!variant) {
+            variant.reset(new Summary());
+        }
+
+        count(*variant, result);
+        count(total, result);
+    }
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+
+    if (total.games == 0) {
+        std::printf("no games found\n");
+        return 0;
+    }
+
+    // report each variant played, then (if there was more than one) the total
+    size_t variant_count = 0;
+
+    for (int i = 0; i < 256; ++i) {
+        if (!variants[i]) {
+            continue;
+        }
+
+        int draw_count = i & 0xF;
+        int pass_limit = i >> 4;
+
+        std::string heading = "draw " + std::to_string(draw_count);
+
+        if (pass_limit != UNLIMITED_PASSES) {
+            heading += ", " + std::to_string(pass_limit)
+                       + (pass_limit == 1 ? " pass" : " passes");
+        }
+
+        print_summary(heading.c_str(), *variants[i]);
+        ++variant_count;
+    }
+
+    if (variant_count > 1) {
+        print_summary("all variants", total);
+    }
+
+    std::fprintf(
+        stderr, "scanned %zu game(s) in %.1f ms\n", record_count,
+        seconds * 1000
+    );
+
+    return 0;
+}
@@ -0,0 +1,516 @@
+/* klondike/tools/stress.cpp
+ * by python-b5
+ *
+ * Plays random legal moves on as many deals as it can get through in a given
+ * time, on all cores, checking the engine's invariants as it goes. Any game
+ * that breaks one is cut down to the fewest moves that still break it, so it
+ * can be stepped through by hand.
+ *
+ * Usage: stress [-j threads] [-t seconds] [-r rules] [-m moves] [-s seed]
+ *   -j  number of threads to use (defaults to one per core)
+ *   -t  how long to run for, in seconds (defaults to 10)
+ *   -r  the rules to play with: the draw count, optionally followed by a
+ *       slash and the pass limit (e.g. "1" or "3/3"; defaults to cycling
+ *       through every variant, one game each)
+ *   -m  random steps to take in each game before taking back every move
+ *       left (defaults to 300)
+ *   -s  the first seed (defaults to 1)
+ *
+ * Each seed is both a deal number and the seed for the moves played on it,
+ * so any game can be played again exactly. Along the way, one move in eight
+ * is taken back instead of a new one being played, and at the end of the
+ * game every move left is taken back, so every move is undone exactly once.
+ *
+ * The invariants checked are that:
+ *   - all 52 cards are somewhere, once each
+ *   - the foundations hold valid runs
+ *   - face-down cards only sit below face-up ones, and face-up cards form a
+ *     run of alternating colors
+ *   - the stock, waste and taken cards fit, and no more passes were made
+ *     than allowed
+ *   - every move the generator offers is legal
+ *   - undoing a move gives back the position from before it (everything the
+ *     position's hash covers is compared directly, which is quicker)
+ * The last two are checked on every step. The full check of a position costs
+ * more than the step itself, so random games only make it every
+ * CHECK_INTERVAL steps and on the position they end with; a game that breaks
+ * something is replayed checking every step, so it is still cut down to the
+ * step that broke it. (A move that breaks a position and is taken back before
+ * the next check goes unnoticed, so a rare bug can take longer to turn up.)
+ */
+
+
+// project includes
+#include "../engine.hpp"
+
+// standard libraries
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+// using declarations
+using namespace engine;
+
+
+// constants
+const uint32_t BATCH_SIZE = 16;
+const int UNDO_CHANCE = 8;
+const int CHECK_INTERVAL = 16;
+
+
+/* One step of a game: a move, or taking back the last move still standing. */
+struct Step {
+    Move move;
+    bool undo;
+};
+
+/* A game that broke an invariant, and the steps that got it there. */
+struct Failure {
+    uint64_t seed;
+    Rules rules;
+
+    const char *problem;
+    std::vector<Step> steps;
+};
+
+/* Totals collected by one thread. */
+struct Totals {
+    uint64_t games = 0;
+    uint64_t moves = 0;
+    uint64_t undos = 0;
+};
+
+/* A move that can be taken back, and the position from before it. */
+struct Played {
+    Undo undo;
+    State before;
+};
+
+
+/* helper functions */
+
+/* Returns the rules a seed is played with: the ones given, or (if none were)
+ * each variant in turn.
+ */
+static Rules seed_rules(uint64_t seed, bool fixed, const Rules &rules) {
+    return fixed ? rules : VARIANTS[seed % VARIANT_COUNT];
+}
+
+/* Plays a move (if it is legal) or takes one back, checking that an undo
+ * restored the position, and (if asked to) that a move left a valid one.
+ * Returns the invariant broken, if any; an illegal move or an undo with
+ * nothing to take back sets invalid instead.
+ */
+template <typename V>
+static const char *take_step(
+    State &state, std::vector<Played> &played, const Step &step, bool check,
+    bool &invalid
+) {
+    if (step.undo) {
+        if (played.empty()) {
+            invalid = true;
+            return NULL;
+        }
+
+        revert(state, played.back().undo);
+
+        if (!same_position(state, played.back().before)) {
+            return "undoing a move didn't restore the position";
+        }
+
+        played.pop_back();
+
+        // (the position is the one from before the move, which was already
+        // checked)
+        return NULL;
+    }
+
+    if (!is_legal<V>(state, step.move)) {
+        invalid = true;
+        return NULL;
+    }
+
+    played.emplace_back();
+    played.back().before = state;
+    played.back().undo = apply<V>(state, step.move);
+
+    return check ? check_state<V>(state) : NULL;
+}
+
+/* Plays a random game from a seed, recording its steps (up to the first
+ * invariant broken, if any).
+ * Returns the invariant broken, or NULL if none were.
+ */
+template <typename V>
+static const char *play_random(
+    uint64_t seed, int move_limit, std::vector<Step> &steps,
+    std::vector<Played> &played, Totals &totals
+) {
+    State state;
+    deal(state, static_cast<uint32_t>(seed));
+
+    steps.clear();
+    played.clear();
+
+    const char *problem = check_state<V>(state);
+
+    uint64_t random = seed;
+    Move moves[MAX_MOVES];
+    bool invalid = false;
+
+    for (int i = 0; i < move_limit && problem == NULL; ++i) {
+        Step step;
+        step.undo = !played.empty() && next_random(random) % UNDO_CHANCE == 0;
+
+        if (!step.undo) {
+            int count = legal_moves<V>(state, moves);
+
+            if (count == 0) {
+                break;
+            }
+
+            step.move = moves[next_random(random) % count];
+        }
+
+        steps.push_back(step);
+
+        bool check = i % CHECK_INTERVAL == CHECK_INTERVAL - 1;
+        problem = take_step<V>(state, played, step, check, invalid);
+
+        // (the generator only offers legal moves, so this is a problem too)
+        if (invalid) {
+            problem = "the move generator offered an illegal move";
+        }
+
+        ++(step.undo ? totals.undos : totals.moves);
+    }
+
+    if (problem == NULL) {
+        problem = check_state<V>(state);
+    }
+
+    // take back every move left, back to the deal
+    while (problem == NULL && !played.empty()) {
+        Step step;
+        step.undo = true;
+
+        steps.push_back(step);
+        problem = take_step<V>(state, played, step, false, invalid);
+
+        ++totals.undos;
+    }
+
+    ++totals.games;
+
+    return problem;
+}
+
+/* Plays recorded steps on a seed's deal, skipping any that can't be taken
+ * (moves that aren't legal any more, and undos with nothing to take back),
+ * so leaving steps out rarely stops the rest from being played.
+ * Returns whether they break the given invariant (rather than some other
+ * one, or none); if they do, the steps are replaced by the ones actually
+ * taken, up to the one that broke it.
+ */
+template <typename V>
+static bool reproduces(
+    uint64_t seed, std::vector<Step> &steps, const char *problem
+) {
+    State state;
+    deal(state, static_cast<uint32_t>(seed));
+
+    std::vector<Played> played;
+    std::vector<Step> taken;
+
+    for (const Step &step : steps) {
+        bool invalid = false;
+        const char *found = take_step<V>(
+            state, played, step, true, invalid
+        );
+
+        if (invalid) {
+            continue;
+        }
+
+        taken.push_back(step);
+
+        if (found != NULL) {
+            if (std::strcmp(found, problem) != 0) {
+                return false;
+            }
+
+            steps.swap(taken);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Cuts a failing game's steps down as far as possible while it still breaks
+ * the same invariant: ever smaller chunks are left out for as long as
+ * leaving one out doesn't stop it from failing, until no single step can be
+ * left out.
+ * (A failure the random game found by offering an illegal move can't be
+ * replayed, since replaying skips illegal moves, so it is left alone.)
+ */
+template <typename V>
+static void reduce(Failure &failure) {
+    std::vector<Step> candidate;
+    size_t chunk = failure.steps.size() / 2;
+
+    while (chunk != 0) {
+        size_t start = 0;
+        bool shortened = false;
+
+        while (start < failure.steps.size()) {
+            candidate.assign(
+                failure.steps.begin(), failure.steps.begin() + start
+            );
+            candidate.insert(
+                candidate.end(),
+                failure.steps.begin() + std::min(
+                    start + chunk, failure.steps.size()
+                ),
+                failure.steps.end()
+            );
+
+            if (reproduces<V>(failure.seed, candidate, failure.problem)) {
+                failure.steps.swap(candidate);
+                shortened = true;
+            } else {
+                start += chunk;
+            }
+        }
+
+        // (leaving out one step can make another unnecessary, so single
+        // steps are tried until none can go)
+        if (chunk > 1 || !shortened) {
+            chunk /= 2;
+        }
+    }
+}
+
+
+/* Describes a move in words. */
+static std::string describe(const Move &move) {
+    char text[64];
+
+    switch (move.type) {
+        case DRAW:
+            return "draw";
+
+        case FLIP:
+            std::snprintf(text, sizeof(text), "flip stack %d", move.from);
+            break;
+
+        case WASTE_TO_FOUNDATION:
+            std::snprintf(
+                text, sizeof(text), "waste to foundation %d", move.to
+            );
+            break;
+
+        case WASTE_TO_TABLEAU:
+            std::snprintf(text, sizeof(text), "waste to stack %d", move.to);
+            break;
+
+        case TABLEAU_TO_FOUNDATION:
+            std::snprintf(
+                text, sizeof(text), "stack %d to foundation %d", move.from,
+                move.to
+            );
+            break;
+
+        case TABLEAU_TO_TABLEAU:
+            std::snprintf(
+                text, sizeof(text), "stack %d to stack %d (%d card(s))",
+                move.from, move.to, move.count
+            );
+            break;
+
+        default:
+            std::snprintf(
+                text, sizeof(text), "foundation %d to stack %d", move.from,
+                move.to
+            );
+            break;
+    }
+
+    return text;
+}
+
+
+int main(int argc, char *argv[]) {
+    // parse arguments
+    unsigned int thread_count = std::thread::hardware_concurrency();
+    double time_limit = 10;
+    bool fixed_rules = false;
+    Rules rules = DEFAULT_RULES;
+    int move_limit = 300;
+    uint64_t first_seed = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            time_limit = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (!parse_rules(argv[++i], rules)) {
+                std::fprintf(stderr, "unsupported rules\n");
+                return 1;
+            }
+
+            fixed_rules = true;
+        } else if (std::strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            move_limit = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            first_seed = std::strtoull(argv[++i], NULL, 10);
+        } else {
+            std::fprintf(
+                stderr, "usage: %s [-j threads] [-t seconds] [-r rules] "
+                        "[-m moves] [-s seed]\n",
+                argv[0]
+            );
+            return 1;
+        }
+    }
+
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    // play seeds in batches until time runs out, with each thread taking the
+    // next batch when it is done with its last one
+    // (of the games that fail, only the lowest seed's steps are kept)
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration<double>(time_limit);
+
+    std::atomic<uint64_t> next_batch(0);
+    std::vector<Totals> totals(thread_count);
+    std::vector<std::thread> threads;
+
+    std::mutex failure_mutex;
+    Failure failure;
+    uint64_t failure_count = 0;
+
+    for (unsigned int t = 0; t < thread_count; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            Totals &thread_totals = totals[t];
+
+            // (reused for every game, so the hot loop doesn't allocate)
+            std::vector<Step> steps;
+            std::vector<Played> played;
+
+            steps.reserve(2 * move_limit);
+            played.reserve(move_limit);
+
+            while (std::chrono::steady_clock::now() < deadline) {
+                uint64_t first = first_seed + next_batch.fetch_add(1)
+                                              * BATCH_SIZE;
+
+                for (uint64_t seed = first; seed < first + BATCH_SIZE; ++seed) {
+                    const char *problem = with_variant(
+                        seed_rules(seed, fixed_rules, rules),
+                        [&](auto variant) {
+                            return play_random<decltype(variant)>(
+                                seed, move_limit, steps, played,
+                                thread_totals
+                            );
+                        }
+                    );
+
+                    if (problem == NULL) {
+                        continue;
+                    }
+
+                    std::lock_guard<std::mutex> lock(failure_mutex);
+
+                    if (failure_count++ == 0 || seed < failure.seed) {
+                        failure.seed = seed;
+                        failure.rules = seed_rules(seed, fixed_rules, rules);
+                        failure.problem = problem;
+                        failure.steps = steps;
+                    }
+                }
+            }
+        }));
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+
+    // add up the totals
+    Totals total;
+
+    for (const Totals &thread_totals : totals) {
+        total.games += thread_totals.games;
+        total.moves += thread_totals.moves;
+        total.undos += thread_totals.undos;
+    }
+
+    std::printf(
+        "%llu games, %llu moves and %llu undos in %.2f s "
+        "(%.1f million steps/s on %u thread(s))\n",
+        static_cast<unsigned long long>(total.games),
+        static_cast<unsigned long long>(total.moves),
+        static_cast<unsigned long long>(total.undos), seconds,
+        (total.moves + total.undos) / seconds / 1e6, thread_count
+    );
+
+    if (failure_count == 0) {
+        std::printf("no invariants broken\n");
+        return 0;
+    }
+
+    // cut the failing game down, and show how to get there
+    size_t original_size = failure.steps.size();
+
+    if (std::strcmp(
+        failure.problem, "the move generator offered an illegal move"
+    ) != 0) {
+        with_variant(failure.rules, [&](auto variant) {
+            reduce<decltype(variant)>(failure);
+        });
+    }
+
+    std::printf(
+        "%llu game(s) broke an invariant; the lowest seed, %llu (rules "
+        "%d/%d), found that %s after %zu step(s)\n",
+        static_cast<unsigned long long>(failure_count),
+        static_cast<unsigned long long>(failure.seed),
+        failure.rules.draw_count, failure.rules.pass_limit, failure.problem,
+        original_size
+    );
+    std::printf(
+        "reduced to %zu step(s) from deal %u:\n", failure.steps.size(),
+        static_cast<uint32_t>(failure.seed)
+    );
+
+    for (size_t i = 0; i < failure.steps.size(); ++i) {
+        const Step &step = failure.steps[i];
+
+        std::printf(
+            "  %zu. %s\n", i + 1,
+            step.undo ? "undo" : describe(step.move).c_str()
+        );
+    }
+
+    return 1;
+}
@@ -8,9 +8,20 @@
 
 // project includes
 #include "wrapper.hpp"
+#include "capture.hpp"
 
 // standard libraries
+#include <new>
+#include <atomic>
 #include <string>
+#include <vector>
+#include <algorithm>
+
+// C standard libraries
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
 
 // external libraries
 #include <SDL2/SDL.h>
@@ -26,16 +37,191 @@ SDL_Window *window;
 SDL_Renderer *renderer;
 bool refreshed;
 
+// in headless mode, there is no window, and everything is drawn to a surface
+// in memory instead
+bool headless = false;
+SDL_Surface *target = NULL;
+
+// (the screen is measured in pixels, which on a HiDPI display can be more
+// than the window's size, measured in points; the mouse's position is
+// converted from one to the other)
+int screen_width;
+int screen_height;
+
+int window_width;
+int window_height;
+
+// whether the screen changed size, or lost the contents of textures drawn
+// to, since the last frame
+bool screen_resized = false;
+
 std::vector<SDL_Texture *> textures;
 
 unsigned int frame_time;
 uint32_t last_frame = 0;
 
+FrameStats frame_stats;
+FrameCapture capture;
+int capture_width;
+int capture_height;
+std::atomic<unsigned long> frame_allocations(0);
+
+// only allocations on the thread running the mainloop count towards frames
+thread_local bool counts_allocations = false;
+
+bool keys_pressed[SDL_NUM_SCANCODES];
+
+// (the keys pressed this frame, for recording input; more than this many in
+// one frame are left out of the recording)
+const int MAX_FRAME_KEYS = 8;
+
+SDL_Scancode frame_keys[MAX_FRAME_KEYS];
+int frame_key_count = 0;
+
 int mouse_x;
 int mouse_y;
 bool lmb_state;
 bool lmb_state_last = false;
 
+/* The input for one frame of a recorded input script: where the mouse was,
+ * whether its button was down, and which keys were pressed.
+ */
+struct InputEvent {
+    unsigned long frame;
+
+    int x, y;
+    bool lmb;
+
+    SDL_Scancode keys[MAX_FRAME_KEYS];
+    int key_count;
+};
+
+/* A screen size recorded in an input script, and the frame it took effect
+ * on.
+ */
+struct ScreenSize {
+    unsigned long frame;
+    int width, height;
+};
+
+// input being recorded to a script, and the input it last recorded
+// (the file gets its own buffer, so writing to it never allocates)
+std::FILE *input_recording = NULL;
+char recording_buffer[65536];
+
+int recorded_x;
+int recorded_y;
+bool recorded_lmb;
+
+// a script being played back instead of real input (it ends on input_end,
+// when update() reports the window as closed)
+bool playing_input = false;
+
+std::vector<InputEvent> input_script;
+size_t input_next;
+unsigned long input_end;
+
+// (the screen is resized to each size the script recorded as it plays, so
+// the mouse lands on the same layout it was recorded with)
+std::vector<ScreenSize> script_sizes;
+size_t size_next;
+
+// how long each frame took, in milliseconds (only kept during playback)
+std::vector<float> frame_times;
+uint64_t last_update = 0;
+
+
+
+/* helper functions */
+
+/* Measures the screen (in pixels) and the window (in points). */
+static void measure_screen() {
+    SDL_GetRendererOutputSize(renderer, &screen_width, &screen_height);
+    SDL_GetWindowSize(window, &window_width, &window_height);
+}
+
+/* Resizes the screen to every size an input script recorded up to the
+ * current frame. This is only done without a display, where the screen is a
+ * viewport onto a surface big enough for every size in the script.
+ */
+static void play_screen_sizes() {
+    while (
+        size_next < script_sizes.size()
+        && script_sizes[size_next].frame <= frame_stats.frames
+    ) {
+        const ScreenSize &size = script_sizes[size_next++];
+
+        if (size.width == screen_width && size.height == screen_height) {
+            continue;
+        }
+
+        SDL_Rect viewport = {0, 0, size.width, size.height};
+        SDL_RenderSetViewport(renderer, &viewport);
+
+        screen_width = size.width;
+        screen_height = size.height;
+
+        window_width = size.width;
+        window_height = size.height;
+
+        screen_resized = true;
+    }
+}
+
+/* Reads the mouse's state, converting its position to pixels. */
+static void read_mouse() {
+    lmb_state = SDL_GetMouseState(&mouse_x, &mouse_y);
+
+    if (
+        window_width > 0 && window_height > 0
+        && (window_width != screen_width || window_height != screen_height)
+    ) {
+        mouse_x = mouse_x * screen_width / window_width;
+        mouse_y = mouse_y * screen_height / window_height;
+    }
+}
+
+/* Frees a texture that's no longer needed, rather than when quitting. */
+static void destroy_texture(SDL_Texture *texture) {
+    textures.erase(
+        std::remove(textures.begin(), textures.end(), texture),
+        textures.end()
+    );
+    SDL_DestroyTexture(texture);
+}
+
+
+
+/* allocation tracking */
+
+#ifndef NDEBUG
+/* Replaces the global allocation function so every allocation is counted
+ * towards the current frame. The deallocation functions are replaced too,
+ * since the default ones aren't guaranteed to free what std::malloc
+ * allocated.
+ */
+void *operator new(std::size_t size) {
+    if (counts_allocations) {
+        frame_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void *pointer = std::malloc(size == 0 ? 1 : size);
+
+    if (pointer == NULL) {
+        throw std::bad_alloc();
+    }
+
+    return pointer;
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+#endif
 
 
 /* Color implementation:
@@ -52,7 +238,14 @@ Color::Color(uint8_t r_, uint8_t g_, uint8_t b_, uint8_t a_) :
  * A wrapper around an SDL texture.
  */
 
-Sprite::Sprite() {}
+Sprite::Sprite():
+    texture(NULL),
+    width(0),
+    height(0),
+    scaled(NULL),
+    scaled_width(0),
+    scaled_height(0)
+{}
 
 Sprite::Sprite(std::string file) {
     // create surface and convert to texture (keying out the background)
@@ -60,18 +253,94 @@ Sprite::Sprite(std::string file) {
     // color, so I'm hardcoding it in because I'm lazy)
     // (also I know I should have used PNGs but I'm also too lazy to install
     // SDL_image)
+    // (the keyed-out pixels are made transparent black rather than left
+    // magenta, as in Atlas::load(), so resampling doesn't blend magenta into
+    // the edges)
     SDL_Surface *temp = SDL_LoadBMP(file.c_str());
     SDL_SetColorKey(temp, SDL_TRUE, SDL_MapRGB(temp->format, 255, 0, 255));
-    texture = SDL_CreateTextureFromSurface(renderer, temp);
+
+    SDL_Surface *keyed = SDL_CreateRGBSurfaceWithFormat(
+        0, temp->w, temp->h, 32, SDL_PIXELFORMAT_ARGB8888
+    );
+    SDL_FillRect(keyed, NULL, 0);
+    SDL_SetSurfaceBlendMode(temp, SDL_BLENDMODE_NONE);
+    SDL_BlitSurface(temp, NULL, keyed, NULL);
     SDL_FreeSurface(temp);
 
+    texture = SDL_CreateTextureFromSurface(renderer, keyed);
+    SDL_FreeSurface(keyed);
+
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
     // query size
     SDL_QueryTexture(texture, NULL, NULL, &width, &height);
 
+    scaled = texture;
+    scaled_width = width;
+    scaled_height = height;
+
     // add texture to vector so it can be freed later
     textures.push_back(texture);
 }
 
+/* Resamples the Sprite at a scale, once, so it can be drawn that much bigger
+ * or smaller without being scaled every time it is drawn. Any copy made for
+ * an earlier scale is freed (at a scale of 1, the texture itself is drawn).
+ * If the renderer can't draw to textures, the Sprite is scaled as it is drawn
+ * instead.
+ */
+void Sprite::set_scale(float scale) {
+    if (scaled != texture) {
+        destroy_texture(scaled);
+    }
+
+    scaled = texture;
+    scaled_width = std::max(1, static_cast<int>(std::lround(width * scale)));
+    scaled_height = std::max(
+        1, static_cast<int>(std::lround(height * scale))
+    );
+
+    if (scaled_width == width && scaled_height == height) {
+        return;
+    }
+
+    SDL_Texture *copy = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+        scaled_width, scaled_height
+    );
+
+    if (copy == NULL) {
+        return;
+    }
+
+    // draw the texture into the copy, filtered, keeping its alpha as it is
+    // rather than blending it with the (transparent) copy
+    SDL_Texture *previous_target = SDL_GetRenderTarget(renderer);
+
+    if (SDL_SetRenderTarget(renderer, copy) != 0) {
+        SDL_DestroyTexture(copy);
+        return;
+    }
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+    SDL_SetTextureScaleMode(texture, SDL_ScaleModeLinear);
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_SetTextureScaleMode(texture, SDL_ScaleModeNearest);
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+    SDL_SetRenderTarget(renderer, previous_target);
+
+    SDL_SetTextureBlendMode(copy, SDL_BLENDMODE_BLEND);
+
+    scaled = copy;
+
+    // add texture to vector so it can be freed later
+    textures.push_back(copy);
+}
+
 /* Draws the Sprite at a given position. */
 void Sprite::draw(int x, int y) {
     // create rect
@@ -79,21 +348,219 @@ void Sprite::draw(int x, int y) {
 
     rect.x = x;
     rect.y = y;
-    rect.w = width;
-    rect.h = height;
+    rect.w = scaled_width;
+    rect.h = scaled_height;
 
     // draw texture
-    SDL_RenderCopy(renderer, texture, NULL, &rect);
+    SDL_RenderCopy(renderer, scaled, NULL, &rect);
 }
 
-/* Returns the width of the Sprite. */
+/* Draws the sprite with its colors multiplied by a tint. */
+void Sprite::draw(int x, int y, const Color &tint) {
+    SDL_SetTextureColorMod(scaled, tint.r, tint.g, tint.b);
+    draw(x, y);
+    SDL_SetTextureColorMod(scaled, 255, 255, 255);
+}
+
+/* Returns the width of the Sprite, as drawn. */
 int Sprite::get_width() const {
-    return width;
+    return scaled_width;
 }
 
-/* Returns the height of the Sprite. */
+/* Returns the height of the Sprite, as drawn. */
 int Sprite::get_height() const {
-    return height;
+    return scaled_height;
+}
+
+
+/* Atlas implementation:
+ * A texture holding many images side by side.
+ */
+
+// (images are kept this far apart, so scaling one down never blends in the
+// edge of its neighbor)
+const int ATLAS_PADDING = 1;
+
+Atlas::Atlas():
+    texture(NULL),
+    width(0),
+    height(0)
+{}
+
+/* Loads bitmaps into the atlas (keying out the background, as with Sprite),
+ * packing them into a grid. This must be done after initializing the wrapper.
+ * Returns whether it was successful.
+ */
+bool Atlas::load(const std::vector<std::string> &files) {
+    std::vector<SDL_Surface *> images;
+    int cell_width = 0;
+    int cell_height = 0;
+
+    for (const std::string &file : files) {
+        SDL_Surface *image = SDL_LoadBMP(file.c_str());
+
+        if (image == NULL) {
+            for (SDL_Surface *loaded : images) {
+                SDL_FreeSurface(loaded);
+            }
+
+            return false;
+        }
+
+        SDL_SetColorKey(
+            image, SDL_TRUE, SDL_MapRGB(image->format, 255, 0, 255)
+        );
+
+        cell_width = std::max(cell_width, image->w + ATLAS_PADDING);
+        cell_height = std::max(cell_height, image->h + ATLAS_PADDING);
+
+        images.push_back(image);
+    }
+
+    // lay the images out in a roughly square grid, on a transparent sheet
+    int columns = 1;
+
+    while (columns * columns < static_cast<int>(images.size())) {
+        ++columns;
+    }
+
+    int rows = (static_cast<int>(images.size()) + columns - 1) / columns;
+
+    texture = NULL;
+
+    SDL_Surface *sheet = SDL_CreateRGBSurfaceWithFormat(
+        0, columns * cell_width + ATLAS_PADDING,
+        rows * cell_height + ATLAS_PADDING, 32, SDL_PIXELFORMAT_ARGB8888
+    );
+
+    if (sheet != NULL) {
+        SDL_FillRect(sheet, NULL, 0);
+        regions.clear();
+
+        for (size_t i = 0; i < images.size(); ++i) {
+            SDL_Rect region;
+
+            region.x = static_cast<int>(i) % columns * cell_width
+                       + ATLAS_PADDING;
+            region.y = static_cast<int>(i) / columns * cell_height
+                       + ATLAS_PADDING;
+            region.w = images[i]->w;
+            region.h = images[i]->h;
+
+            // (the keyed-out pixels are skipped, leaving them transparent)
+            SDL_SetSurfaceBlendMode(images[i], SDL_BLENDMODE_NONE);
+            SDL_BlitSurface(images[i], NULL, sheet, &region);
+
+            regions.push_back(region);
+        }
+
+        width = sheet->w;
+        height = sheet->h;
+
+        texture = SDL_CreateTextureFromSurface(renderer, sheet);
+        SDL_FreeSurface(sheet);
+    }
+
+    for (SDL_Surface *image : images) {
+        SDL_FreeSurface(image);
+    }
+
+    if (texture == NULL) {
+        return false;
+    }
+
+    // (images are usually drawn scaled down, which looks much better
+    // filtered)
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    SDL_SetTextureScaleMode(texture, SDL_ScaleModeLinear);
+
+    // add texture to vector so it can be freed later
+    textures.push_back(texture);
+
+    return true;
+}
+
+/* Returns the number of images in the atlas. */
+int Atlas::get_count() const {
+    return regions.size();
+}
+
+/* Returns the width of an image in the atlas. */
+int Atlas::get_width(int image) const {
+    return regions[image].w;
+}
+
+/* Returns the height of an image in the atlas. */
+int Atlas::get_height(int image) const {
+    return regions[image].h;
+}
+
+
+/* Batch implementation:
+ * A queue of images from an atlas, drawn together in one draw call.
+ */
+
+Batch::Batch():
+    atlas(NULL)
+{}
+
+Batch::Batch(const Atlas &atlas_):
+    atlas(&atlas_)
+{}
+
+/* Queues an image to be drawn at a given position, scaled, and with its
+ * colors multiplied by a tint.
+ */
+void Batch::draw(int image, float x, float y, float scale, const Color &tint) {
+    const SDL_Rect &region = atlas->regions[image];
+
+    float x2 = x + region.w * scale;
+    float y2 = y + region.h * scale;
+
+    float u1 = static_cast<float>(region.x) / atlas->width;
+    float v1 = static_cast<float>(region.y) / atlas->height;
+    float u2 = static_cast<float>(region.x + region.w) / atlas->width;
+    float v2 = static_cast<float>(region.y + region.h) / atlas->height;
+
+    SDL_Color color = {tint.r, tint.g, tint.b, tint.a};
+
+    int first = vertices.size();
+
+    vertices.push_back({{x, y}, color, {u1, v1}});
+    vertices.push_back({{x2, y}, color, {u2, v1}});
+    vertices.push_back({{x, y2}, color, {u1, v2}});
+    vertices.push_back({{x2, y2}, color, {u2, v2}});
+
+    // (the indices are the same every frame, so they are only ever added
+    // to, never cleared)
+    if (indices.size() < vertices.size() / 4 * 6) {
+        int corners[6] = {0, 1, 2, 2, 1, 3};
+
+        for (int corner : corners) {
+            indices.push_back(first + corner);
+        }
+    }
+}
+
+/* Draws every queued image, then empties the queue. */
+void Batch::flush() {
+    if (vertices.empty()) {
+        return;
+    }
+
+    SDL_RenderGeometry(
+        renderer, atlas->texture, vertices.data(), vertices.size(),
+        indices.data(), vertices.size() / 4 * 6
+    );
+
+    // (clearing keeps the memory, so batches of a similar size don't
+    // allocate)
+    vertices.clear();
+}
+
+/* Returns the number of images queued. */
+size_t Batch::get_size() const {
+    return vertices.size() / 4;
 }
 
 
@@ -123,12 +590,15 @@ bool BBox::collision(int point_x, int point_y) {
 
 /* functions */
 
-/* Initializes SDL and creates necessary resources.
+/* Initializes SDL and creates necessary resources, optionally with a window
+ * that can be resized (which is also drawn at the display's full resolution
+ * on HiDPI displays, so the screen can be bigger than the size asked for;
+ * see screen_changed()).
  * Returns whether it was successful.
  */
 bool wrapper::initialize(
     int width, int height, int fps,
-    std::string title, std::string icon
+    std::string title, std::string icon, bool resizable
 ) {
     if (!initialized) {
         // initialize SDL
@@ -141,13 +611,22 @@ bool wrapper::initialize(
             title.c_str(),
             SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
             width, height,
-            SDL_WINDOW_HIDDEN
+            SDL_WINDOW_HIDDEN | (
+                resizable ? SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI
+                          : 0
+            )
         );
 
         if (window == NULL) {
             return false;
         }
 
+        // (shrinking the window much further would make everything too
+        // small to use)
+        if (resizable) {
+            SDL_SetWindowMinimumSize(window, width / 2, height / 2);
+        }
+
         // set icon
         SDL_Surface *temp = SDL_LoadBMP(icon.c_str());
         SDL_SetWindowIcon(window, temp);
@@ -167,8 +646,13 @@ bool wrapper::initialize(
         refreshed = false;
         frame_time = 1000 / fps;
 
+        measure_screen();
+
         // get initial mouse state
-        lmb_state = SDL_GetMouseState(&mouse_x, &mouse_y);
+        read_mouse();
+
+        // (the mainloop has to run on the thread that initialized SDL)
+        counts_allocations = true;
 
         initialized = true;
 
@@ -178,9 +662,90 @@ bool wrapper::initialize(
     }
 }
 
+/* Initializes SDL without a display, drawing everything to a surface in
+ * memory (which can be read back with read_pixels()). Frames aren't waited
+ * for, so they can be drawn as fast as possible. If an input script has
+ * already been loaded, the screen takes the sizes it recorded instead of the
+ * one given.
+ * Returns whether it was successful.
+ */
+bool wrapper::initialize_headless(int width, int height) {
+    if (initialized) {
+        return false;
+    }
+
+    // (the surface is made big enough for every size the script recorded,
+    // and the screen is a viewport onto it)
+    if (playing_input) {
+        width = 0;
+        height = 0;
+
+        for (const ScreenSize &size : script_sizes) {
+            width = std::max(width, size.width);
+            height = std::max(height, size.height);
+        }
+    }
+
+    // (the dummy video driver still handles events, so update() works the
+    // same, but needs no display; setting SDL_VIDEODRIVER overrides it)
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0) {
+        return false;
+    }
+
+    target = SDL_CreateRGBSurfaceWithFormat(
+        0, width, height, 32, SDL_PIXELFORMAT_ARGB8888
+    );
+
+    if (target == NULL) {
+        return false;
+    }
+
+    renderer = SDL_CreateSoftwareRenderer(target);
+
+    if (renderer == NULL) {
+        SDL_FreeSurface(target);
+        target = NULL;
+
+        return false;
+    }
+
+    window = NULL;
+    headless = true;
+
+    refreshed = false;
+    frame_time = 0;
+
+    screen_width = width;
+    screen_height = height;
+
+    window_width = width;
+    window_height = height;
+
+    lmb_state = false;
+    mouse_x = 0;
+    mouse_y = 0;
+
+    counts_allocations = true;
+
+    initialized = true;
+
+    if (playing_input) {
+        play_screen_sizes();
+    }
+
+    return true;
+}
+
 /* Frees memory and quits SDL. */
 void wrapper::quit() {
     if (initialized) {
+        // finish writing any frames still being captured, and any input
+        // being recorded
+        capture.stop();
+        stop_input_recording();
+
         // destroy sprites' textures
         for (SDL_Texture *texture : textures) {
             SDL_DestroyTexture(texture);
@@ -188,7 +753,14 @@ void wrapper::quit() {
 
         // free remaining resources
         SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
+
+        if (headless) {
+            SDL_FreeSurface(target);
+            target = NULL;
+            headless = false;
+        } else {
+            SDL_DestroyWindow(window);
+        }
 
         // quit SDL
         SDL_Quit();
@@ -196,10 +768,301 @@ void wrapper::quit() {
     }
 }
 
+/* Changes the window's title (if there is one). */
+void wrapper::set_title(const char *title) {
+    if (initialized && !headless) {
+        SDL_SetWindowTitle(window, title);
+    }
+}
+
+void wrapper::set_title(const std::string &title) {
+    set_title(title.c_str());
+}
+
+/* Returns the width of the screen. */
+int wrapper::get_screen_width() {
+    return screen_width;
+}
+
+/* Returns the height of the screen. */
+int wrapper::get_screen_height() {
+    return screen_height;
+}
+
+/* Returns whether the screen was resized during the last update() (or the
+ * contents of textures drawn to were lost, as happens when the graphics
+ * device is reset), meaning anything laid out or resampled for it needs
+ * doing again.
+ */
+bool wrapper::screen_changed() {
+    return screen_resized;
+}
+
+/* Reads back what has been drawn so far this frame, as 32-bit ARGB pixels
+ * (row by row, from the top left).
+ * Returns whether it was successful.
+ */
+bool wrapper::read_pixels(std::vector<uint32_t> &pixels) {
+    if (!initialized) {
+        return false;
+    }
+
+    // (resizing never shrinks the buffer, so reading every frame into the
+    // same one doesn't allocate)
+    pixels.resize(static_cast<size_t>(screen_width) * screen_height);
+
+    return SDL_RenderReadPixels(
+        renderer, NULL, SDL_PIXELFORMAT_ARGB8888, pixels.data(),
+        screen_width * 4
+    ) == 0;
+}
+
+/* Saves what has been drawn so far this frame as a bitmap.
+ * Returns whether it was successful.
+ */
+bool wrapper::save_screenshot(const std::string &path) {
+    std::vector<uint32_t> pixels;
+
+    if (!read_pixels(pixels)) {
+        return false;
+    }
+
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(
+        pixels.data(), screen_width, screen_height, 32, screen_width * 4,
+        SDL_PIXELFORMAT_ARGB8888
+    );
+
+    if (surface == NULL) {
+        return false;
+    }
+
+    bool success = SDL_SaveBMP(surface, path.c_str()) == 0;
+    SDL_FreeSurface(surface);
+
+    return success;
+}
+
+/* Starts recording every frame drawn from now on, either as numbered bitmaps
+ * in a directory or as one file of raw pixels (see capture.cpp).
+ * Returns whether it was successful.
+ */
+bool wrapper::start_capture(const std::string &path, CaptureFormat format) {
+    if (!initialized) {
+        return false;
+    }
+
+    capture_width = screen_width;
+    capture_height = screen_height;
+
+    return capture.start(path, format, capture_width, capture_height);
+}
+
+/* Stops recording frames, waiting for the ones captured so far to be
+ * written.
+ */
+void wrapper::stop_capture() {
+    capture.stop();
+}
+
+/* Returns how many frames have been recorded, and how many were dropped. */
+CaptureStats wrapper::get_capture_stats() {
+    return capture.get_stats();
+}
+
+/* Starts recording the mouse and keyboard to an input script, which can be
+ * played back later with start_input_playback(). Each line holds the input
+ * for a frame where it changed: the frame's number, the mouse's position
+ * (in pixels), whether its button is down, and the scancodes of any keys
+ * pressed. The screen's size is written when recording starts and whenever
+ * it changes, as the frame's number, "size", and the width and height (so
+ * the mouse's position means the same thing when played back). The last line
+ * is the frame the recording stopped on, followed by "end".
+ * Returns whether it was successful.
+ */
+bool wrapper::start_input_recording(const std::string &path) {
+    stop_input_recording();
+
+    input_recording = std::fopen(path.c_str(), "w");
+
+    if (input_recording == NULL) {
+        return false;
+    }
+
+    std::setvbuf(
+        input_recording, recording_buffer, _IOFBF, sizeof(recording_buffer)
+    );
+    std::fprintf(input_recording, "# klondike input script\n");
+    std::fprintf(
+        input_recording, "%lu size %d %d\n", frame_stats.frames, screen_width,
+        screen_height
+    );
+
+    // (the first frame is always written, so playback starts in the same
+    // place)
+    recorded_x = -1;
+    recorded_y = -1;
+    recorded_lmb = false;
+
+    return true;
+}
+
+/* Stops recording input, if it is being recorded. */
+void wrapper::stop_input_recording() {
+    if (input_recording != NULL) {
+        std::fprintf(input_recording, "%lu end\n", frame_stats.frames);
+        std::fclose(input_recording);
+
+        input_recording = NULL;
+    }
+}
+
+/* Loads an input script (see start_input_recording()) and plays it back in
+ * place of the real mouse and keyboard. Once it ends, update() reports the
+ * window as closed. How long each frame takes is kept while it plays (see
+ * get_frame_times()).
+ *
+ * The screen is resized to match the script as it plays, which can only be
+ * done without a display: a script can be loaded before initialize_headless()
+ * (which makes the screen fit it), or after it if the screen is already big
+ * enough. With a window, the script has to have been recorded at the
+ * window's size throughout. Scripts that don't record their sizes are
+ * rejected.
+ * Returns whether it was successful.
+ */
+bool wrapper::start_input_playback(const std::string &path) {
+    std::FILE *input = std::fopen(path.c_str(), "r");
+
+    if (input == NULL) {
+        return false;
+    }
+
+    input_script.clear();
+    script_sizes.clear();
+    input_end = 0;
+
+    char line[256];
+    bool ended = false;
+
+    while (!ended && std::fgets(line, sizeof(line), input) != NULL) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+
+        InputEvent event;
+        int lmb;
+        int start;
+        int read;
+
+        if (std::sscanf(line, "%lu %n", &event.frame, &start) != 1) {
+            continue;
+        }
+
+        ScreenSize size;
+
+        if (std::strncmp(line + start, "end", 3) == 0) {
+            input_end = event.frame;
+            ended = true;
+        } else if (
+            std::sscanf(
+                line + start, "size %d %d", &size.width, &size.height
+            ) == 2
+        ) {
+            // (a script with an impossible size is rejected, the same as
+            // one that never ends)
+            if (size.width <= 0 || size.height <= 0) {
+                break;
+            }
+
+            size.frame = event.frame;
+            script_sizes.push_back(size);
+        } else if (
+            std::sscanf(
+                line + start, "%d %d %d%n", &event.x, &event.y, &lmb, &read
+            ) == 3
+        ) {
+            event.lmb = lmb != 0;
+            event.key_count = 0;
+
+            // the keys pressed, if any
+            const char *keys = line + start + read;
+            char *end;
+
+            while (event.key_count < MAX_FRAME_KEYS) {
+                long key = std::strtol(keys, &end, 10);
+
+                if (end == keys || key < 0 || key >= SDL_NUM_SCANCODES) {
+                    break;
+                }
+
+                event.keys[event.key_count++] = static_cast<SDL_Scancode>(key);
+                keys = end;
+            }
+
+            input_script.push_back(event);
+        }
+    }
+
+    std::fclose(input);
+
+    if (!ended || script_sizes.empty()) {
+        return false;
+    }
+
+    // check the screen can take every size recorded
+    if (initialized) {
+        for (const ScreenSize &size : script_sizes) {
+            bool fits = headless ? size.width <= target->w
+                                   && size.height <= target->h
+                                 : size.width == screen_width
+                                   && size.height == screen_height;
+
+            if (!fits) {
+                return false;
+            }
+        }
+    }
+
+    input_next = 0;
+    size_next = 0;
+    playing_input = true;
+
+    if (initialized && headless) {
+        play_screen_sizes();
+    }
+
+    // (frame times are kept without allocating during playback)
+    frame_times.clear();
+    frame_times.reserve(input_end);
+    last_update = 0;
+
+    return true;
+}
+
+/* Returns how long each frame took to run, in milliseconds, while an input
+ * script was played back.
+ */
+const std::vector<float> &wrapper::get_frame_times() {
+    return frame_times;
+}
+
 /* Waits for the next frame, refreshes the screen, and handles events.
  * Returns whether the window was closed.
  */
 bool wrapper::update() {
+    // time the frame that just ran, if playing back input
+    if (playing_input) {
+        uint64_t now = SDL_GetPerformanceCounter();
+
+        if (last_update != 0) {
+            frame_times.push_back(
+                static_cast<float>(now - last_update) * 1000
+                / SDL_GetPerformanceFrequency()
+            );
+        }
+
+        last_update = now;
+    }
+
     if (refreshed) {
         // wait until next frame
         uint32_t current = SDL_GetTicks();
@@ -208,35 +1071,179 @@ bool wrapper::update() {
             current = SDL_GetTicks();
         }
 
+        frame_stats.frame_time = current - last_frame;
         last_frame = current;
     } else {
         // show window if this is the first refresh
-        SDL_ShowWindow(window);
+        if (!headless) {
+            SDL_ShowWindow(window);
+        }
+
         refreshed = true;
     }
 
+    // copy the frame for the capture writer, if recording (if every buffer is
+    // still waiting to be written, the frame is dropped rather than waiting)
+    // (frames stay the size recording started at, even if the window is
+    // resized, with the screen cut off or left blank to fit)
+    if (capture.is_running()) {
+        uint32_t *buffer = capture.acquire();
+
+        if (buffer != NULL) {
+            SDL_Rect rect = {0, 0, capture_width, capture_height};
+
+            if (
+                screen_width < capture_width || screen_height < capture_height
+            ) {
+                std::fill(
+                    buffer, buffer + static_cast<size_t>(capture_width)
+                                     * capture_height,
+                    0
+                );
+            }
+
+            SDL_RenderReadPixels(
+                renderer, &rect, SDL_PIXELFORMAT_ARGB8888, buffer,
+                capture_width * 4
+            );
+            capture.submit(buffer);
+        }
+    }
+
     // present renderer
     SDL_RenderPresent(renderer);
 
+    // update frame stats, flagging the frame if it allocated anything
+    // (the first frame is skipped, since it includes all the loading done
+    // before the mainloop started)
+    unsigned long allocations = frame_allocations.exchange(0);
+
+    if (frame_stats.frames != 0 && allocations != 0) {
+        frame_stats.allocations += allocations;
+        ++frame_stats.allocating_frames;
+
+        SDL_Log(
+            "wrapper: frame %lu made %lu allocation(s)",
+            frame_stats.frames, allocations
+        );
+    }
+
+    ++frame_stats.frames;
+
     // handle events
     SDL_Event event;
 
+    // keys only count as pressed for the frame their event arrived in
+    std::fill(keys_pressed, keys_pressed + SDL_NUM_SCANCODES, false);
+    frame_key_count = 0;
+
+    screen_resized = false;
+
     while ((SDL_PollEvent(&event)) != 0) {
-        if (event.type == SDL_QUIT) {
+        if (
+            event.type == SDL_WINDOWEVENT
+            && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED
+            && !headless
+        ) {
+            measure_screen();
+            screen_resized = true;
+
+            // (sizes are recorded so the mouse's position, which is in
+            // pixels, is played back against the same layout)
+            if (input_recording != NULL) {
+                std::fprintf(
+                    input_recording, "%lu size %d %d\n", frame_stats.frames,
+                    screen_width, screen_height
+                );
+            }
+        } else if (
+            event.type == SDL_RENDER_TARGETS_RESET
+            || event.type == SDL_RENDER_DEVICE_RESET
+        ) {
+            screen_resized = true;
+        } else if (event.type == SDL_QUIT) {
             // hide the window if it was closed
-            SDL_HideWindow(window);
+            if (!headless) {
+                SDL_HideWindow(window);
+            }
+
             return true;
+        } else if (
+            event.type == SDL_KEYDOWN && !event.key.repeat && !playing_input
+        ) {
+            keys_pressed[event.key.keysym.scancode] = true;
+
+            if (frame_key_count < MAX_FRAME_KEYS) {
+                frame_keys[frame_key_count++] = event.key.keysym.scancode;
+            }
         }
     }
 
-    // get mouse state
+    // get mouse state (there is no mouse without a window)
     lmb_state_last = lmb_state;
-    lmb_state = SDL_GetMouseState(&mouse_x, &mouse_y);
+
+    if (playing_input) {
+        if (headless) {
+            play_screen_sizes();
+        }
+
+        // play back the input recorded for this frame, if it changed
+        if (
+            input_next < input_script.size()
+            && input_script[input_next].frame == frame_stats.frames
+        ) {
+            const InputEvent &recorded = input_script[input_next++];
+
+            mouse_x = recorded.x;
+            mouse_y = recorded.y;
+            lmb_state = recorded.lmb;
+
+            for (int i = 0; i < recorded.key_count; ++i) {
+                keys_pressed[recorded.keys[i]] = true;
+            }
+        }
+
+        // (the script's last frame ends it, as if the window was closed)
+        if (frame_stats.frames >= input_end) {
+            playing_input = false;
+            return true;
+        }
+    } else if (!headless) {
+        read_mouse();
+    }
+
+    // record the input for this frame, if it changed
+    if (
+        input_recording != NULL && (
+            mouse_x != recorded_x || mouse_y != recorded_y
+            || lmb_state != recorded_lmb || frame_key_count != 0
+        )
+    ) {
+        std::fprintf(
+            input_recording, "%lu %d %d %d", frame_stats.frames, mouse_x,
+            mouse_y, lmb_state ? 1 : 0
+        );
+
+        for (int i = 0; i < frame_key_count; ++i) {
+            std::fprintf(input_recording, " %d", frame_keys[i]);
+        }
+
+        std::fprintf(input_recording, "\n");
+
+        recorded_x = mouse_x;
+        recorded_y = mouse_y;
+        recorded_lmb = lmb_state;
+    }
 
     // window was not closed
     return false;
 }
 
+/* Returns statistics about the frames drawn so far. */
+const FrameStats &wrapper::get_frame_stats() {
+    return frame_stats;
+}
+
 /* Clears the screen, optionally filling it with a color. */
 void wrapper::clear(const Color &color) {
     SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
@@ -244,6 +1251,27 @@ void wrapper::clear(const Color &color) {
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
 }
 
+/* Fills a rectangle with a color. The BBox's edges are included, as they are
+ * for collisions.
+ */
+void wrapper::fill_rect(const BBox &bbox, const Color &color) {
+    SDL_Rect rect;
+
+    rect.x = bbox.x1;
+    rect.y = bbox.y1;
+    rect.w = bbox.x2 - bbox.x1 + 1;
+    rect.h = bbox.y2 - bbox.y1 + 1;
+
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    SDL_RenderFillRect(renderer, &rect);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+}
+
+/* Returns whether a key was pressed this frame. */
+bool wrapper::key_pressed(SDL_Scancode key) {
+    return keys_pressed[key];
+}
+
 /* Returns whether the left mouse button is down. */
 bool wrapper::mouse_down() {
     return lmb_state;
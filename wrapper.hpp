@@ -6,6 +6,9 @@
  */
 
 
+// project includes
+#include "capture.hpp"
+
 // standard libraries
 #include <string>
 #include <vector>
@@ -31,17 +34,85 @@
             int width;
             int height;
 
+            // the texture resampled to the size it is drawn at (see
+            // set_scale()), which is just the texture at its own size
+            SDL_Texture *scaled;
+            int scaled_width;
+            int scaled_height;
+
             public:
                 Sprite();
                 Sprite(std::string file);
                 Sprite(SDL_Surface *surface);
 
+                void set_scale(float scale);
+
                 void draw(int x, int y);
+                void draw(int x, int y, const Color &tint);
 
                 int get_width() const;
                 int get_height() const;
         };
 
+        /* Several images packed into one texture, so any number of them can
+         * be drawn with a single draw call (see Batch). Images are numbered
+         * in the order their files were given.
+         */
+        class Atlas {
+            SDL_Texture *texture;
+            int width;
+            int height;
+
+            std::vector<SDL_Rect> regions;
+
+            friend class Batch;
+
+            public:
+                Atlas();
+
+                bool load(const std::vector<std::string> &files);
+
+                int get_count() const;
+                int get_width(int image) const;
+                int get_height(int image) const;
+        };
+
+        /* Images from an atlas queued up to be drawn, at any position and
+         * scale, all at once. They are drawn in the order they were queued,
+         * so later ones cover earlier ones just as with Sprite::draw().
+         */
+        class Batch {
+            const Atlas *atlas;
+
+            // (four corners per image, drawn as two triangles each)
+            std::vector<SDL_Vertex> vertices;
+            std::vector<int> indices;
+
+            public:
+                Batch();
+                Batch(const Atlas &atlas_);
+
+                void draw(
+                    int image, float x, float y, float scale = 1,
+                    const Color &tint = Color(255, 255, 255)
+                );
+                void flush();
+
+                size_t get_size() const;
+        };
+
+        /* Statistics about the frames drawn so far.
+         * Allocation counts are only tracked in debug builds (i.e. when NDEBUG
+         * isn't defined); otherwise they stay at 0.
+         */
+        struct FrameStats {
+            unsigned long frames = 0;
+            unsigned int frame_time = 0;
+
+            unsigned long allocations = 0;
+            unsigned long allocating_frames = 0;
+        };
+
         class BBox {
             public:
                 int x1, y1;
@@ -58,13 +129,38 @@
         // functions
         bool initialize(
             int width, int height, int fps,
-            std::string title, std::string icon
+            std::string title, std::string icon, bool resizable = false
         );
+        bool initialize_headless(int width, int height);
 
         void quit();
         bool update();
 
+        void set_title(const char *title);
+        void set_title(const std::string &title);
+
+        int get_screen_width();
+        int get_screen_height();
+        bool screen_changed();
+
+        bool read_pixels(std::vector<uint32_t> &pixels);
+        bool save_screenshot(const std::string &path);
+
+        bool start_capture(const std::string &path, CaptureFormat format);
+        void stop_capture();
+        CaptureStats get_capture_stats();
+
+        bool start_input_recording(const std::string &path);
+        void stop_input_recording();
+        bool start_input_playback(const std::string &path);
+        const std::vector<float> &get_frame_times();
+
+        const FrameStats &get_frame_stats();
+
         void clear(const Color &color = Color(0, 0, 0, 0));
+        void fill_rect(const BBox &bbox, const Color &color);
+
+        bool key_pressed(SDL_Scancode key);
 
         bool mouse_down();
         bool mouse_clicked();